@@ -1,7 +1,10 @@
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 
 #include <dpusm/provider_api.h>
 
+#include <common.h>
+
 typedef enum alloc_type {
     ALLOC_REAL,
     ALLOC_REF,
@@ -26,9 +29,9 @@ ptr_offset(void *ptr, size_t offset) {
 }
 
 static int
-dpusm_provider_algorithms(int *compress, int *decompress,
-                          int *checksum, int *checksum_byteorder,
-                          int *raid) {
+dpusm_provider_algorithms(u64 *compress, u64 *decompress,
+                          u64 *checksum, u64 *checksum_byteorder,
+                          u64 *raid) {
     *compress           = 0;
     *decompress         = 0;
     *checksum           = 0;
@@ -37,38 +40,30 @@ dpusm_provider_algorithms(int *compress, int *decompress,
     return DPUSM_OK;
 }
 
-static void *
-dpusm_provider_alloc(size_t size) {
-    alloc_t *alloc = kmalloc(sizeof(alloc_t), GFP_KERNEL);
-    if (alloc) {
-        alloc->type = ALLOC_REAL;
-        alloc->ptr = kmalloc(size, GFP_KERNEL);
-        alloc->size = size;
-
-        if (!alloc->ptr) {
-            kfree(alloc);
-            alloc = NULL;
-        }
-    }
+/* alloc_t is embedded in the DPUSM handle, so only the backing memory is allocated here */
+static int
+dpusm_provider_alloc_private(void *handle, size_t size) {
+    alloc_t *alloc = (alloc_t *) handle;
+    alloc->type = ALLOC_REAL;
+    alloc->ptr = kmalloc(size, GFP_KERNEL);
+    alloc->size = size;
 
-    return alloc;
+    return alloc->ptr?DPUSM_OK:DPUSM_ERROR;
 }
 
-static void *
-dpusm_provider_alloc_ref(void *src, size_t offset, size_t size) {
+static int
+dpusm_provider_alloc_ref_private(void *handle, void *src, size_t offset, size_t size) {
     if (!src) {
-        return NULL;
+        return DPUSM_ERROR;
     }
 
     alloc_t *src_handle = (alloc_t *) src;
-    alloc_t *ref = kmalloc(sizeof(alloc_t), GFP_KERNEL);
-    if (ref) {
-        ref->type = ALLOC_REF;
-        ref->ptr = ptr_offset(src_handle->ptr, offset);
-        ref->size = size;
-    }
+    alloc_t *ref = (alloc_t *) handle;
+    ref->type = ALLOC_REF;
+    ref->ptr = ptr_offset(src_handle->ptr, offset);
+    ref->size = size;
 
-    return ref;
+    return DPUSM_OK;
 }
 
 static int
@@ -76,23 +71,57 @@ dpusm_provider_get_size(void *handle, size_t *size, size_t *actual) {
     return DPUSM_ERROR;
 }
 
+/* the alloc_t itself is owned by the DPUSM */
 static int
-dpusm_provider_free(void *handle) {
+dpusm_provider_free_private(void *handle) {
     alloc_t *alloc = (alloc_t *) handle;
-    if (alloc) {
-        switch (alloc->type) {
-            case ALLOC_REAL:
-                kfree(alloc->ptr);
-                break;
-            case ALLOC_REF:
-            case ALLOC_INVALID:
-            default:
-                break;
-        }
+    switch (alloc->type) {
+        case ALLOC_REAL:
+            kfree(alloc->ptr);
+            break;
+        case ALLOC_REF:
+        case ALLOC_INVALID:
+        default:
+            break;
+    }
+
+    alloc->type = ALLOC_INVALID;
+
+    return DPUSM_OK;
+}
 
+/* handles that are not embedded allocate their own alloc_t */
+static void *
+dpusm_provider_alloc(size_t size) {
+    alloc_t *alloc = kmalloc(sizeof(alloc_t), GFP_KERNEL);
+    if (alloc && (dpusm_provider_alloc_private(alloc, size) != DPUSM_OK)) {
         kfree(alloc);
+        alloc = NULL;
     }
 
+    return alloc;
+}
+
+static void *
+dpusm_provider_alloc_ref(void *src, size_t offset, size_t size) {
+    alloc_t *ref = kmalloc(sizeof(alloc_t), GFP_KERNEL);
+    if (ref && (dpusm_provider_alloc_ref_private(ref, src, offset, size) != DPUSM_OK)) {
+        kfree(ref);
+        ref = NULL;
+    }
+
+    return ref;
+}
+
+static int
+dpusm_provider_free(void *handle) {
+    if (!handle) {
+        return DPUSM_ERROR;
+    }
+
+    dpusm_provider_free_private(handle);
+    kfree(handle);
+
     return DPUSM_OK;
 }
 
@@ -122,6 +151,80 @@ dpusm_provider_copy_to_generic(dpusm_mv_t *mv, void *buf, size_t size) {
     return DPUSM_OK;
 }
 
+/*
+ * asynchronous copies are emulated by running the
+ * synchronous copies on a workqueue
+ */
+static struct workqueue_struct *copy_wq = NULL;
+
+typedef struct async_copy {
+    dpusm_mv_t mv;
+    void *buf;
+    size_t size;
+    int to;
+    dpusm_cc_t copy_completion;
+    void *cc_args;
+    struct work_struct work;
+} async_copy_t;
+
+static void
+dpusm_provider_copy_work(struct work_struct *work) {
+    async_copy_t *copy = container_of(work, async_copy_t, work);
+    const int rc = copy->to?
+        dpusm_provider_copy_to_generic(&copy->mv, copy->buf, copy->size):
+        dpusm_provider_copy_from_generic(&copy->mv, copy->buf, copy->size);
+
+    copy->copy_completion(copy->cc_args, rc);
+    kfree(copy);
+}
+
+static int
+dpusm_provider_copy_async(dpusm_mv_t *mv, void *buf, size_t size, int to,
+    dpusm_cc_t copy_completion, void *cc_args) {
+    async_copy_t *copy = kmalloc(sizeof(async_copy_t), GFP_KERNEL);
+    if (!copy) {
+        return DPUSM_ERROR;
+    }
+
+    copy->mv = *mv;
+    copy->buf = buf;
+    copy->size = size;
+    copy->to = to;
+    copy->copy_completion = copy_completion;
+    copy->cc_args = cc_args;
+    INIT_WORK(&copy->work, dpusm_provider_copy_work);
+    queue_work(copy_wq, &copy->work);
+
+    return DPUSM_OK;
+}
+
+static int
+dpusm_provider_copy_from_async(dpusm_mv_t *mv, const void *buf, size_t size,
+    dpusm_cc_t copy_completion, void *cc_args) {
+    return dpusm_provider_copy_async(mv, (void *) buf, size, 0,
+        copy_completion, cc_args);
+}
+
+static int
+dpusm_provider_copy_to_async(dpusm_mv_t *mv, void *buf, size_t size,
+    dpusm_cc_t copy_completion, void *cc_args) {
+    return dpusm_provider_copy_async(mv, buf, size, 1,
+        copy_completion, cc_args);
+}
+
+int
+example_dpusm_provider_init(void) {
+    copy_wq = alloc_workqueue("%s", WQ_UNBOUND, 0, module_name(THIS_MODULE));
+    return copy_wq?0:-ENOMEM;
+}
+
+void
+example_dpusm_provider_fini(void) {
+    destroy_workqueue(copy_wq);
+    copy_wq = NULL;
+}
+
+/* the provider allocates its own handles */
 const dpusm_pf_t example_dpusm_provider_functions = {
     .algorithms                = dpusm_provider_algorithms,
     .alloc                     = dpusm_provider_alloc,
@@ -133,15 +236,21 @@ const dpusm_pf_t example_dpusm_provider_functions = {
                                                  .generic     = dpusm_provider_copy_from_generic,
                                                  .ptr         = NULL,
                                                  .scatterlist = NULL,
+                                                 .async       = dpusm_provider_copy_from_async,
                                              },
                                      .to =   {
                                                  .generic     = dpusm_provider_copy_to_generic,
                                                  .ptr         = NULL,
                                                  .scatterlist = NULL,
+                                                 .async       = dpusm_provider_copy_to_async,
                                              },
                                  },
     .at_connect                = NULL,
     .at_disconnect             = NULL,
+    .private_size              = 0,
+    .alloc_private             = NULL,
+    .alloc_ref_private         = NULL,
+    .free_private              = NULL,
     .mem_stats                 = NULL,
     .zero_fill                 = NULL,
     .all_zeros                 = NULL,
@@ -160,7 +269,61 @@ const dpusm_pf_t example_dpusm_provider_functions = {
                                      .open        = NULL,
                                      .write       = NULL,
                                      .close       = NULL,
+                                 },
+    .disk                      = {
+                                     .open        = NULL,
+                                     .invalidate  = NULL,
+                                     .write       = NULL,
+                                     .flush       = NULL,
+                                     .close       = NULL,
+                                 },
+};
 
+/* handles are embedded in DPUSM handles */
+const dpusm_pf_t example_dpusm_provider_functions_embedded = {
+    .algorithms                = dpusm_provider_algorithms,
+    .alloc                     = NULL,
+    .alloc_ref                 = NULL,
+    .get_size                  = dpusm_provider_get_size,
+    .free                      = NULL,
+    .copy                      = {
+                                     .from = {
+                                                 .generic     = dpusm_provider_copy_from_generic,
+                                                 .ptr         = NULL,
+                                                 .scatterlist = NULL,
+                                                 .async       = dpusm_provider_copy_from_async,
+                                             },
+                                     .to =   {
+                                                 .generic     = dpusm_provider_copy_to_generic,
+                                                 .ptr         = NULL,
+                                                 .scatterlist = NULL,
+                                                 .async       = dpusm_provider_copy_to_async,
+                                             },
+                                 },
+    .at_connect                = NULL,
+    .at_disconnect             = NULL,
+    .private_size              = sizeof(alloc_t),
+    .alloc_private             = dpusm_provider_alloc_private,
+    .alloc_ref_private         = dpusm_provider_alloc_ref_private,
+    .free_private              = dpusm_provider_free_private,
+    .mem_stats                 = NULL,
+    .zero_fill                 = NULL,
+    .all_zeros                 = NULL,
+    .compress                  = NULL,
+    .decompress                = NULL,
+    .checksum                  = NULL,
+    .raid                      = {
+                                     .alloc       = NULL,
+                                     .set_column  = NULL,
+                                     .free        = NULL,
+                                     .gen         = NULL,
+                                     .cmp         = NULL,
+                                     .rec         = NULL,
+                                 },
+    .file                      = {
+                                     .open        = NULL,
+                                     .write       = NULL,
+                                     .close       = NULL,
                                  },
     .disk                      = {
                                      .open        = NULL,
@@ -3,7 +3,18 @@
 
 #include <dpusm/provider_api.h>
 
-/* filled callback struct */
+/*
+ * filled callback structs
+ *
+ * The first allocates provider handles with alloc, alloc_ref, and
+ * free. The second embeds them in DPUSM handles. The example
+ * providers use one each so that both paths are exercised.
+ */
 extern const dpusm_pf_t example_dpusm_provider_functions;
+extern const dpusm_pf_t example_dpusm_provider_functions_embedded;
+
+/* set up and tear down the workqueue used for asynchronous copies */
+int example_dpusm_provider_init(void);
+void example_dpusm_provider_fini(void);
 
 #endif
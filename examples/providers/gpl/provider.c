@@ -6,8 +6,14 @@
 
 static int __init
 dpusm_gpl_provider_init(void) {
-    const int rc = dpusm_register_gpl(THIS_MODULE,
-        &example_dpusm_provider_functions);
+    int rc = example_dpusm_provider_init();
+    if (rc == 0) {
+        rc = dpusm_register_gpl(THIS_MODULE,
+            &example_dpusm_provider_functions_embedded);
+        if (rc) {
+            example_dpusm_provider_fini();
+        }
+    }
     printk("%s init: %d\n", module_name(THIS_MODULE), rc);
     return rc;
 }
@@ -15,6 +21,7 @@ dpusm_gpl_provider_init(void) {
 static void __exit
 dpusm_gpl_provider_exit(void) {
     dpusm_unregister_gpl(THIS_MODULE);
+    example_dpusm_provider_fini();
 
     printk("%s exit\n", module_name(THIS_MODULE));
 }
@@ -0,0 +1,295 @@
+#include <linux/limits.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+
+#include <dpusm/checksum.h>
+
+#include "software.h"
+
+static unsigned long parallel_min = 1 << 20;
+module_param(parallel_min, ulong, 0644);
+MODULE_PARM_DESC(parallel_min, "Smallest checksum_many batch (in bytes) that is spread across CPUs");
+
+/* the host checksum code from the DPUSM with the fastest fletcher from fletcher.c */
+static int
+sw_cksum_update(dpusm_host_cksum_t *hc, const void *buf, size_t size) {
+    switch (hc->alg) {
+        case DPUSM_CHECKSUM_FLETCHER_2:
+            if (size % (2 * sizeof(u64))) {
+                return DPUSM_ERROR;
+            }
+            sw_fletcher_2(buf, size, hc->byteswap, hc->fletcher);
+            return DPUSM_OK;
+        case DPUSM_CHECKSUM_FLETCHER_4:
+            if (size % sizeof(u32)) {
+                return DPUSM_ERROR;
+            }
+            sw_fletcher_4(buf, size, hc->byteswap, hc->fletcher);
+            return DPUSM_OK;
+        default:
+            break;
+    }
+
+    return dpusm_host_cksum_update(hc, buf, size);
+}
+
+static int
+sw_checksum_buf(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    const void *buf, size_t size, void *cksum, size_t cksum_size) {
+    if (!buf || !cksum) {
+        return DPUSM_ERROR;
+    }
+
+    dpusm_host_cksum_t hc;
+    int rc = dpusm_host_cksum_init(&hc, alg, order);
+    if (rc != DPUSM_OK) {
+        return rc;
+    }
+
+    rc = sw_cksum_update(&hc, buf, size);
+    if (rc == DPUSM_OK) {
+        rc = dpusm_host_cksum_final(&hc, cksum, cksum_size);
+    }
+
+    dpusm_host_cksum_fini(&hc);
+    return rc;
+}
+
+/* checksum into a scratch buffer and compare */
+static int
+sw_checksum_cmp(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    const void *buf, size_t size, const void *expected, size_t cksum_size) {
+    u8 stack[64];
+    void *actual = (cksum_size <= sizeof(stack))?stack:kmalloc(cksum_size, GFP_KERNEL);
+    if (!actual) {
+        return DPUSM_ERROR;
+    }
+
+    int rc = sw_checksum_buf(alg, order, buf, size, actual, cksum_size);
+    if ((rc == DPUSM_OK) && memcmp(actual, expected, cksum_size)) {
+        rc = DPUSM_CHECKSUM_MISMATCH;
+    }
+
+    if (actual != stack) {
+        kfree(actual);
+    }
+
+    return rc;
+}
+
+int
+sw_checksum_init(u64 *checksum, u64 *checksum_byteorder) {
+    *checksum = dpusm_host_cksum_algorithms();
+    *checksum_byteorder = DPUSM_BYTEORDER_NATIVE | DPUSM_BYTEORDER_BYTESWAP;
+    return DPUSM_OK;
+}
+
+int
+sw_checksum_properties(dpusm_checksum_t alg, dpusm_ap_t *props) {
+    switch (alg) {
+        case DPUSM_CHECKSUM_FLETCHER_2:
+            props->alignment = 2 * sizeof(u64);
+            props->throughput = sw_fletcher_throughput(0);
+            return DPUSM_OK;
+        case DPUSM_CHECKSUM_FLETCHER_4:
+            props->alignment = sizeof(u32);
+            props->throughput = sw_fletcher_throughput(1);
+            return DPUSM_OK;
+        default:
+            break;
+    }
+
+    /* SHA-2 lengths are passed to the crypto API as unsigned ints */
+    if (!(dpusm_host_cksum_algorithms() & alg)) {
+        return DPUSM_NOT_SUPPORTED;
+    }
+
+    props->max_size = UINT_MAX;
+    return DPUSM_OK;
+}
+
+int
+sw_checksum(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *data, size_t size, void *cksum, size_t cksum_size) {
+    if (!data) {
+        return DPUSM_ERROR;
+    }
+
+    return sw_checksum_buf(alg, order, sw_ptr(data, 0), size, cksum, cksum_size);
+}
+
+int
+sw_checksum_verify(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *data, size_t size, const void *expected, size_t cksum_size) {
+    if (!data || !expected) {
+        return DPUSM_ERROR;
+    }
+
+    return sw_checksum_cmp(alg, order, sw_ptr(data, 0), size, expected, cksum_size);
+}
+
+/* large batches are spread across CPUs */
+typedef struct sw_cksum_batch {
+    dpusm_checksum_t alg;
+    dpusm_checksum_byteorder_t order;
+    size_t count;
+    void **handles;
+    size_t *offsets;
+    size_t *sizes;
+    void *cksums;
+    const void *expected;   /* compare against these instead of writing cksums */
+    size_t cksum_size;
+    int *rcs;
+} sw_cksum_batch_t;
+
+static void
+sw_cksum_batch_one(void *arg, size_t i) {
+    sw_cksum_batch_t *batch = (sw_cksum_batch_t *) arg;
+    const void *buf = batch->handles[i]?
+        sw_ptr(batch->handles[i], batch->offsets[i]):NULL;
+    const size_t offset = i * batch->cksum_size;
+
+    if (!buf) {
+        batch->rcs[i] = DPUSM_ERROR;
+    }
+    else if (batch->expected) {
+        batch->rcs[i] = sw_checksum_cmp(batch->alg, batch->order,
+            buf, batch->sizes[i],
+            ((const u8 *) batch->expected) + offset, batch->cksum_size);
+    }
+    else {
+        batch->rcs[i] = sw_checksum_buf(batch->alg, batch->order,
+            buf, batch->sizes[i],
+            ((u8 *) batch->cksums) + offset, batch->cksum_size);
+    }
+}
+
+static int
+sw_cksum_batch(sw_cksum_batch_t *batch) {
+    size_t total = 0;
+    for(size_t i = 0; i < batch->count; i++) {
+        total += batch->sizes[i];
+    }
+
+    sw_parallel(batch->count, total >= READ_ONCE(parallel_min),
+        sw_cksum_batch_one, batch);
+
+    for(size_t i = 0; i < batch->count; i++) {
+        if (batch->rcs[i] != DPUSM_OK) {
+            return batch->rcs[i];
+        }
+    }
+
+    return DPUSM_OK;
+}
+
+int
+sw_checksum_many(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    size_t count, void **handles, size_t *offsets, size_t *sizes,
+    void *cksums, size_t cksum_size, int *rcs) {
+    sw_cksum_batch_t batch = {
+        .alg        = alg,
+        .order      = order,
+        .count      = count,
+        .handles    = handles,
+        .offsets    = offsets,
+        .sizes      = sizes,
+        .cksums     = cksums,
+        .cksum_size = cksum_size,
+        .rcs        = rcs,
+    };
+
+    return sw_cksum_batch(&batch);
+}
+
+int
+sw_checksum_verify_many(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    size_t count, void **handles, size_t *offsets, size_t *sizes,
+    const void *expected, size_t cksum_size, int *rcs) {
+    if (!expected) {
+        return DPUSM_ERROR;
+    }
+
+    sw_cksum_batch_t batch = {
+        .alg        = alg,
+        .order      = order,
+        .count      = count,
+        .handles    = handles,
+        .offsets    = offsets,
+        .sizes      = sizes,
+        .expected   = expected,
+        .cksum_size = cksum_size,
+        .rcs        = rcs,
+    };
+
+    return sw_cksum_batch(&batch);
+}
+
+void *
+sw_checksum_ctx_init(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order) {
+    dpusm_host_cksum_t *hc = kmalloc(sizeof(dpusm_host_cksum_t), GFP_KERNEL);
+    if (hc && (dpusm_host_cksum_init(hc, alg, order) != DPUSM_OK)) {
+        kfree(hc);
+        hc = NULL;
+    }
+
+    return hc;
+}
+
+int
+sw_checksum_ctx_update(void *ctx, void *handle, size_t offset, size_t size) {
+    if (!ctx || !handle) {
+        return DPUSM_ERROR;
+    }
+
+    return sw_cksum_update(ctx, sw_ptr(handle, offset), size);
+}
+
+int
+sw_checksum_ctx_final(void *ctx, void *cksum, size_t cksum_size) {
+    if (!ctx) {
+        return DPUSM_ERROR;
+    }
+
+    return dpusm_host_cksum_final(ctx, cksum, cksum_size);
+}
+
+void
+sw_checksum_ctx_free(void *ctx) {
+    if (ctx) {
+        dpusm_host_cksum_fini(ctx);
+        kfree(ctx);
+    }
+}
+
+/* checksum each chunk right after copying it, while it is still in cache */
+#define SW_COPY_CKSUM_CHUNK (64 * 1024)
+
+int
+sw_copy_checksum(void *dst, const void *src, size_t size,
+    dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *cksum, size_t cksum_size) {
+    dpusm_host_cksum_t hc;
+    int rc = dpusm_host_cksum_init(&hc, alg, order);
+    if (rc != DPUSM_OK) {
+        return rc;
+    }
+
+    for(size_t offset = 0; offset < size; offset += SW_COPY_CKSUM_CHUNK) {
+        const size_t len = min_t(size_t, size - offset, SW_COPY_CKSUM_CHUNK);
+        void *chunk = ((char *) dst) + offset;
+        memcpy(chunk, ((const char *) src) + offset, len);
+        rc = sw_cksum_update(&hc, chunk, len);
+        if (rc != DPUSM_OK) {
+            break;
+        }
+    }
+
+    if (rc == DPUSM_OK) {
+        rc = dpusm_host_cksum_final(&hc, cksum, cksum_size);
+    }
+
+    dpusm_host_cksum_fini(&hc);
+    return rc;
+}
@@ -0,0 +1,484 @@
+#include <crypto/acompress.h>
+#include <linux/err.h>
+#include <linux/limits.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/version.h>
+#include <linux/wait.h>
+#include <linux/zutil.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
+
+#include "software.h"
+
+/*
+ * The kernel produces raw deflate streams and bare LZ4 blocks, so
+ * they are framed the way other implementations expect: deflate is
+ * wrapped in a zlib header and adler32 trailer, and LZ4 blocks are
+ * prefixed with their big-endian length. zstd output is already a
+ * frame. The kernel picks the compression level, so only that level
+ * is advertised for compression. Any level can be decompressed.
+ *
+ * Each acomp request holds its own compression workspace, which is
+ * expensive to set up, so every algorithm keeps one request per CPU
+ * and callers take turns with them.
+ */
+typedef enum sw_frame {
+    SW_FRAME_NONE,
+    SW_FRAME_ZLIB,
+    SW_FRAME_LZ4,
+} sw_frame_t;
+
+/* zlib header and adler32 trailer (RFC 1950) */
+#define ZLIB_HEADER_SIZE 2
+#define ZLIB_TRAILER_SIZE 4
+#define ZLIB_DEFLATED 8
+
+/*
+ * crypto/deflate.c uses 2^11 byte windows, so that is what the header
+ * says, and streams that need larger windows cannot be decompressed
+ */
+#define SW_DEFLATE_WINBITS 11
+
+/* the length in front of every LZ4 block */
+#define LZ4_HEADER_SIZE 4
+
+typedef struct sw_compressor {
+    const char *name;          /* crypto API algorithm */
+    sw_frame_t frame;          /* what goes around the crypto API output */
+    u64 compress;              /* dpusm_compress_t produced by name */
+    u64 decompress;            /* dpusm_decompress_t readable by name */
+
+    struct crypto_acomp *tfm;
+    spinlock_t lock;
+    wait_queue_head_t wait;    /* waiting for a free request */
+    unsigned int nreqs;
+    unsigned int nfree;
+    struct acomp_req **free;
+} sw_compressor_t;
+
+static sw_compressor_t compressors[] = {
+    { "deflate", SW_FRAME_ZLIB, DPUSM_COMPRESS_GZIP_6, GZIP_ALL           },
+    { "lz4",     SW_FRAME_LZ4,  DPUSM_COMPRESS_LZ4,    DPUSM_COMPRESS_LZ4 },
+    { "zstd",    SW_FRAME_NONE, DPUSM_COMPRESS_ZSTD_3, ZSTD_ALL           },
+};
+
+#define COMPRESSORS (sizeof(compressors) / sizeof(compressors[0]))
+
+static void
+sw_compressor_fini(sw_compressor_t *c) {
+    for(unsigned int i = 0; i < c->nfree; i++) {
+        acomp_request_free(c->free[i]);
+    }
+    kfree(c->free);
+    c->free = NULL;
+    c->nreqs = 0;
+    c->nfree = 0;
+
+    if (c->tfm) {
+        crypto_free_acomp(c->tfm);
+        c->tfm = NULL;
+    }
+}
+
+static int
+sw_compressor_init(sw_compressor_t *c) {
+    spin_lock_init(&c->lock);
+    init_waitqueue_head(&c->wait);
+
+    struct crypto_acomp *tfm = crypto_alloc_acomp(c->name, 0, 0);
+    if (IS_ERR(tfm)) {
+        return PTR_ERR(tfm);
+    }
+    c->tfm = tfm;
+
+    c->nreqs = num_possible_cpus();
+    c->free = kcalloc(c->nreqs, sizeof(struct acomp_req *), GFP_KERNEL);
+    if (!c->free) {
+        sw_compressor_fini(c);
+        return -ENOMEM;
+    }
+
+    for(c->nfree = 0; c->nfree < c->nreqs; c->nfree++) {
+        c->free[c->nfree] = acomp_request_alloc(c->tfm);
+        if (!c->free[c->nfree]) {
+            sw_compressor_fini(c);
+            return -ENOMEM;
+        }
+    }
+
+    return 0;
+}
+
+static struct acomp_req *
+sw_req_tryget(sw_compressor_t *c) {
+    struct acomp_req *req = NULL;
+    spin_lock(&c->lock);
+    if (c->nfree) {
+        req = c->free[--c->nfree];
+    }
+    spin_unlock(&c->lock);
+    return req;
+}
+
+static struct acomp_req *
+sw_req_get(sw_compressor_t *c) {
+    struct acomp_req *req = NULL;
+    wait_event(c->wait, (req = sw_req_tryget(c)) != NULL);
+    return req;
+}
+
+static void
+sw_req_put(sw_compressor_t *c, struct acomp_req *req) {
+    spin_lock(&c->lock);
+    c->free[c->nfree++] = req;
+    spin_unlock(&c->lock);
+    wake_up(&c->wait);
+}
+
+/* handles are kvmalloc-ed, so they might not be physically contiguous */
+typedef struct sw_sg {
+    struct sg_table table;
+    struct scatterlist one;
+} sw_sg_t;
+
+static struct scatterlist *
+sw_sg_init(sw_sg_t *sg, void *buf, size_t size) {
+    sg->table.sgl = NULL;
+
+    if (!is_vmalloc_addr(buf)) {
+        sg_init_one(&sg->one, buf, size);
+        return &sg->one;
+    }
+
+    const unsigned int nents = DIV_ROUND_UP(offset_in_page(buf) + size, PAGE_SIZE);
+    if (sg_alloc_table(&sg->table, nents, GFP_KERNEL)) {
+        return NULL;
+    }
+
+    char *ptr = buf;
+    struct scatterlist *s = NULL;
+    unsigned int i = 0;
+    for_each_sg(sg->table.sgl, s, nents, i) {
+        const size_t len = min_t(size_t, size, PAGE_SIZE - offset_in_page(ptr));
+        sg_set_page(s, vmalloc_to_page(ptr), len, offset_in_page(ptr));
+        ptr += len;
+        size -= len;
+    }
+
+    return sg->table.sgl;
+}
+
+static void
+sw_sg_fini(sw_sg_t *sg) {
+    if (sg->table.sgl) {
+        sg_free_table(&sg->table);
+    }
+}
+
+static int
+sw_acomp(sw_compressor_t *c, int compress,
+    const void *src, size_t s_len, void *dst, size_t *d_len) {
+    if (s_len > UINT_MAX) {
+        return DPUSM_ERROR;
+    }
+
+    /* only the space that can be described to the crypto API is usable */
+    const unsigned int dlen = min_t(size_t, *d_len, UINT_MAX);
+
+    int rc = DPUSM_ERROR;
+    sw_sg_t src_sg;
+    sw_sg_t dst_sg;
+    struct scatterlist *src_sgl = sw_sg_init(&src_sg, (void *) src, s_len);
+    if (!src_sgl) {
+        return DPUSM_ERROR;
+    }
+
+    struct scatterlist *dst_sgl = sw_sg_init(&dst_sg, dst, dlen);
+    if (!dst_sgl) {
+        goto src;
+    }
+
+    struct acomp_req *req = sw_req_get(c);
+    DECLARE_CRYPTO_WAIT(wait);
+    acomp_request_set_callback(req, CRYPTO_TFM_REQ_MAY_BACKLOG,
+        crypto_req_done, &wait);
+    acomp_request_set_params(req, src_sgl, dst_sgl, s_len, dlen);
+
+    const int err = crypto_wait_req(compress?
+        crypto_acomp_compress(req):crypto_acomp_decompress(req), &wait);
+    if (err == 0) {
+        *d_len = req->dlen;
+        rc = DPUSM_OK;
+    }
+    else {
+        rc = DPUSM_BAD_RESULT;
+    }
+
+    sw_req_put(c, req);
+    sw_sg_fini(&dst_sg);
+
+  src:
+    sw_sg_fini(&src_sg);
+    return rc;
+}
+
+/* running out of space for the frame is the same as running out of space for the data */
+static int
+sw_frame_compress(sw_compressor_t *c,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+    if (!src || !dst || !d_len) {
+        return DPUSM_ERROR;
+    }
+
+    const u8 *in = sw_ptr(src, 0);
+    u8 *out = sw_ptr(dst, 0);
+    size_t len = 0;
+    int rc = DPUSM_ERROR;
+
+    switch (c->frame) {
+        case SW_FRAME_ZLIB:
+            if (*d_len < ZLIB_HEADER_SIZE + ZLIB_TRAILER_SIZE) {
+                return DPUSM_BAD_RESULT;
+            }
+
+            len = *d_len - ZLIB_HEADER_SIZE - ZLIB_TRAILER_SIZE;
+            rc = sw_acomp(c, 1, in, s_len, out + ZLIB_HEADER_SIZE, &len);
+            if (rc != DPUSM_OK) {
+                return rc;
+            }
+
+            /* the kernel's default level, with FCHECK making the header a multiple of 31 */
+            out[0] = ((SW_DEFLATE_WINBITS - 8) << 4) | ZLIB_DEFLATED;
+            out[1] = 2 << 6;
+            out[1] |= 31 - (((out[0] << 8) | out[1]) % 31);
+            put_unaligned_be32(zlib_adler32(1, in, s_len),
+                out + ZLIB_HEADER_SIZE + len);
+            *d_len = ZLIB_HEADER_SIZE + len + ZLIB_TRAILER_SIZE;
+            return DPUSM_OK;
+        case SW_FRAME_LZ4:
+            if (*d_len < LZ4_HEADER_SIZE) {
+                return DPUSM_BAD_RESULT;
+            }
+
+            len = *d_len - LZ4_HEADER_SIZE;
+            rc = sw_acomp(c, 1, in, s_len, out + LZ4_HEADER_SIZE, &len);
+            if (rc != DPUSM_OK) {
+                return rc;
+            }
+
+            put_unaligned_be32(len, out);
+            *d_len = LZ4_HEADER_SIZE + len;
+            return DPUSM_OK;
+        case SW_FRAME_NONE:
+        default:
+            break;
+    }
+
+    return sw_acomp(c, 1, in, s_len, out, d_len);
+}
+
+static int
+sw_frame_decompress(sw_compressor_t *c,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+    if (!src || !dst || !d_len) {
+        return DPUSM_ERROR;
+    }
+
+    const u8 *in = sw_ptr(src, 0);
+    u8 *out = sw_ptr(dst, 0);
+    size_t len = 0;
+    int rc = DPUSM_ERROR;
+
+    switch (c->frame) {
+        case SW_FRAME_ZLIB:
+            if (s_len < ZLIB_HEADER_SIZE + ZLIB_TRAILER_SIZE) {
+                return DPUSM_BAD_RESULT;
+            }
+
+            /* preset dictionaries are not supported by the crypto API */
+            if (((in[0] & 0x0f) != ZLIB_DEFLATED) ||
+                (in[1] & 0x20) ||
+                (((in[0] << 8) | in[1]) % 31)) {
+                return DPUSM_BAD_RESULT;
+            }
+
+            if ((in[0] >> 4) > (SW_DEFLATE_WINBITS - 8)) {
+                return DPUSM_NOT_SUPPORTED;
+            }
+
+            len = *d_len;
+            rc = sw_acomp(c, 0, in + ZLIB_HEADER_SIZE,
+                s_len - ZLIB_HEADER_SIZE - ZLIB_TRAILER_SIZE, out, &len);
+            if (rc != DPUSM_OK) {
+                return rc;
+            }
+
+            if (zlib_adler32(1, out, len) !=
+                get_unaligned_be32(in + s_len - ZLIB_TRAILER_SIZE)) {
+                return DPUSM_BAD_RESULT;
+            }
+
+            *d_len = len;
+            return DPUSM_OK;
+        case SW_FRAME_LZ4:
+            if (s_len < LZ4_HEADER_SIZE) {
+                return DPUSM_BAD_RESULT;
+            }
+
+            len = get_unaligned_be32(in);
+            if (len > s_len - LZ4_HEADER_SIZE) {
+                return DPUSM_BAD_RESULT;
+            }
+
+            return sw_acomp(c, 0, in + LZ4_HEADER_SIZE, len, out, d_len);
+        case SW_FRAME_NONE:
+        default:
+            break;
+    }
+
+    return sw_acomp(c, 0, in, s_len, out, d_len);
+}
+
+int
+sw_compress_init(u64 *compress, u64 *decompress) {
+    *compress = 0;
+    *decompress = 0;
+
+    for(size_t i = 0; i < COMPRESSORS; i++) {
+        sw_compressor_t *c = &compressors[i];
+        const int rc = sw_compressor_init(c);
+        if (rc) {
+            printk("%s: %s is not available: %d\n",
+                   module_name(THIS_MODULE), c->name, rc);
+            continue;
+        }
+
+        *compress |= c->compress;
+        *decompress |= c->decompress;
+    }
+
+    return DPUSM_OK;
+}
+
+void
+sw_compress_fini(void) {
+    for(size_t i = 0; i < COMPRESSORS; i++) {
+        sw_compressor_fini(&compressors[i]);
+    }
+}
+
+int
+sw_compress(dpusm_compress_t alg, int level,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+    for(size_t i = 0; i < COMPRESSORS; i++) {
+        sw_compressor_t *c = &compressors[i];
+        if (c->tfm && (c->compress & alg)) {
+            return sw_frame_compress(c, src, s_len, dst, d_len);
+        }
+    }
+
+    return DPUSM_NOT_SUPPORTED;
+}
+
+/*
+ * the compressors give up once dst is full, and the crypto API reports
+ * that as an error like any other, so a failure here means the data
+ * did not compress well enough
+ */
+int
+sw_compress_bounded(dpusm_compress_t alg, int level,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+    const int rc = sw_compress(alg, level, src, s_len, dst, d_len);
+    return (rc == DPUSM_BAD_RESULT)?DPUSM_NOT_COMPRESSIBLE:rc;
+}
+
+int
+sw_decompress(dpusm_decompress_t alg, int *level,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+    for(size_t i = 0; i < COMPRESSORS; i++) {
+        sw_compressor_t *c = &compressors[i];
+        if (c->tfm && (c->decompress & alg)) {
+            return sw_frame_decompress(c, src, s_len, dst, d_len);
+        }
+    }
+
+    return DPUSM_NOT_SUPPORTED;
+}
+
+/* compressors keep one request per CPU, so a batch can use all of them at once */
+typedef struct sw_compress_batch {
+    int compress;
+    u64 alg;
+    int level;
+    int *levels;
+    void **srcs;
+    size_t *s_lens;
+    void **dsts;
+    size_t *d_lens;
+    int *rcs;
+} sw_compress_batch_t;
+
+static void
+sw_compress_batch_one(void *arg, size_t i) {
+    sw_compress_batch_t *batch = (sw_compress_batch_t *) arg;
+    int level = batch->level;
+    batch->rcs[i] = batch->compress?
+        sw_compress(batch->alg, level,
+            batch->srcs[i], batch->s_lens[i], batch->dsts[i], &batch->d_lens[i]):
+        sw_decompress(batch->alg, batch->levels?&batch->levels[i]:&level,
+            batch->srcs[i], batch->s_lens[i], batch->dsts[i], &batch->d_lens[i]);
+}
+
+static int
+sw_compress_batch(sw_compress_batch_t *batch, size_t count) {
+    sw_parallel(count, count > 1, sw_compress_batch_one, batch);
+
+    for(size_t i = 0; i < count; i++) {
+        if (batch->rcs[i] != DPUSM_OK) {
+            return batch->rcs[i];
+        }
+    }
+
+    return DPUSM_OK;
+}
+
+int
+sw_compress_many(dpusm_compress_t alg, int level, size_t count,
+    void **srcs, size_t *s_lens, void **dsts, size_t *d_lens, int *rcs) {
+    sw_compress_batch_t batch = {
+        .compress = 1,
+        .alg      = alg,
+        .level    = level,
+        .srcs     = srcs,
+        .s_lens   = s_lens,
+        .dsts     = dsts,
+        .d_lens   = d_lens,
+        .rcs      = rcs,
+    };
+
+    return sw_compress_batch(&batch, count);
+}
+
+int
+sw_decompress_many(dpusm_decompress_t alg, int *levels, size_t count,
+    void **srcs, size_t *s_lens, void **dsts, size_t *d_lens, int *rcs) {
+    sw_compress_batch_t batch = {
+        .compress = 0,
+        .alg      = alg,
+        .levels   = levels,
+        .srcs     = srcs,
+        .s_lens   = s_lens,
+        .dsts     = dsts,
+        .d_lens   = d_lens,
+        .rcs      = rcs,
+    };
+
+    return sw_compress_batch(&batch, count);
+}
@@ -0,0 +1,173 @@
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/version.h>
+#include <linux/zstd.h>
+
+#include "software.h"
+
+/*
+ * zstd dictionaries
+ *
+ * The crypto API cannot take a dictionary, so these go to lib/zstd
+ * directly. The output is a zstd frame like the one from compress.c,
+ * with the dictionary ID in the frame header. The dictionaries are
+ * read only once they are loaded, so any number of callers can use
+ * one at the same time, and each call gets its own zstd context.
+ */
+
+/* crypto/zstd.c compresses at this level, so it is the only one advertised */
+#define SW_ZSTD_LEVEL 3
+
+/* lib/zstd only has dictionaries with custom allocators since 6.2 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
+#define SW_ZSTD_DICT
+#endif
+
+typedef struct sw_dict {
+    void *buf;                 /* the cdict and ddict point into this */
+    size_t size;
+#ifdef SW_ZSTD_DICT
+    zstd_cdict *cdict;
+    zstd_ddict *ddict;
+#endif
+} sw_dict_t;
+
+#ifdef SW_ZSTD_DICT
+static void *
+sw_zstd_alloc(void *opaque, size_t size) {
+    return kvmalloc(size, GFP_KERNEL);
+}
+
+static void
+sw_zstd_free(void *opaque, void *address) {
+    kvfree(address);
+}
+
+static const zstd_custom_mem sw_zstd_mem = {
+    .customAlloc = sw_zstd_alloc,
+    .customFree  = sw_zstd_free,
+    .opaque      = NULL,
+};
+#endif
+
+void
+sw_dict_free(void *dict) {
+    sw_dict_t *d = (sw_dict_t *) dict;
+    if (!d) {
+        return;
+    }
+
+#ifdef SW_ZSTD_DICT
+    if (d->cdict) {
+        zstd_free_cdict(d->cdict);
+    }
+    if (d->ddict) {
+        zstd_free_ddict(d->ddict);
+    }
+#endif
+    kvfree(d->buf);
+    kfree(d);
+}
+
+void *
+sw_dict_load(dpusm_compress_t algs, const void *buf, size_t size) {
+#ifdef SW_ZSTD_DICT
+    if (algs & ~ZSTD_ALL) {
+        return NULL;
+    }
+
+    sw_dict_t *d = kzalloc(sizeof(sw_dict_t), GFP_KERNEL);
+    if (!d) {
+        return NULL;
+    }
+
+    d->buf = kvmalloc(size, GFP_KERNEL);
+    if (!d->buf) {
+        goto error;
+    }
+    memcpy(d->buf, buf, size);
+    d->size = size;
+
+    const zstd_parameters params = zstd_get_params(SW_ZSTD_LEVEL, 0);
+    d->cdict = zstd_create_cdict_byreference(d->buf, d->size,
+        params.cParams, sw_zstd_mem);
+    d->ddict = zstd_create_ddict_byreference(d->buf, d->size, sw_zstd_mem);
+    if (!d->cdict || !d->ddict) {
+        goto error;
+    }
+
+    return d;
+
+  error:
+    sw_dict_free(d);
+#endif
+    return NULL;
+}
+
+/* like sw_compress, running out of space in dst is a BAD_RESULT */
+int
+sw_dict_compress(void *dict, dpusm_compress_t alg, int level,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+#ifdef SW_ZSTD_DICT
+    sw_dict_t *d = (sw_dict_t *) dict;
+    if (!d || !src || !dst || !d_len) {
+        return DPUSM_ERROR;
+    }
+
+    if (!(alg & DPUSM_COMPRESS_ZSTD_3)) {
+        return DPUSM_NOT_SUPPORTED;
+    }
+
+    zstd_cctx *cctx = zstd_create_cctx_advanced(sw_zstd_mem);
+    if (!cctx) {
+        return DPUSM_ERROR;
+    }
+
+    const size_t rc = zstd_compress_using_cdict(cctx,
+        sw_ptr(dst, 0), *d_len, sw_ptr(src, 0), s_len, d->cdict);
+    zstd_free_cctx(cctx);
+
+    if (zstd_is_error(rc)) {
+        return DPUSM_BAD_RESULT;
+    }
+
+    *d_len = rc;
+    return DPUSM_OK;
+#else
+    return DPUSM_NOT_SUPPORTED;
+#endif
+}
+
+int
+sw_dict_decompress(void *dict, dpusm_decompress_t alg, int *level,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+#ifdef SW_ZSTD_DICT
+    sw_dict_t *d = (sw_dict_t *) dict;
+    if (!d || !src || !dst || !d_len) {
+        return DPUSM_ERROR;
+    }
+
+    if (!(alg & ZSTD_ALL)) {
+        return DPUSM_NOT_SUPPORTED;
+    }
+
+    zstd_dctx *dctx = zstd_create_dctx_advanced(sw_zstd_mem);
+    if (!dctx) {
+        return DPUSM_ERROR;
+    }
+
+    const size_t rc = zstd_decompress_using_ddict(dctx,
+        sw_ptr(dst, 0), *d_len, sw_ptr(src, 0), s_len, d->ddict);
+    zstd_free_dctx(dctx);
+
+    if (zstd_is_error(rc)) {
+        return DPUSM_BAD_RESULT;
+    }
+
+    *d_len = rc;
+    return DPUSM_OK;
+#else
+    return DPUSM_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,830 @@
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/random.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/swab.h>
+
+#ifdef CONFIG_X86_64
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#endif
+
+#include "software.h"
+
+static char *fletcher_impl = "fastest";
+module_param(fletcher_impl, charp, 0444);
+MODULE_PARM_DESC(fletcher_impl, "Fletcher implementation: fastest, scalar, sse2, ssse3, avx2, avx512f, or avx512bw");
+
+/* checksum and byte order combinations */
+typedef enum fletcher_variant {
+    FLETCHER_2_NATIVE,
+    FLETCHER_2_BYTESWAP,
+    FLETCHER_4_NATIVE,
+    FLETCHER_4_BYTESWAP,
+
+    FLETCHER_VARIANTS,
+} fletcher_variant_t;
+
+static const char *FLETCHER_VARIANT_STR[] = {
+    "fletcher_2_native",
+    "fletcher_2_byteswap",
+    "fletcher_4_native",
+    "fletcher_4_byteswap",
+};
+
+#define FLETCHER_LANES_MAX 8
+
+/*
+ * running sums of each lane
+ *
+ * fletcher-4: v[0] to v[3] are a, b, c, and d. With n lanes, lane
+ * j sums words j, j + n, j + 2n, ...
+ *
+ * fletcher-2: v[0] and v[1] are a and b of two interleaved streams
+ * of u64s. With n lanes per stream, lane 2j + s sums u64s
+ * 2j + s, 2j + s + 2n, 2j + s + 4n, ...
+ */
+typedef struct fletcher_ctx {
+    u64 v[4][FLETCHER_LANES_MAX];
+} fletcher_ctx_t;
+
+typedef struct fletcher_ops {
+    /* size is a multiple of block */
+    void (*compute)(fletcher_ctx_t *ctx, const void *buf, size_t size);
+    size_t block;
+    unsigned int lanes;
+} fletcher_ops_t;
+
+typedef struct fletcher_impl {
+    const char *name;
+    bool (*usable)(void);
+    bool simd;                              /* needs the FPU */
+    fletcher_ops_t ops[FLETCHER_VARIANTS];  /* compute is NULL if not implemented */
+    u64 mbps[FLETCHER_VARIANTS];            /* 0 if not usable or wrong */
+} fletcher_impl_t;
+
+/* SIMD code runs with preemption disabled, so give up the FPU every so often */
+#define FLETCHER_SIMD_CHUNK (64 * 1024)
+
+static void
+fletcher_2_scalar_native(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    const u64 *ip = buf;
+    const u64 *end = ip + (size / sizeof(u64));
+    u64 a0 = ctx->v[0][0], a1 = ctx->v[0][1];
+    u64 b0 = ctx->v[1][0], b1 = ctx->v[1][1];
+
+    for(; ip < end; ip += 2) {
+        a0 += ip[0];
+        a1 += ip[1];
+        b0 += a0;
+        b1 += a1;
+    }
+
+    ctx->v[0][0] = a0;
+    ctx->v[0][1] = a1;
+    ctx->v[1][0] = b0;
+    ctx->v[1][1] = b1;
+}
+
+static void
+fletcher_2_scalar_byteswap(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    const u64 *ip = buf;
+    const u64 *end = ip + (size / sizeof(u64));
+    u64 a0 = ctx->v[0][0], a1 = ctx->v[0][1];
+    u64 b0 = ctx->v[1][0], b1 = ctx->v[1][1];
+
+    for(; ip < end; ip += 2) {
+        a0 += swab64(ip[0]);
+        a1 += swab64(ip[1]);
+        b0 += a0;
+        b1 += a1;
+    }
+
+    ctx->v[0][0] = a0;
+    ctx->v[0][1] = a1;
+    ctx->v[1][0] = b0;
+    ctx->v[1][1] = b1;
+}
+
+static void
+fletcher_4_scalar_native(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    const u32 *ip = buf;
+    const u32 *end = ip + (size / sizeof(u32));
+    u64 a = ctx->v[0][0], b = ctx->v[1][0], c = ctx->v[2][0], d = ctx->v[3][0];
+
+    for(; ip < end; ip++) {
+        a += ip[0];
+        b += a;
+        c += b;
+        d += c;
+    }
+
+    ctx->v[0][0] = a;
+    ctx->v[1][0] = b;
+    ctx->v[2][0] = c;
+    ctx->v[3][0] = d;
+}
+
+static void
+fletcher_4_scalar_byteswap(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    const u32 *ip = buf;
+    const u32 *end = ip + (size / sizeof(u32));
+    u64 a = ctx->v[0][0], b = ctx->v[1][0], c = ctx->v[2][0], d = ctx->v[3][0];
+
+    for(; ip < end; ip++) {
+        a += swab32(ip[0]);
+        b += a;
+        c += b;
+        d += c;
+    }
+
+    ctx->v[0][0] = a;
+    ctx->v[1][0] = b;
+    ctx->v[2][0] = c;
+    ctx->v[3][0] = d;
+}
+
+static bool
+fletcher_scalar_usable(void) {
+    return true;
+}
+
+#ifdef CONFIG_X86_64
+
+/* memory operands of the right width */
+typedef struct { u64 v[2]; } fletcher_v128_t;
+typedef struct { u64 v[4]; } fletcher_v256_t;
+typedef struct { u64 v[8]; } fletcher_v512_t;
+
+#define V128(p) (*(fletcher_v128_t *) (p))
+#define V256(p) (*(fletcher_v256_t *) (p))
+#define V512(p) (*(fletcher_v512_t *) (p))
+#define CV128(p) (*(const fletcher_v128_t *) (p))
+#define CV256(p) (*(const fletcher_v256_t *) (p))
+#define CV512(p) (*(const fletcher_v512_t *) (p))
+
+/* pshufb masks, repeated for each 128 bit lane */
+static const fletcher_v512_t fletcher_bswap64 = {{
+    0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL,
+    0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL,
+    0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL,
+    0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL,
+}};
+
+/* swap each u32 in place */
+static const fletcher_v128_t fletcher_bswap32 = {{
+    0x0405060700010203ULL, 0x0c0d0e0f08090a0bULL,
+}};
+
+/* swap the low u32 of each u64 and clear the high u32 */
+static const fletcher_v512_t fletcher_bswap32_zx = {{
+    0xffffffff00010203ULL, 0xffffffff08090a0bULL,
+    0xffffffff00010203ULL, 0xffffffff08090a0bULL,
+    0xffffffff00010203ULL, 0xffffffff08090a0bULL,
+    0xffffffff00010203ULL, 0xffffffff08090a0bULL,
+}};
+
+/* 1 lane per stream */
+static void
+fletcher_2_sse2_native(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    const char *ip = buf;
+    const char *end = ip + size;
+
+    asm volatile("movdqu %0, %%xmm0" :: "m" (V128(ctx->v[0])));
+    asm volatile("movdqu %0, %%xmm1" :: "m" (V128(ctx->v[1])));
+
+    for(; ip < end; ip += 16) {
+        asm volatile("movdqu %0, %%xmm2" :: "m" (CV128(ip)));
+        asm volatile("paddq %xmm2, %xmm0");
+        asm volatile("paddq %xmm0, %xmm1");
+    }
+
+    asm volatile("movdqu %%xmm0, %0" : "=m" (V128(ctx->v[0])));
+    asm volatile("movdqu %%xmm1, %0" : "=m" (V128(ctx->v[1])));
+}
+
+static void
+fletcher_2_ssse3_byteswap(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    const char *ip = buf;
+    const char *end = ip + size;
+
+    asm volatile("movdqu %0, %%xmm0" :: "m" (V128(ctx->v[0])));
+    asm volatile("movdqu %0, %%xmm1" :: "m" (V128(ctx->v[1])));
+    asm volatile("movdqu %0, %%xmm7" :: "m" (fletcher_bswap64));
+
+    for(; ip < end; ip += 16) {
+        asm volatile("movdqu %0, %%xmm2" :: "m" (CV128(ip)));
+        asm volatile("pshufb %xmm7, %xmm2");
+        asm volatile("paddq %xmm2, %xmm0");
+        asm volatile("paddq %xmm0, %xmm1");
+    }
+
+    asm volatile("movdqu %%xmm0, %0" : "=m" (V128(ctx->v[0])));
+    asm volatile("movdqu %%xmm1, %0" : "=m" (V128(ctx->v[1])));
+}
+
+/* 2 lanes - xmm5 holds 4 words, which are added to the lanes 2 at a time */
+#define FLETCHER_4_SSE2_LOOP(load)                                  \
+    for(; ip < end; ip += 16) {                                     \
+        load;                                                       \
+        asm volatile("movdqa %xmm5, %xmm6");                        \
+        asm volatile("punpckldq %xmm7, %xmm5");                     \
+        asm volatile("punpckhdq %xmm7, %xmm6");                     \
+        asm volatile("paddq %xmm5, %xmm0");                         \
+        asm volatile("paddq %xmm0, %xmm1");                         \
+        asm volatile("paddq %xmm1, %xmm2");                         \
+        asm volatile("paddq %xmm2, %xmm3");                         \
+        asm volatile("paddq %xmm6, %xmm0");                         \
+        asm volatile("paddq %xmm0, %xmm1");                         \
+        asm volatile("paddq %xmm1, %xmm2");                         \
+        asm volatile("paddq %xmm2, %xmm3");                         \
+    }
+
+#define FLETCHER_4_SSE2_RESTORE(ctx)                                \
+    asm volatile("movdqu %0, %%xmm0" :: "m" (V128((ctx)->v[0])));   \
+    asm volatile("movdqu %0, %%xmm1" :: "m" (V128((ctx)->v[1])));   \
+    asm volatile("movdqu %0, %%xmm2" :: "m" (V128((ctx)->v[2])));   \
+    asm volatile("movdqu %0, %%xmm3" :: "m" (V128((ctx)->v[3])));   \
+    asm volatile("pxor %xmm7, %xmm7")
+
+#define FLETCHER_4_SSE2_SAVE(ctx)                                   \
+    asm volatile("movdqu %%xmm0, %0" : "=m" (V128((ctx)->v[0])));   \
+    asm volatile("movdqu %%xmm1, %0" : "=m" (V128((ctx)->v[1])));   \
+    asm volatile("movdqu %%xmm2, %0" : "=m" (V128((ctx)->v[2])));   \
+    asm volatile("movdqu %%xmm3, %0" : "=m" (V128((ctx)->v[3])))
+
+static void
+fletcher_4_sse2_native(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    const char *ip = buf;
+    const char *end = ip + size;
+
+    FLETCHER_4_SSE2_RESTORE(ctx);
+    FLETCHER_4_SSE2_LOOP(asm volatile("movdqu %0, %%xmm5" :: "m" (CV128(ip))));
+    FLETCHER_4_SSE2_SAVE(ctx);
+}
+
+static void
+fletcher_4_ssse3_byteswap(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    const char *ip = buf;
+    const char *end = ip + size;
+
+    FLETCHER_4_SSE2_RESTORE(ctx);
+    asm volatile("movdqu %0, %%xmm4" :: "m" (fletcher_bswap32));
+    FLETCHER_4_SSE2_LOOP(
+        asm volatile("movdqu %0, %%xmm5" :: "m" (CV128(ip)));
+        asm volatile("pshufb %xmm4, %xmm5"));
+    FLETCHER_4_SSE2_SAVE(ctx);
+}
+
+/* 2 lanes per stream */
+static void
+fletcher_2_avx2(fletcher_ctx_t *ctx, const void *buf, size_t size, bool byteswap) {
+    const char *ip = buf;
+    const char *end = ip + size;
+
+    asm volatile("vmovdqu %0, %%ymm0" :: "m" (V256(ctx->v[0])));
+    asm volatile("vmovdqu %0, %%ymm1" :: "m" (V256(ctx->v[1])));
+
+    if (byteswap) {
+        asm volatile("vmovdqu %0, %%ymm7" :: "m" (fletcher_bswap64));
+        for(; ip < end; ip += 32) {
+            asm volatile("vmovdqu %0, %%ymm2" :: "m" (CV256(ip)));
+            asm volatile("vpshufb %ymm7, %ymm2, %ymm2");
+            asm volatile("vpaddq %ymm2, %ymm0, %ymm0");
+            asm volatile("vpaddq %ymm0, %ymm1, %ymm1");
+        }
+    }
+    else {
+        for(; ip < end; ip += 32) {
+            asm volatile("vpaddq %0, %%ymm0, %%ymm0" :: "m" (CV256(ip)));
+            asm volatile("vpaddq %ymm0, %ymm1, %ymm1");
+        }
+    }
+
+    asm volatile("vmovdqu %%ymm0, %0" : "=m" (V256(ctx->v[0])));
+    asm volatile("vmovdqu %%ymm1, %0" : "=m" (V256(ctx->v[1])));
+    asm volatile("vzeroupper");
+}
+
+static void
+fletcher_2_avx2_native(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    fletcher_2_avx2(ctx, buf, size, false);
+}
+
+static void
+fletcher_2_avx2_byteswap(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    fletcher_2_avx2(ctx, buf, size, true);
+}
+
+/* 4 lanes - each load zero extends 4 words into the 4 lanes */
+static void
+fletcher_4_avx2(fletcher_ctx_t *ctx, const void *buf, size_t size, bool byteswap) {
+    const char *ip = buf;
+    const char *end = ip + size;
+
+    asm volatile("vmovdqu %0, %%ymm0" :: "m" (V256(ctx->v[0])));
+    asm volatile("vmovdqu %0, %%ymm1" :: "m" (V256(ctx->v[1])));
+    asm volatile("vmovdqu %0, %%ymm2" :: "m" (V256(ctx->v[2])));
+    asm volatile("vmovdqu %0, %%ymm3" :: "m" (V256(ctx->v[3])));
+
+    if (byteswap) {
+        asm volatile("vmovdqu %0, %%ymm5" :: "m" (fletcher_bswap32_zx));
+    }
+
+    for(; ip < end; ip += 16) {
+        asm volatile("vpmovzxdq %0, %%ymm4" :: "m" (CV128(ip)));
+        if (byteswap) {
+            asm volatile("vpshufb %ymm5, %ymm4, %ymm4");
+        }
+        asm volatile("vpaddq %ymm4, %ymm0, %ymm0");
+        asm volatile("vpaddq %ymm0, %ymm1, %ymm1");
+        asm volatile("vpaddq %ymm1, %ymm2, %ymm2");
+        asm volatile("vpaddq %ymm2, %ymm3, %ymm3");
+    }
+
+    asm volatile("vmovdqu %%ymm0, %0" : "=m" (V256(ctx->v[0])));
+    asm volatile("vmovdqu %%ymm1, %0" : "=m" (V256(ctx->v[1])));
+    asm volatile("vmovdqu %%ymm2, %0" : "=m" (V256(ctx->v[2])));
+    asm volatile("vmovdqu %%ymm3, %0" : "=m" (V256(ctx->v[3])));
+    asm volatile("vzeroupper");
+}
+
+static void
+fletcher_4_avx2_native(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    fletcher_4_avx2(ctx, buf, size, false);
+}
+
+static void
+fletcher_4_avx2_byteswap(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    fletcher_4_avx2(ctx, buf, size, true);
+}
+
+/* 4 lanes per stream - byteswap needs AVX512BW for vpshufb */
+static void
+fletcher_2_avx512(fletcher_ctx_t *ctx, const void *buf, size_t size, bool byteswap) {
+    const char *ip = buf;
+    const char *end = ip + size;
+
+    asm volatile("vmovdqu64 %0, %%zmm0" :: "m" (V512(ctx->v[0])));
+    asm volatile("vmovdqu64 %0, %%zmm1" :: "m" (V512(ctx->v[1])));
+
+    if (byteswap) {
+        asm volatile("vmovdqu64 %0, %%zmm7" :: "m" (fletcher_bswap64));
+        for(; ip < end; ip += 64) {
+            asm volatile("vmovdqu64 %0, %%zmm2" :: "m" (CV512(ip)));
+            asm volatile("vpshufb %zmm7, %zmm2, %zmm2");
+            asm volatile("vpaddq %zmm2, %zmm0, %zmm0");
+            asm volatile("vpaddq %zmm0, %zmm1, %zmm1");
+        }
+    }
+    else {
+        for(; ip < end; ip += 64) {
+            asm volatile("vpaddq %0, %%zmm0, %%zmm0" :: "m" (CV512(ip)));
+            asm volatile("vpaddq %zmm0, %zmm1, %zmm1");
+        }
+    }
+
+    asm volatile("vmovdqu64 %%zmm0, %0" : "=m" (V512(ctx->v[0])));
+    asm volatile("vmovdqu64 %%zmm1, %0" : "=m" (V512(ctx->v[1])));
+    asm volatile("vzeroupper");
+}
+
+static void
+fletcher_2_avx512f_native(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    fletcher_2_avx512(ctx, buf, size, false);
+}
+
+static void
+fletcher_2_avx512bw_byteswap(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    fletcher_2_avx512(ctx, buf, size, true);
+}
+
+/* 8 lanes */
+static void
+fletcher_4_avx512(fletcher_ctx_t *ctx, const void *buf, size_t size, bool byteswap) {
+    const char *ip = buf;
+    const char *end = ip + size;
+
+    asm volatile("vmovdqu64 %0, %%zmm0" :: "m" (V512(ctx->v[0])));
+    asm volatile("vmovdqu64 %0, %%zmm1" :: "m" (V512(ctx->v[1])));
+    asm volatile("vmovdqu64 %0, %%zmm2" :: "m" (V512(ctx->v[2])));
+    asm volatile("vmovdqu64 %0, %%zmm3" :: "m" (V512(ctx->v[3])));
+
+    if (byteswap) {
+        asm volatile("vmovdqu64 %0, %%zmm5" :: "m" (fletcher_bswap32_zx));
+    }
+
+    for(; ip < end; ip += 32) {
+        asm volatile("vpmovzxdq %0, %%zmm4" :: "m" (CV256(ip)));
+        if (byteswap) {
+            asm volatile("vpshufb %zmm5, %zmm4, %zmm4");
+        }
+        asm volatile("vpaddq %zmm4, %zmm0, %zmm0");
+        asm volatile("vpaddq %zmm0, %zmm1, %zmm1");
+        asm volatile("vpaddq %zmm1, %zmm2, %zmm2");
+        asm volatile("vpaddq %zmm2, %zmm3, %zmm3");
+    }
+
+    asm volatile("vmovdqu64 %%zmm0, %0" : "=m" (V512(ctx->v[0])));
+    asm volatile("vmovdqu64 %%zmm1, %0" : "=m" (V512(ctx->v[1])));
+    asm volatile("vmovdqu64 %%zmm2, %0" : "=m" (V512(ctx->v[2])));
+    asm volatile("vmovdqu64 %%zmm3, %0" : "=m" (V512(ctx->v[3])));
+    asm volatile("vzeroupper");
+}
+
+static void
+fletcher_4_avx512f_native(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    fletcher_4_avx512(ctx, buf, size, false);
+}
+
+static void
+fletcher_4_avx512bw_byteswap(fletcher_ctx_t *ctx, const void *buf, size_t size) {
+    fletcher_4_avx512(ctx, buf, size, true);
+}
+
+static bool
+fletcher_sse2_usable(void) {
+    return boot_cpu_has(X86_FEATURE_XMM2);
+}
+
+static bool
+fletcher_ssse3_usable(void) {
+    return fletcher_sse2_usable() && boot_cpu_has(X86_FEATURE_SSSE3);
+}
+
+static bool
+fletcher_avx2_usable(void) {
+    return boot_cpu_has(X86_FEATURE_AVX2) &&
+        cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM, NULL);
+}
+
+static bool
+fletcher_avx512f_usable(void) {
+    return boot_cpu_has(X86_FEATURE_AVX512F) &&
+        cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM |
+                          XFEATURE_MASK_AVX512, NULL);
+}
+
+static bool
+fletcher_avx512bw_usable(void) {
+    return fletcher_avx512f_usable() && boot_cpu_has(X86_FEATURE_AVX512BW);
+}
+
+#endif
+
+static fletcher_impl_t fletcher_impls[] = {
+    {
+        .name   = "scalar",
+        .usable = fletcher_scalar_usable,
+        .simd   = false,
+        .ops    = {
+            [FLETCHER_2_NATIVE]   = { fletcher_2_scalar_native,   16, 1 },
+            [FLETCHER_2_BYTESWAP] = { fletcher_2_scalar_byteswap, 16, 1 },
+            [FLETCHER_4_NATIVE]   = { fletcher_4_scalar_native,    4, 1 },
+            [FLETCHER_4_BYTESWAP] = { fletcher_4_scalar_byteswap,  4, 1 },
+        },
+    },
+#ifdef CONFIG_X86_64
+    {
+        .name   = "sse2",
+        .usable = fletcher_sse2_usable,
+        .simd   = true,
+        .ops    = {
+            [FLETCHER_2_NATIVE]   = { fletcher_2_sse2_native,     16, 1 },
+            [FLETCHER_4_NATIVE]   = { fletcher_4_sse2_native,     16, 2 },
+        },
+    },
+    {
+        .name   = "ssse3",
+        .usable = fletcher_ssse3_usable,
+        .simd   = true,
+        .ops    = {
+            [FLETCHER_2_BYTESWAP] = { fletcher_2_ssse3_byteswap,  16, 1 },
+            [FLETCHER_4_BYTESWAP] = { fletcher_4_ssse3_byteswap,  16, 2 },
+        },
+    },
+    {
+        .name   = "avx2",
+        .usable = fletcher_avx2_usable,
+        .simd   = true,
+        .ops    = {
+            [FLETCHER_2_NATIVE]   = { fletcher_2_avx2_native,     32, 2 },
+            [FLETCHER_2_BYTESWAP] = { fletcher_2_avx2_byteswap,   32, 2 },
+            [FLETCHER_4_NATIVE]   = { fletcher_4_avx2_native,     16, 4 },
+            [FLETCHER_4_BYTESWAP] = { fletcher_4_avx2_byteswap,   16, 4 },
+        },
+    },
+    {
+        .name   = "avx512f",
+        .usable = fletcher_avx512f_usable,
+        .simd   = true,
+        .ops    = {
+            [FLETCHER_2_NATIVE]   = { fletcher_2_avx512f_native,  64, 4 },
+            [FLETCHER_4_NATIVE]   = { fletcher_4_avx512f_native,  32, 8 },
+        },
+    },
+    {
+        .name   = "avx512bw",
+        .usable = fletcher_avx512bw_usable,
+        .simd   = true,
+        .ops    = {
+            [FLETCHER_2_BYTESWAP] = { fletcher_2_avx512bw_byteswap, 64, 4 },
+            [FLETCHER_4_BYTESWAP] = { fletcher_4_avx512bw_byteswap, 32, 8 },
+        },
+    },
+#endif
+};
+
+#define FLETCHER_IMPLS (sizeof(fletcher_impls) / sizeof(fletcher_impls[0]))
+
+/* scalar until the benchmark has run */
+static const fletcher_impl_t *fletcher_selected[FLETCHER_VARIANTS] = {
+    &fletcher_impls[0], &fletcher_impls[0], &fletcher_impls[0], &fletcher_impls[0],
+};
+
+static void
+fletcher_simd_begin(const fletcher_impl_t *impl) {
+#ifdef CONFIG_X86_64
+    if (impl->simd) {
+        kernel_fpu_begin();
+    }
+#endif
+}
+
+static void
+fletcher_simd_end(const fletcher_impl_t *impl) {
+#ifdef CONFIG_X86_64
+    if (impl->simd) {
+        kernel_fpu_end();
+    }
+#endif
+}
+
+/*
+ * merge the lanes into one checksum
+ *
+ * With n lanes, lane j sees every nth word starting at word j, so
+ * the coefficients below are what it takes to turn the lanes' sums
+ * back into the sums of a single pass over the data.
+ */
+static void
+fletcher_combine(fletcher_variant_t variant, u64 n,
+    const fletcher_ctx_t *ctx, u64 *cksum) {
+    const u64 *a = ctx->v[0];
+    const u64 *b = ctx->v[1];
+    const u64 *c = ctx->v[2];
+    const u64 *d = ctx->v[3];
+
+    if ((variant == FLETCHER_2_NATIVE) || (variant == FLETCHER_2_BYTESWAP)) {
+        for(u64 s = 0; s < 2; s++) {
+            u64 A = 0, B = 0;
+            for(u64 j = 0; j < n; j++) {
+                const u64 l = 2 * j + s;
+                A += a[l];
+                B += n * b[l] - j * a[l];
+            }
+            cksum[s] = A;
+            cksum[2 + s] = B;
+        }
+        return;
+    }
+
+    u64 A = 0, B = 0, C = 0, D = 0;
+    for(u64 j = 0; j < n; j++) {
+        A += a[j];
+        B += n * b[j] - j * a[j];
+        C += n * n * c[j]
+            - (n * (n - 1) / 2 + n * j) * b[j]
+            + (j * (j - 1) / 2) * a[j];
+        D += n * n * n * d[j]
+            - n * n * (n - 1 + j) * c[j]
+            + (n * (n - 1) * (n - 2) / 6 + (n * (n - 1) / 2) * j + n * (j * (j - 1) / 2)) * b[j]
+            - (j * (j - 1) * (j - 2) / 6) * a[j];
+    }
+
+    cksum[0] = A;
+    cksum[1] = B;
+    cksum[2] = C;
+    cksum[3] = D;
+}
+
+/* put a checksum back into the lanes of the scalar code */
+static void
+fletcher_uncombine(fletcher_variant_t variant, const u64 *cksum,
+    fletcher_ctx_t *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+    if ((variant == FLETCHER_2_NATIVE) || (variant == FLETCHER_2_BYTESWAP)) {
+        ctx->v[0][0] = cksum[0];
+        ctx->v[0][1] = cksum[1];
+        ctx->v[1][0] = cksum[2];
+        ctx->v[1][1] = cksum[3];
+    }
+    else {
+        for(size_t i = 0; i < 4; i++) {
+            ctx->v[i][0] = cksum[i];
+        }
+    }
+}
+
+static void
+fletcher_run(const fletcher_impl_t *impl, fletcher_variant_t variant,
+    const void *buf, size_t size, u64 *cksum) {
+    const fletcher_ops_t *ops = &impl->ops[variant];
+    const size_t main = size - (size % ops->block);
+
+    fletcher_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    for(size_t offset = 0; offset < main; offset += FLETCHER_SIMD_CHUNK) {
+        fletcher_simd_begin(impl);
+        ops->compute(&ctx, ((const char *) buf) + offset,
+            min_t(size_t, main - offset, FLETCHER_SIMD_CHUNK));
+        fletcher_simd_end(impl);
+    }
+    fletcher_combine(variant, ops->lanes, &ctx, cksum);
+
+    /* finish the words that did not fill a block */
+    if (main < size) {
+        fletcher_uncombine(variant, cksum, &ctx);
+        fletcher_impls[0].ops[variant].compute(&ctx,
+            ((const char *) buf) + main, size - main);
+        fletcher_combine(variant, 1, &ctx, cksum);
+    }
+}
+
+/* n(n + 1) / 2 */
+static u64
+fletcher_tri(u64 n) {
+    return (n % 2)?(n * ((n + 1) / 2)):((n / 2) * (n + 1));
+}
+
+/* n(n + 1)(n + 2) / 6, dividing before the product can wrap */
+static u64
+fletcher_tet(u64 n) {
+    u64 f[3] = { n, n + 1, n + 2 };
+    f[(3 - (n % 3)) % 3] /= 3;
+    for(size_t i = 0; i < 3; i++) {
+        if (!(f[i] % 2)) {
+            f[i] /= 2;
+            break;
+        }
+    }
+    return f[0] * f[1] * f[2];
+}
+
+/* cksum covers some data - extend it with size bytes whose checksum is seg */
+static void
+fletcher_append(fletcher_variant_t variant, size_t size, const u64 *seg, u64 *cksum) {
+    if ((variant == FLETCHER_2_NATIVE) || (variant == FLETCHER_2_BYTESWAP)) {
+        const u64 n = size / (2 * sizeof(u64));
+        for(size_t s = 0; s < 2; s++) {
+            cksum[2 + s] += n * cksum[s] + seg[2 + s];
+            cksum[s] += seg[s];
+        }
+        return;
+    }
+
+    const u64 n = size / sizeof(u32);
+    cksum[3] += n * cksum[2] + fletcher_tri(n) * cksum[1] + fletcher_tet(n) * cksum[0] + seg[3];
+    cksum[2] += n * cksum[1] + fletcher_tri(n) * cksum[0] + seg[2];
+    cksum[1] += n * cksum[0] + seg[1];
+    cksum[0] += seg[0];
+}
+
+static void
+fletcher_update(fletcher_variant_t variant, const void *buf, size_t size, u64 *cksum) {
+    u64 seg[4];
+    fletcher_run(READ_ONCE(fletcher_selected[variant]), variant, buf, size, seg);
+    fletcher_append(variant, size, seg, cksum);
+}
+
+void
+sw_fletcher_2(const void *buf, size_t size, int byteswap, u64 *cksum) {
+    fletcher_update(byteswap?FLETCHER_2_BYTESWAP:FLETCHER_2_NATIVE, buf, size, cksum);
+}
+
+void
+sw_fletcher_4(const void *buf, size_t size, int byteswap, u64 *cksum) {
+    fletcher_update(byteswap?FLETCHER_4_BYTESWAP:FLETCHER_4_NATIVE, buf, size, cksum);
+}
+
+u64
+sw_fletcher_throughput(int fletcher_4) {
+    const fletcher_variant_t variant = fletcher_4?FLETCHER_4_NATIVE:FLETCHER_2_NATIVE;
+    return READ_ONCE(fletcher_selected[variant])->mbps[variant] * 1000000;
+}
+
+/* not a multiple of any block size, so the scalar tail is checked too */
+#define FLETCHER_BENCH_SIZE ((128 * 1024) - 48)
+#define FLETCHER_BENCH_NS   (2 * NSEC_PER_MSEC)
+
+/* returns MB/s, or 0 if the implementation disagrees with the scalar code */
+static u64
+fletcher_bench(const fletcher_impl_t *impl, fletcher_variant_t variant,
+    const void *buf) {
+    u64 expected[4];
+    u64 cksum[4];
+    fletcher_run(&fletcher_impls[0], variant, buf, FLETCHER_BENCH_SIZE, expected);
+    fletcher_run(impl, variant, buf, FLETCHER_BENCH_SIZE, cksum);
+    if (memcmp(expected, cksum, sizeof(cksum))) {
+        printk("%s: %s %s is wrong - not using it\n", module_name(THIS_MODULE),
+               impl->name, FLETCHER_VARIANT_STR[variant]);
+        return 0;
+    }
+
+    u64 bytes = 0;
+    u64 elapsed = 0;
+    const u64 start = ktime_get_ns();
+    do {
+        fletcher_run(impl, variant, buf, FLETCHER_BENCH_SIZE, cksum);
+        bytes += FLETCHER_BENCH_SIZE;
+        elapsed = ktime_get_ns() - start;
+    } while (elapsed < FLETCHER_BENCH_NS);
+
+    return max_t(u64, div64_u64(bytes * 1000, elapsed), 1);
+}
+
+static int
+fletcher_show(struct seq_file *m, void *v) {
+    seq_printf(m, "%-12s", "impl");
+    for(size_t var = 0; var < FLETCHER_VARIANTS; var++) {
+        seq_printf(m, " %20s", FLETCHER_VARIANT_STR[var]);
+    }
+    seq_printf(m, "\n");
+
+    /* GB/s, with the implementations in use marked */
+    for(size_t i = 0; i < FLETCHER_IMPLS; i++) {
+        const fletcher_impl_t *impl = &fletcher_impls[i];
+        seq_printf(m, "%-12s", impl->name);
+        for(size_t var = 0; var < FLETCHER_VARIANTS; var++) {
+            const u64 mbps = impl->mbps[var];
+            if (!mbps) {
+                seq_printf(m, " %19s ", "-");
+                continue;
+            }
+            seq_printf(m, " %16llu.%02llu%c", mbps / 1000, (mbps % 1000) / 10,
+                       (fletcher_selected[var] == impl)?'*':' ');
+        }
+        seq_printf(m, "\n");
+    }
+
+    return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(fletcher);
+
+int
+sw_fletcher_init(struct dentry *debugfs) {
+    void *buf = kvmalloc(FLETCHER_BENCH_SIZE, GFP_KERNEL);
+    if (!buf) {
+        return -ENOMEM;
+    }
+    get_random_bytes(buf, FLETCHER_BENCH_SIZE);
+
+    for(size_t i = 0; i < FLETCHER_IMPLS; i++) {
+        fletcher_impl_t *impl = &fletcher_impls[i];
+        if (!impl->usable()) {
+            continue;
+        }
+
+        for(size_t var = 0; var < FLETCHER_VARIANTS; var++) {
+            if (impl->ops[var].compute) {
+                impl->mbps[var] = fletcher_bench(impl, var, buf);
+            }
+        }
+    }
+
+    kvfree(buf);
+
+    for(size_t var = 0; var < FLETCHER_VARIANTS; var++) {
+        const fletcher_impl_t *fastest = &fletcher_impls[0];
+        const fletcher_impl_t *forced = NULL;
+        for(size_t i = 0; i < FLETCHER_IMPLS; i++) {
+            const fletcher_impl_t *impl = &fletcher_impls[i];
+            if (!impl->mbps[var]) {
+                continue;
+            }
+
+            if (impl->mbps[var] > fastest->mbps[var]) {
+                fastest = impl;
+            }
+
+            if (!strcmp(impl->name, fletcher_impl)) {
+                forced = impl;
+            }
+        }
+
+        WRITE_ONCE(fletcher_selected[var], forced?forced:fastest);
+        printk("%s: %s: %s\n", module_name(THIS_MODULE),
+               FLETCHER_VARIANT_STR[var], fletcher_selected[var]->name);
+    }
+
+    debugfs_create_file("fletcher", 0444, debugfs, NULL, &fletcher_fops);
+    return 0;
+}
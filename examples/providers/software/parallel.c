@@ -0,0 +1,84 @@
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+
+#include "software.h"
+
+/*
+ * work is split between the caller and workers on sw_wq,
+ * which take items in order until there are none left
+ */
+typedef struct sw_parallel {
+    size_t count;
+    sw_parallel_fn_t fn;
+    void *arg;
+
+    atomic_t next;      /* next item to run */
+    atomic_t workers;   /* workers that have not finished */
+    struct completion done;
+} sw_parallel_t;
+
+typedef struct sw_parallel_worker {
+    sw_parallel_t *p;
+    struct work_struct work;
+} sw_parallel_worker_t;
+
+static void
+sw_parallel_run(sw_parallel_t *p) {
+    size_t i = 0;
+    while ((i = atomic_inc_return(&p->next) - 1) < p->count) {
+        p->fn(p->arg, i);
+    }
+}
+
+static void
+sw_parallel_work(struct work_struct *work) {
+    sw_parallel_worker_t *worker = container_of(work, sw_parallel_worker_t, work);
+    sw_parallel_t *p = worker->p;
+
+    sw_parallel_run(p);
+    if (atomic_dec_and_test(&p->workers)) {
+        complete(&p->done);
+    }
+}
+
+void
+sw_parallel(size_t count, int spread, sw_parallel_fn_t fn, void *arg) {
+    sw_parallel_t p = {
+        .count = count,
+        .fn    = fn,
+        .arg   = arg,
+    };
+    atomic_set(&p.next, 0);
+    init_completion(&p.done);
+
+    /* the caller takes a share of the work too */
+    size_t nworkers = 0;
+    sw_parallel_worker_t *workers = NULL;
+    if (spread && count) {
+        nworkers = min_t(size_t, count, num_online_cpus()) - 1;
+    }
+
+    if (nworkers) {
+        workers = kmalloc_array(nworkers, sizeof(sw_parallel_worker_t), GFP_KERNEL);
+        if (!workers) {
+            nworkers = 0;
+        }
+    }
+
+    atomic_set(&p.workers, nworkers);
+    for(size_t i = 0; i < nworkers; i++) {
+        workers[i].p = &p;
+        INIT_WORK(&workers[i].work, sw_parallel_work);
+        queue_work(sw_wq, &workers[i].work);
+    }
+
+    sw_parallel_run(&p);
+
+    if (nworkers) {
+        wait_for_completion(&p.done);
+    }
+    kfree(workers);
+}
@@ -0,0 +1,310 @@
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "software.h"
+
+struct workqueue_struct *sw_wq = NULL;
+static struct dentry *sw_debugfs = NULL;
+
+/* filled in at init with whatever the kernel provides */
+static u64 sw_compress_algs = 0;
+static u64 sw_decompress_algs = 0;
+static u64 sw_checksum_algs = 0;
+static u64 sw_checksum_byteorders = 0;
+static u64 sw_raid_algs = 0;
+
+static int
+sw_algorithms(u64 *compress, u64 *decompress,
+              u64 *checksum, u64 *checksum_byteorder,
+              u64 *raid) {
+    *compress           = sw_compress_algs;
+    *decompress         = sw_decompress_algs;
+    *checksum           = sw_checksum_algs;
+    *checksum_byteorder = sw_checksum_byteorders;
+    *raid               = sw_raid_algs;
+    return DPUSM_OK;
+}
+
+static int
+sw_algorithm_properties(dpusm_op_type_t type, u64 alg, dpusm_ap_t *props) {
+    switch (type) {
+        case DPUSM_OP_COMPRESS:
+        case DPUSM_OP_DECOMPRESS:
+            /* the crypto API takes unsigned int lengths */
+            props->max_size = UINT_MAX;
+            return DPUSM_OK;
+        case DPUSM_OP_CHECKSUM:
+            return sw_checksum_properties(alg, props);
+        default:
+            break;
+    }
+
+    return DPUSM_NOT_SUPPORTED;
+}
+
+/* sw_alloc_t is embedded in the DPUSM handle, so only the backing memory is allocated here */
+static int
+sw_alloc_private(void *handle, size_t size) {
+    sw_alloc_t *alloc = (sw_alloc_t *) handle;
+    alloc->ptr = kvmalloc(size, GFP_KERNEL);
+    alloc->size = size;
+    alloc->ref = 0;
+
+    return alloc->ptr?DPUSM_OK:DPUSM_ERROR;
+}
+
+static int
+sw_alloc_ref_private(void *handle, void *src, size_t offset, size_t size) {
+    sw_alloc_t *src_alloc = (sw_alloc_t *) src;
+    if (!src_alloc || (offset + size > src_alloc->size)) {
+        return DPUSM_ERROR;
+    }
+
+    sw_alloc_t *ref = (sw_alloc_t *) handle;
+    ref->ptr = sw_ptr(src_alloc, offset);
+    ref->size = size;
+    ref->ref = 1;
+
+    return DPUSM_OK;
+}
+
+static int
+sw_get_size(void *handle, size_t *size, size_t *actual) {
+    sw_alloc_t *alloc = (sw_alloc_t *) handle;
+    if (!alloc) {
+        return DPUSM_ERROR;
+    }
+
+    if (size) {
+        *size = alloc->size;
+    }
+
+    if (actual) {
+        *actual = alloc->size;
+    }
+
+    return DPUSM_OK;
+}
+
+/* the sw_alloc_t itself is owned by the DPUSM */
+static int
+sw_free_private(void *handle) {
+    sw_alloc_t *alloc = (sw_alloc_t *) handle;
+    if (!alloc->ref) {
+        kvfree(alloc->ptr);
+    }
+    alloc->ptr = NULL;
+
+    return DPUSM_OK;
+}
+
+static int
+sw_copy_from_generic(dpusm_mv_t *mv, const void *buf, size_t size) {
+    if (!mv->handle) {
+        return DPUSM_ERROR;
+    }
+
+    memcpy(sw_ptr(mv->handle, mv->offset), buf, size);
+    return DPUSM_OK;
+}
+
+static int
+sw_copy_from_scatterlist(dpusm_mv_t *mv, struct scatterlist *sgl,
+    unsigned int nents, size_t size) {
+    if (!mv->handle) {
+        return DPUSM_ERROR;
+    }
+
+    return (sg_copy_to_buffer(sgl, nents, sw_ptr(mv->handle, mv->offset), size) == size)?
+        DPUSM_OK:DPUSM_ERROR;
+}
+
+static int
+sw_copy_to_generic(dpusm_mv_t *mv, void *buf, size_t size) {
+    if (!mv->handle) {
+        return DPUSM_ERROR;
+    }
+
+    memcpy(buf, sw_ptr(mv->handle, mv->offset), size);
+    return DPUSM_OK;
+}
+
+static int
+sw_copy_to_scatterlist(dpusm_mv_t *mv, struct scatterlist *sgl,
+    unsigned int nents, size_t size) {
+    if (!mv->handle) {
+        return DPUSM_ERROR;
+    }
+
+    return (sg_copy_from_buffer(sgl, nents, sw_ptr(mv->handle, mv->offset), size) == size)?
+        DPUSM_OK:DPUSM_ERROR;
+}
+
+static int
+sw_copy_from_checksum(dpusm_mv_t *mv, const void *buf, size_t size,
+    dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *cksum, size_t cksum_size) {
+    if (!mv->handle) {
+        return DPUSM_ERROR;
+    }
+
+    return sw_copy_checksum(sw_ptr(mv->handle, mv->offset), buf, size,
+        alg, order, cksum, cksum_size);
+}
+
+static int
+sw_copy_to_checksum(dpusm_mv_t *mv, void *buf, size_t size,
+    dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *cksum, size_t cksum_size) {
+    if (!mv->handle) {
+        return DPUSM_ERROR;
+    }
+
+    return sw_copy_checksum(buf, sw_ptr(mv->handle, mv->offset), size,
+        alg, order, cksum, cksum_size);
+}
+
+/* handles of other providers cannot be dereferenced */
+static int
+sw_copy_peer(dpusm_mv_t *local, const char *remote,
+    dpusm_mv_t *remote_mv, size_t size, int to_remote) {
+    if (strcmp(remote, module_name(THIS_MODULE))) {
+        return DPUSM_NOT_SUPPORTED;
+    }
+
+    void *local_ptr = sw_ptr(local->handle, local->offset);
+    void *remote_ptr = sw_ptr(remote_mv->handle, remote_mv->offset);
+    if (to_remote) {
+        memcpy(remote_ptr, local_ptr, size);
+    }
+    else {
+        memcpy(local_ptr, remote_ptr, size);
+    }
+
+    return DPUSM_OK;
+}
+
+static int
+sw_zero_fill(void *handle, size_t offset, size_t size) {
+    memset(sw_ptr(handle, offset), 0, size);
+    return DPUSM_OK;
+}
+
+static int
+sw_all_zeros(void *handle, size_t offset, size_t size) {
+    return memchr_inv(sw_ptr(handle, offset), 0, size)?DPUSM_BAD_RESULT:DPUSM_OK;
+}
+
+static const dpusm_pf_t sw_provider_functions = {
+    .algorithms                = sw_algorithms,
+    .algorithm_properties      = sw_algorithm_properties,
+    .alloc                     = NULL,
+    .alloc_ref                 = NULL,
+    .get_size                  = sw_get_size,
+    .free                      = NULL,
+    .copy                      = {
+                                     .from = {
+                                                 .generic     = sw_copy_from_generic,
+                                                 .ptr         = sw_copy_from_generic,
+                                                 .scatterlist = sw_copy_from_scatterlist,
+                                                 .async       = NULL,
+                                                 .checksum    = sw_copy_from_checksum,
+                                             },
+                                     .to =   {
+                                                 .generic     = sw_copy_to_generic,
+                                                 .ptr         = sw_copy_to_generic,
+                                                 .scatterlist = sw_copy_to_scatterlist,
+                                                 .async       = NULL,
+                                                 .checksum    = sw_copy_to_checksum,
+                                             },
+                                     .peer = sw_copy_peer,
+                                 },
+    .at_connect                = NULL,
+    .at_disconnect             = NULL,
+    .private_size              = sizeof(sw_alloc_t),
+    .alloc_private             = sw_alloc_private,
+    .alloc_ref_private         = sw_alloc_ref_private,
+    .free_private              = sw_free_private,
+    .mem_stats                 = NULL,
+    .zero_fill                 = sw_zero_fill,
+    .all_zeros                 = sw_all_zeros,
+    .compress                  = sw_compress,
+    .compress_bounded          = sw_compress_bounded,
+    .decompress                = sw_decompress,
+    .compress_many             = sw_compress_many,
+    .decompress_many           = sw_decompress_many,
+    .dict                      = {
+                                     .load        = sw_dict_load,
+                                     .compress    = sw_dict_compress,
+                                     .decompress  = sw_dict_decompress,
+                                     .free        = sw_dict_free,
+                                 },
+    .checksum                  = sw_checksum,
+    .checksum_many             = sw_checksum_many,
+    .checksum_verify           = sw_checksum_verify,
+    .checksum_verify_many      = sw_checksum_verify_many,
+    .checksum_ctx              = {
+                                     .init        = sw_checksum_ctx_init,
+                                     .update      = sw_checksum_ctx_update,
+                                     .final       = sw_checksum_ctx_final,
+                                     .free        = sw_checksum_ctx_free,
+                                 },
+    .raid                      = {
+                                     .can_compute = sw_raid_can_compute,
+                                     .alloc       = sw_raid_alloc,
+                                     .set_column  = sw_raid_set_column,
+                                     .free        = sw_raid_free,
+                                     .gen         = sw_raid_gen,
+                                     .cmp         = sw_raid_cmp,
+                                     .rec         = sw_raid_rec,
+                                 },
+};
+
+static int __init
+dpusm_software_provider_init(void) {
+    sw_wq = alloc_workqueue("%s", WQ_UNBOUND, 0, module_name(THIS_MODULE));
+    if (!sw_wq) {
+        return -ENOMEM;
+    }
+
+    sw_debugfs = debugfs_create_dir(module_name(THIS_MODULE), NULL);
+    sw_fletcher_init(sw_debugfs);
+
+    sw_compress_init(&sw_compress_algs, &sw_decompress_algs);
+    sw_checksum_init(&sw_checksum_algs, &sw_checksum_byteorders);
+    sw_raid_algorithms(&sw_raid_algs);
+
+    const int rc = dpusm_register_gpl(THIS_MODULE, &sw_provider_functions);
+    if (rc) {
+        sw_compress_fini();
+        debugfs_remove_recursive(sw_debugfs);
+        destroy_workqueue(sw_wq);
+        sw_wq = NULL;
+    }
+
+    printk("%s init: %d\n", module_name(THIS_MODULE), rc);
+    return rc;
+}
+
+static void __exit
+dpusm_software_provider_exit(void) {
+    dpusm_unregister_gpl(THIS_MODULE);
+
+    sw_compress_fini();
+    debugfs_remove_recursive(sw_debugfs);
+    destroy_workqueue(sw_wq);
+    sw_wq = NULL;
+
+    printk("%s exit\n", module_name(THIS_MODULE));
+}
+
+module_init(dpusm_software_provider_init);
+module_exit(dpusm_software_provider_exit);
+
+/* lib/raid6 and the crypto API are GPL-only */
+MODULE_LICENSE("GPL v2");
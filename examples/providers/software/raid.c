@@ -0,0 +1,299 @@
+#include <linux/mm.h>
+#include <linux/raid/pq.h>
+#include <linux/raid/xor.h>
+#include <linux/slab.h>
+
+#include "software.h"
+
+/*
+ * columns are laid out the way ZFS lays out raidz rows: parity
+ * first (P, then Q), followed by the data columns
+ *
+ * lib/raid6 weights data disk z by 2^z while ZFS weights data
+ * column d by 2^(ndata - 1 - d), so data columns are handed to
+ * lib/raid6 in reverse order to produce the same Q.
+ *
+ * Data columns may be shorter than the parity columns. The missing
+ * bytes are treated as zeros.
+ */
+
+#define SW_RAID_ALIGN 512   /* column sizes have to be multiples of this */
+
+typedef struct sw_raid_col {
+    void *ptr;
+    size_t size;
+    void *bounce;           /* zero padded copy of a short column */
+} sw_raid_col_t;
+
+typedef struct sw_raid {
+    size_t nparity;
+    size_t ndata;
+    void **ptrs;            /* columns of the current chunk in lib/raid6 order */
+    void **srcs;            /* scratch for xor sources */
+    sw_raid_col_t cols[];
+} sw_raid_t;
+
+#define NCOLS(raid) ((raid)->nparity + (raid)->ndata)
+
+int
+sw_raid_algorithms(u64 *raid) {
+    *raid = DPUSM_RAID_1_GEN | DPUSM_RAID_2_GEN |
+            DPUSM_RAID_1_REC | DPUSM_RAID_2_REC;
+    return DPUSM_OK;
+}
+
+int
+sw_raid_can_compute(size_t nparity, size_t ndata, size_t *col_sizes, int rec) {
+    if (!nparity || (nparity > 2) || !ndata ||
+        ((nparity + ndata) > 255)) {
+        return DPUSM_NOT_SUPPORTED;
+    }
+
+    if (!col_sizes) {
+        return DPUSM_OK;
+    }
+
+    for(size_t c = 0; c < nparity + ndata; c++) {
+        if ((col_sizes[c] % SW_RAID_ALIGN) ||
+            ((c < nparity) && (col_sizes[c] != col_sizes[0])) ||
+            (col_sizes[c] > col_sizes[0])) {
+            return DPUSM_NOT_SUPPORTED;
+        }
+    }
+
+    return DPUSM_OK;
+}
+
+void *
+sw_raid_alloc(size_t nparity, size_t ndata) {
+    if (sw_raid_can_compute(nparity, ndata, NULL, 0) != DPUSM_OK) {
+        return NULL;
+    }
+
+    const size_t ncols = nparity + ndata;
+    sw_raid_t *raid = kzalloc(struct_size(raid, cols, ncols) +
+        (2 * ncols * sizeof(void *)), GFP_KERNEL);
+    if (raid) {
+        raid->nparity = nparity;
+        raid->ndata = ndata;
+        raid->ptrs = (void **) &raid->cols[ncols];
+        raid->srcs = raid->ptrs + ncols;
+    }
+    return raid;
+}
+
+int
+sw_raid_set_column(void *raid, uint64_t c, void *col, size_t size) {
+    sw_raid_t *r = (sw_raid_t *) raid;
+    if (!r || !col || (c >= NCOLS(r)) || (size % SW_RAID_ALIGN) ||
+        (size > ((sw_alloc_t *) col)->size)) {
+        return DPUSM_ERROR;
+    }
+
+    sw_raid_col_t *rc = &r->cols[c];
+    rc->ptr = sw_ptr(col, 0);
+    rc->size = size;
+    return DPUSM_OK;
+}
+
+int
+sw_raid_free(void *raid) {
+    sw_raid_t *r = (sw_raid_t *) raid;
+    if (!r) {
+        return DPUSM_ERROR;
+    }
+
+    for(size_t c = 0; c < NCOLS(r); c++) {
+        kfree(r->cols[c].bounce);
+    }
+    kfree(r);
+    return DPUSM_OK;
+}
+
+/* make sure every column is set and set up bounce pages for short columns */
+static int
+sw_raid_prepare(sw_raid_t *raid) {
+    const size_t size = raid->cols[0].size;
+    for(size_t c = 0; c < NCOLS(raid); c++) {
+        sw_raid_col_t *col = &raid->cols[c];
+        if (!col->ptr ||
+            ((c < raid->nparity) && (col->size != size)) ||
+            (col->size > size)) {
+            return DPUSM_ERROR;
+        }
+
+        if ((col->size < size) && !col->bounce) {
+            col->bounce = kmalloc(PAGE_SIZE, GFP_KERNEL);
+            if (!col->bounce) {
+                return DPUSM_ERROR;
+            }
+        }
+    }
+
+    return DPUSM_OK;
+}
+
+/* lib/raid6 position of column c */
+static int
+sw_raid_index(sw_raid_t *raid, size_t c) {
+    if (c < raid->nparity) {
+        return raid->ndata + c;
+    }
+    return raid->ndata - 1 - (c - raid->nparity);
+}
+
+/* point ptrs at [offset, offset + len) of every column */
+static void
+sw_raid_map(sw_raid_t *raid, size_t offset, size_t len, void **ptrs) {
+    for(size_t c = 0; c < NCOLS(raid); c++) {
+        sw_raid_col_t *col = &raid->cols[c];
+        void **ptr = &ptrs[sw_raid_index(raid, c)];
+        if (col->size >= offset + len) {
+            *ptr = ((char *) col->ptr) + offset;
+            continue;
+        }
+
+        const size_t valid = (col->size > offset)?(col->size - offset):0;
+        memcpy(col->bounce, ((char *) col->ptr) + offset, valid);
+        memset(((char *) col->bounce) + valid, 0, len - valid);
+        *ptr = col->bounce;
+    }
+}
+
+/* copy reconstructed bytes of a short column out of its bounce page */
+static void
+sw_raid_unmap(sw_raid_t *raid, size_t c, size_t offset, size_t len) {
+    sw_raid_col_t *col = &raid->cols[c];
+    if (col->size < offset + len) {
+        const size_t valid = (col->size > offset)?(col->size - offset):0;
+        memcpy(((char *) col->ptr) + offset, col->bounce, valid);
+    }
+}
+
+/* dst = xor of srcs */
+static void
+sw_raid_xor(void *dst, void **srcs, size_t count, size_t len) {
+    memcpy(dst, srcs[0], len);
+    for(size_t i = 1; i < count; i += MAX_XOR_BLOCKS) {
+        xor_blocks(min_t(size_t, count - i, MAX_XOR_BLOCKS), len, dst, &srcs[i]);
+    }
+}
+
+/* P (and Q) for one chunk */
+static void
+sw_raid_gen_chunk(sw_raid_t *raid, size_t len, void **ptrs) {
+    if (raid->nparity == 1) {
+        sw_raid_xor(ptrs[raid->ndata], ptrs, raid->ndata, len);
+    }
+    else {
+        raid6_call.gen_syndrome(NCOLS(raid), len, ptrs);
+    }
+}
+
+/* rebuild lib/raid6 position idx from P and the other data columns */
+static void
+sw_raid_rec_p(sw_raid_t *raid, int idx, size_t len, void **ptrs) {
+    size_t count = 0;
+    for(size_t i = 0; i <= raid->ndata; i++) {
+        if (i != idx) {
+            raid->srcs[count++] = ptrs[i];
+        }
+    }
+    sw_raid_xor(ptrs[idx], raid->srcs, count, len);
+}
+
+int
+sw_raid_gen(void *raid) {
+    sw_raid_t *r = (sw_raid_t *) raid;
+    if (!r || (sw_raid_prepare(r) != DPUSM_OK)) {
+        return DPUSM_ERROR;
+    }
+
+    void **ptrs = r->ptrs;
+    const size_t size = r->cols[0].size;
+    for(size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        const size_t len = min_t(size_t, size - offset, PAGE_SIZE);
+        sw_raid_map(r, offset, len, ptrs);
+        sw_raid_gen_chunk(r, len, ptrs);
+    }
+
+    return DPUSM_OK;
+}
+
+int
+sw_raid_cmp(void *lhs_handle, void *rhs_handle, int *diff) {
+    sw_alloc_t *lhs = (sw_alloc_t *) lhs_handle;
+    sw_alloc_t *rhs = (sw_alloc_t *) rhs_handle;
+    if (!lhs || !rhs || !diff) {
+        return DPUSM_ERROR;
+    }
+
+    *diff = (lhs->size != rhs->size) || memcmp(lhs->ptr, rhs->ptr, lhs->size);
+    return DPUSM_OK;
+}
+
+/* tgts are column indicies in increasing order */
+int
+sw_raid_rec(void *raid, int *tgts, int ntgts) {
+    sw_raid_t *r = (sw_raid_t *) raid;
+    if (!r || !tgts || (ntgts < 1) || (ntgts > r->nparity) ||
+        (sw_raid_prepare(r) != DPUSM_OK)) {
+        return DPUSM_ERROR;
+    }
+
+    /* split the targets into parity and data columns */
+    int bad_p = 0;
+    int bad_q = 0;
+    int data[2];
+    int ndata = 0;
+    for(int i = 0; i < ntgts; i++) {
+        if ((tgts[i] < 0) || (tgts[i] >= NCOLS(r))) {
+            return DPUSM_ERROR;
+        }
+
+        if (tgts[i] == 0) {
+            bad_p = 1;
+        }
+        else if (tgts[i] < r->nparity) {
+            bad_q = 1;
+        }
+        else {
+            data[ndata++] = sw_raid_index(r, tgts[i]);
+        }
+    }
+
+    /* lib/raid6 wants faila < failb */
+    if ((ndata == 2) && (data[0] > data[1])) {
+        swap(data[0], data[1]);
+    }
+
+    void **ptrs = r->ptrs;
+    const size_t disks = NCOLS(r);
+    const size_t size = r->cols[0].size;
+    for(size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        const size_t len = min_t(size_t, size - offset, PAGE_SIZE);
+        sw_raid_map(r, offset, len, ptrs);
+
+        if (ndata == 0) {
+            sw_raid_gen_chunk(r, len, ptrs);
+        }
+        else if (ndata == 2) {
+            raid6_2data_recov(disks, len, data[0], data[1], ptrs);
+        }
+        else if (bad_p) {
+            raid6_datap_recov(disks, len, data[0], ptrs);
+        }
+        else {
+            sw_raid_rec_p(r, data[0], len, ptrs);
+            if (bad_q) {
+                raid6_call.gen_syndrome(disks, len, ptrs);
+            }
+        }
+
+        for(int i = 0; i < ntgts; i++) {
+            sw_raid_unmap(r, tgts[i], offset, len);
+        }
+    }
+
+    return DPUSM_OK;
+}
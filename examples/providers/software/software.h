@@ -0,0 +1,112 @@
+#ifndef _EXAMPLE_SOFTWARE_PROVIDER_H
+#define _EXAMPLE_SOFTWARE_PROVIDER_H
+
+#include <linux/debugfs.h>
+#include <linux/workqueue.h>
+
+#include <dpusm/provider_api.h>
+
+/*
+ * CPU implementation of the DPUSM provider API
+ *
+ * Compression goes through the kernel's acomp API, SHA-2 through
+ * the DPUSM's host checksum code (which uses shash), and RAID
+ * through lib/raid6 and the xor library, so the provider uses
+ * whatever SIMD implementations the kernel picked at boot.
+ */
+
+/* embedded in the DPUSM handle */
+typedef struct sw_alloc {
+    void *ptr;     /* start of this handle's data */
+    size_t size;
+    int ref;       /* ptr belongs to another handle */
+} sw_alloc_t;
+
+static inline void *
+sw_ptr(void *handle, size_t offset) {
+    return ((char *) ((sw_alloc_t *) handle)->ptr) + offset;
+}
+
+/* every level of gzip and zstd */
+#define GZIP_ALL (((u64) DPUSM_COMPRESS_GZIP_9 << 1) - DPUSM_COMPRESS_GZIP_1)
+#define ZSTD_ALL (((u64) DPUSM_COMPRESS_ZSTD_22 << 1) - DPUSM_COMPRESS_ZSTD_1)
+
+/* unbound workqueue for spreading work across CPUs */
+extern struct workqueue_struct *sw_wq;
+
+/* parallel.c */
+typedef void (*sw_parallel_fn_t)(void *arg, size_t i);
+
+/* run fn(arg, i) for every i < count, across CPUs if spread is set */
+void sw_parallel(size_t count, int spread, sw_parallel_fn_t fn, void *arg);
+
+/* compress.c */
+int sw_compress_init(u64 *compress, u64 *decompress);
+void sw_compress_fini(void);
+int sw_compress(dpusm_compress_t alg, int level,
+    void *src, size_t s_len, void *dst, size_t *d_len);
+int sw_compress_bounded(dpusm_compress_t alg, int level,
+    void *src, size_t s_len, void *dst, size_t *d_len);
+int sw_decompress(dpusm_decompress_t alg, int *level,
+    void *src, size_t s_len, void *dst, size_t *d_len);
+int sw_compress_many(dpusm_compress_t alg, int level, size_t count,
+    void **srcs, size_t *s_lens, void **dsts, size_t *d_lens, int *rcs);
+int sw_decompress_many(dpusm_decompress_t alg, int *levels, size_t count,
+    void **srcs, size_t *s_lens, void **dsts, size_t *d_lens, int *rcs);
+
+/* dict.c - zstd only */
+void *sw_dict_load(dpusm_compress_t algs, const void *buf, size_t size);
+int sw_dict_compress(void *dict, dpusm_compress_t alg, int level,
+    void *src, size_t s_len, void *dst, size_t *d_len);
+int sw_dict_decompress(void *dict, dpusm_decompress_t alg, int *level,
+    void *src, size_t s_len, void *dst, size_t *d_len);
+void sw_dict_free(void *dict);
+
+/* checksum.c */
+int sw_checksum_init(u64 *checksum, u64 *checksum_byteorder);
+int sw_checksum_properties(dpusm_checksum_t alg, dpusm_ap_t *props);
+int sw_checksum(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *data, size_t size, void *cksum, size_t cksum_size);
+int sw_checksum_many(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    size_t count, void **handles, size_t *offsets, size_t *sizes,
+    void *cksums, size_t cksum_size, int *rcs);
+int sw_checksum_verify(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *data, size_t size, const void *expected, size_t cksum_size);
+int sw_checksum_verify_many(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    size_t count, void **handles, size_t *offsets, size_t *sizes,
+    const void *expected, size_t cksum_size, int *rcs);
+void *sw_checksum_ctx_init(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order);
+int sw_checksum_ctx_update(void *ctx, void *handle, size_t offset, size_t size);
+int sw_checksum_ctx_final(void *ctx, void *cksum, size_t cksum_size);
+void sw_checksum_ctx_free(void *ctx);
+int sw_copy_checksum(void *dst, const void *src, size_t size,
+    dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *cksum, size_t cksum_size);
+
+/*
+ * fletcher.c
+ *
+ * fletcher-2 and fletcher-4 as computed by ZFS. Every implementation
+ * the CPU supports is benchmarked at init, and the fastest one is
+ * used for each checksum and byte order unless the fletcher_impl
+ * module parameter names another. The results are in debugfs.
+ *
+ * cksum holds the checksum of the data before buf (zeros to start)
+ * and is updated to include buf.
+ */
+int sw_fletcher_init(struct dentry *debugfs);
+void sw_fletcher_2(const void *buf, size_t size, int byteswap, u64 *cksum);  /* size % 16 == 0 */
+void sw_fletcher_4(const void *buf, size_t size, int byteswap, u64 *cksum);  /* size % 4 == 0 */
+u64 sw_fletcher_throughput(int fletcher_4);  /* bytes per second in native byte order, 0 if unknown */
+
+/* raid.c */
+int sw_raid_algorithms(u64 *raid);
+int sw_raid_can_compute(size_t nparity, size_t ndata, size_t *col_sizes, int rec);
+void *sw_raid_alloc(size_t nparity, size_t ndata);
+int sw_raid_set_column(void *raid, uint64_t c, void *col, size_t size);
+int sw_raid_free(void *raid);
+int sw_raid_gen(void *raid);
+int sw_raid_cmp(void *lhs_handle, void *rhs_handle, int *diff);
+int sw_raid_rec(void *raid, int *tgts, int ntgts);
+
+#endif
@@ -5,8 +5,11 @@ DIR="$(dirname $(realpath ${BASH_SOURCE[0]}))"
 cd "${DIR}"
 
 function cleanup() {
+    sudo rmmod example_dpusm_bench_user
+    sudo rmmod example_dpusm_alloc_bench_user
     sudo rmmod example_dpusm_need_provider_user
     sudo rmmod example_dpusm_no_provider_user
+    sudo rmmod example_software_dpusm_provider
     sudo rmmod example_gpl_dpusm_provider
     sudo rmmod example_bsd_dpusm_provider
     sudo rmmod dpusm
@@ -34,6 +37,27 @@ sudo insmod users/need_provider/example_dpusm_need_provider_user.ko || true
 # load the user after the provider
 sudo insmod providers/bsd/example_bsd_dpusm_provider.ko
 sudo insmod providers/gpl/example_gpl_dpusm_provider.ko
+
+# lib/raid6 and the xor library are not always built in
+sudo modprobe -a raid6_pq xor
+sudo insmod providers/software/example_software_dpusm_provider.ko
+
+# handle alloc/free cycle latency (results are in dmesg)
+# run before need_provider, which invalidates the providers
+sudo insmod users/alloc_bench/example_dpusm_alloc_bench_user.ko
+sudo dmesg | grep example_dpusm_alloc_bench_user
+
+# per-operation throughput and latency
+sudo insmod users/dpusm_bench/example_dpusm_bench_user.ko duration_ms=200
+sudo cat /sys/kernel/debug/dpusm_bench/results
+
+# CPU baseline for compression, checksums, and RAID
+echo example_software_dpusm_provider | sudo tee /sys/module/example_dpusm_bench_user/parameters/provider_name
+echo 2 | sudo tee /sys/module/example_dpusm_bench_user/parameters/raid_parity
+echo 1 | sudo tee /sys/kernel/debug/dpusm_bench/run
+sudo cat /sys/kernel/debug/dpusm_bench/results
+
+# also checks compression, checksums, RAID, and dictionaries on the software provider
 sudo insmod users/need_provider/example_dpusm_need_provider_user.ko
 
 echo "Success"
@@ -0,0 +1,191 @@
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+
+#include <dpusm/user_api.h> /* the DPUSM API */
+
+/*
+ * Measures the cost of an alloc/free cycle
+ *
+ *     kmalloc:    how dpusm_handle_t wrappers used to be allocated
+ *     kmem_cache: how dpusm_handle_t wrappers are allocated now
+ *     dpusm:      dpusm->alloc + dpusm->free, including the provider
+ *
+ * Each test is run once with back-to-back alloc/free pairs and
+ * once with bursts of allocations followed by bursts of frees.
+ * Results are printed to the kernel log.
+ */
+
+static char *provider_name = "example_bsd_dpusm_provider";
+module_param(provider_name, charp, 0444);
+MODULE_PARM_DESC(provider_name, "Provider to allocate from");
+
+static unsigned int iterations = 100000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Number of alloc/free cycles per test");
+
+static unsigned int alloc_size = 4096;
+module_param(alloc_size, uint, 0444);
+MODULE_PARM_DESC(alloc_size, "Size passed to dpusm->alloc");
+
+/* size of dpusm_handle_t with DEBUG=1 */
+static unsigned int handle_size = 32;
+module_param(handle_size, uint, 0444);
+MODULE_PARM_DESC(handle_size, "Size of the wrapper allocations");
+
+#define BURST 64
+
+const dpusm_uf_t *dpusm = NULL;
+
+static struct kmem_cache *cache = NULL;
+static void *provider = NULL;
+
+static void *
+bench_kmalloc_alloc(void) {
+    return kmalloc(handle_size, GFP_KERNEL);
+}
+
+static void
+bench_kmalloc_free(void *ptr) {
+    kfree(ptr);
+}
+
+static void *
+bench_cache_alloc(void) {
+    return kmem_cache_alloc(cache, GFP_KERNEL);
+}
+
+static void
+bench_cache_free(void *ptr) {
+    kmem_cache_free(cache, ptr);
+}
+
+static void *
+bench_dpusm_alloc(void) {
+    return dpusm->alloc(provider, alloc_size);
+}
+
+static void
+bench_dpusm_free(void *ptr) {
+    dpusm->free(ptr);
+}
+
+typedef struct bench {
+    const char *name;
+    void *(*alloc)(void);
+    void (*free)(void *);
+} bench_t;
+
+static const bench_t benches[] = {
+    { "kmalloc",    bench_kmalloc_alloc, bench_kmalloc_free },
+    { "kmem_cache", bench_cache_alloc,   bench_cache_free   },
+    { "dpusm",      bench_dpusm_alloc,   bench_dpusm_free   },
+};
+
+/* sets ns to the average nanoseconds per alloc/free cycle */
+static int
+run_pairs(const bench_t *bench, u64 *ns) {
+    const u64 start = ktime_get_ns();
+    for(unsigned int i = 0; i < iterations; i++) {
+        void *ptr = bench->alloc();
+        if (!ptr) {
+            return -ENOMEM;
+        }
+        bench->free(ptr);
+    }
+    *ns = (ktime_get_ns() - start) / iterations;
+    return 0;
+}
+
+/* sets ns to the average nanoseconds per alloc/free cycle */
+static int
+run_bursts(const bench_t *bench, u64 *ns) {
+    void *ptrs[BURST];
+    const unsigned int bursts = (iterations + BURST - 1) / BURST;
+
+    int rc = 0;
+    const u64 start = ktime_get_ns();
+    for(unsigned int i = 0; i < bursts; i++) {
+        for(size_t j = 0; j < BURST; j++) {
+            ptrs[j] = bench->alloc();
+            if (!ptrs[j]) {
+                rc = -ENOMEM;
+            }
+        }
+
+        /* free the rest of the burst even if an allocation failed */
+        for(size_t j = 0; j < BURST; j++) {
+            if (ptrs[j]) {
+                bench->free(ptrs[j]);
+            }
+        }
+
+        if (rc) {
+            return rc;
+        }
+    }
+    *ns = (ktime_get_ns() - start) / (bursts * BURST);
+    return 0;
+}
+
+static int __init
+dpusm_alloc_bench_init(void) {
+    dpusm = dpusm_initialize();
+    if (!dpusm) {
+        printk("%s error: Could not initialze DPUSM.\n", module_name(THIS_MODULE));
+        return -EFAULT;
+    }
+
+    if (!iterations) {
+        return -EINVAL;
+    }
+
+    provider = dpusm->get(provider_name);
+    if (!provider) {
+        printk("%s error: Could not find \"%s\".\n", module_name(THIS_MODULE), provider_name);
+        return -ENODEV;
+    }
+
+    cache = kmem_cache_create("dpusm_alloc_bench", handle_size, 0, 0, NULL);
+    if (!cache) {
+        dpusm->put(provider);
+        return -ENOMEM;
+    }
+
+    printk("%s: %u cycles, %u byte wrappers, %u byte provider allocations from \"%s\"\n",
+           module_name(THIS_MODULE), iterations, handle_size, alloc_size, provider_name);
+
+    int rc = 0;
+    for(size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        u64 pairs = 0;
+        u64 bursts = 0;
+        const int pairs_rc = run_pairs(&benches[i], &pairs);
+        const int bursts_rc = run_bursts(&benches[i], &bursts);
+        if (pairs_rc || bursts_rc) {
+            printk("%s: %-10s allocation failed\n",
+                   module_name(THIS_MODULE), benches[i].name);
+            rc = pairs_rc?pairs_rc:bursts_rc;
+            continue;
+        }
+
+        printk("%s: %-10s %6llu ns/cycle (pairs) %6llu ns/cycle (bursts of %d)\n",
+               module_name(THIS_MODULE), benches[i].name, pairs, bursts, BURST);
+    }
+
+    kmem_cache_destroy(cache);
+    dpusm->put(provider);
+
+    return rc;
+}
+
+static void __exit
+dpusm_alloc_bench_exit(void) {
+    printk("%s exited\n", module_name(THIS_MODULE));
+}
+
+module_init(dpusm_alloc_bench_init);
+module_exit(dpusm_alloc_bench_exit);
+
+MODULE_LICENSE("OSS + BSD 3");
@@ -0,0 +1,815 @@
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include <dpusm/user_api.h> /* the DPUSM API */
+
+/*
+ * Drives a provider through the user API for a fixed amount of time
+ * and reports throughput and latency percentiles per operation in
+ *
+ *     /sys/kernel/debug/dpusm_bench/results
+ *
+ * A run happens when the module is loaded. Writing anything to
+ *
+ *     /sys/kernel/debug/dpusm_bench/run
+ *
+ * starts another run with the current module parameters.
+ *
+ * ops is a comma separated list of operations, each optionally
+ * followed by a weight, e.g. "copy_from_generic:4,checksum". "all"
+ * runs every operation with a weight of 1. Operations that the
+ * provider does not implement are reported as unsupported.
+ */
+
+static char *provider_name = "example_bsd_dpusm_provider";
+module_param(provider_name, charp, 0644);
+MODULE_PARM_DESC(provider_name, "Provider to benchmark");
+
+static char *ops = "all";
+module_param(ops, charp, 0644);
+MODULE_PARM_DESC(ops, "Operation mix: all, or name[:weight][,name[:weight]...]");
+
+static unsigned int size = 131072;
+module_param(size, uint, 0644);
+MODULE_PARM_DESC(size, "Buffer size of each operation");
+
+static unsigned int threads = 1;
+module_param(threads, uint, 0644);
+MODULE_PARM_DESC(threads, "Number of threads submitting operations");
+
+static unsigned int duration_ms = 1000;
+module_param(duration_ms, uint, 0644);
+MODULE_PARM_DESC(duration_ms, "How long each run lasts");
+
+static unsigned int raid_parity = 1;
+module_param(raid_parity, uint, 0644);
+MODULE_PARM_DESC(raid_parity, "Parity columns for raid_gen and raid_rec (1-3)");
+
+static unsigned int raid_data = 4;
+module_param(raid_data, uint, 0644);
+MODULE_PARM_DESC(raid_data, "Data columns for raid_gen and raid_rec");
+
+typedef enum bench_op {
+    BENCH_ALLOC_FREE,
+    BENCH_COPY_FROM_GENERIC,
+    BENCH_COPY_TO_GENERIC,
+    BENCH_COPY_FROM_PTR,
+    BENCH_COPY_TO_PTR,
+    BENCH_COPY_FROM_SCATTERLIST,
+    BENCH_COPY_TO_SCATTERLIST,
+    BENCH_COPY_FROM_AUTOMATIC,
+    BENCH_COPY_TO_AUTOMATIC,
+    BENCH_COPY_FROM_ASYNC,
+    BENCH_COPY_TO_ASYNC,
+    BENCH_COPY_FROM_CHECKSUM,
+    BENCH_COPY_TO_CHECKSUM,
+    BENCH_COMPRESS,
+    BENCH_COMPRESS_BOUNDED,
+    BENCH_COMPRESS_MANY,
+    BENCH_COMPRESSIBILITY,
+    BENCH_DECOMPRESS,
+    BENCH_CHECKSUM,
+    BENCH_CHECKSUM_MANY,
+    BENCH_CHECKSUM_VERIFY_MANY,
+    BENCH_CHECKSUM_CTX,
+    BENCH_RAID_GEN,
+    BENCH_RAID_REC,
+    BENCH_ZERO_FILL,
+    BENCH_ALL_ZEROS,
+
+    BENCH_OPS,
+} bench_op_t;
+
+static const char *BENCH_OP_STR[] = {
+    "alloc_free",
+    "copy_from_generic",
+    "copy_to_generic",
+    "copy_from_ptr",
+    "copy_to_ptr",
+    "copy_from_scatterlist",
+    "copy_to_scatterlist",
+    "copy_from_automatic",
+    "copy_to_automatic",
+    "copy_from_async",
+    "copy_to_async",
+    "copy_from_checksum",
+    "copy_to_checksum",
+    "compress",
+    "compress_bounded",
+    "compress_many",
+    "compressibility",
+    "decompress",
+    "checksum",
+    "checksum_many",
+    "checksum_verify_many",
+    "checksum_ctx",
+    "raid_gen",
+    "raid_rec",
+    "zero_fill",
+    "all_zeros",
+};
+
+#define MAX_WEIGHT    16
+#define MAX_SCHEDULE  (BENCH_OPS * MAX_WEIGHT)
+#define MAX_COLUMNS   16
+#define BATCH         16              /* checksum_many and checksum_ctx split the buffer into this many ranges */
+
+/*
+ * log-linear latency histogram
+ *
+ * Values under 8 ns get their own buckets. Above that, each
+ * power of 2 is split into 8 buckets, so a bucket is at most
+ * 12.5% wide.
+ */
+#define SUB_BITS      3
+#define SUB_BUCKETS   (1 << SUB_BITS)
+#define BUCKETS       ((64 - SUB_BITS + 1) * SUB_BUCKETS)
+
+typedef struct bench_stats {
+    u64 ops;
+    u64 bytes;
+    u64 errors;
+    bool unsupported;
+    u64 hist[BUCKETS];
+} bench_stats_t;
+
+typedef struct bench_thread {
+    struct task_struct *task;
+    struct completion done;
+    u64 end;                          /* ktime_get_ns() deadline */
+
+    bench_op_t schedule[MAX_SCHEDULE];
+    size_t schedule_len;
+
+    void *src;                        /* filled with data */
+    void *dst;                        /* scratch */
+    void *cmp;                        /* compressed copy of src */
+    size_t c_len;
+    void *buf;                        /* memory side of copies */
+    struct scatterlist sg;
+
+    void *raid;
+    void *cols[MAX_COLUMNS];
+    size_t ncols;
+
+    dpusm_compress_t compress;
+    dpusm_checksum_t checksum;
+    dpusm_checksum_byteorder_t order;
+    void *batch_handles[BATCH];
+    size_t batch_offsets[BATCH];
+    size_t batch_sizes[BATCH];
+    u8 batch_cksums[BATCH][64];
+    u8 batch_expected[BATCH][64];     /* checksums of the ranges of src */
+    int verify;                       /* batch_expected was filled in */
+    void *batch_srcs[BATCH];          /* references to the ranges of src */
+    void *batch_dsts[BATCH];          /* references to the ranges of dst */
+    size_t batch_d_lens[BATCH];
+
+    bench_stats_t stats[BENCH_OPS];
+} bench_thread_t;
+
+/* results of the last run */
+typedef struct bench_results {
+    char provider[MODULE_NAME_LEN];
+    unsigned int size;
+    unsigned int threads;
+    u64 elapsed_ns;
+    bench_stats_t stats[BENCH_OPS];
+} bench_results_t;
+
+static const dpusm_uf_t *dpusm = NULL;
+static void *provider = NULL;
+static dpusm_pc_t *caps = NULL;
+
+static DEFINE_MUTEX(bench_lock);      /* one run at a time */
+static bench_results_t results;
+static struct dentry *bench_debugfs = NULL;
+
+static size_t
+bucket(u64 ns) {
+    if (ns < SUB_BUCKETS) {
+        return ns;
+    }
+
+    const int msb = fls64(ns) - 1;
+    const size_t sub = (ns >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (msb - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+/* smallest value that lands in a bucket */
+static u64
+bucket_floor(size_t b) {
+    if (b < SUB_BUCKETS) {
+        return b;
+    }
+
+    const int msb = b / SUB_BUCKETS + SUB_BITS - 1;
+    return ((u64) (SUB_BUCKETS + (b % SUB_BUCKETS))) << (msb - SUB_BITS);
+}
+
+/* permille is out of 1000 (p99.9 = 999) */
+static u64
+percentile(const bench_stats_t *stats, u64 permille) {
+    const u64 target = div64_u64(stats->ops * permille + 999, 1000);
+    u64 seen = 0;
+    for(size_t b = 0; b < BUCKETS; b++) {
+        seen += stats->hist[b];
+        if (seen && (seen >= target)) {
+            return bucket_floor(b);
+        }
+    }
+    return 0;
+}
+
+static int
+is_unsupported(int rc) {
+    return (rc == DPUSM_NOT_IMPLEMENTED) || (rc == DPUSM_NOT_SUPPORTED);
+}
+
+typedef struct async_wait {
+    struct completion done;
+    int rc;
+} async_wait_t;
+
+static void
+async_copy_done(void *ptr, int error) {
+    async_wait_t *wait = (async_wait_t *) ptr;
+    wait->rc = error;
+    complete(&wait->done);
+}
+
+/* start an asynchronous copy and wait for it to finish */
+static int
+run_async_copy(dpusm_mv_t *mv, void *buf, int to) {
+    async_wait_t wait;
+    init_completion(&wait.done);
+
+    const int rc = to?
+        dpusm->copy.to.async(mv, buf, size, async_copy_done, &wait):
+        dpusm->copy.from.async(mv, buf, size, async_copy_done, &wait);
+    if (rc != DPUSM_OK) {
+        return rc;
+    }
+
+    wait_for_completion(&wait.done);
+    return wait.rc;
+}
+
+/* the DPUSM can checksum copies on the host even if the provider has no checksums */
+static int
+run_copy_checksum(bench_thread_t *bt, dpusm_mv_t *mv, int to) {
+    const dpusm_checksum_t alg = bt->checksum?bt->checksum:DPUSM_CHECKSUM_FLETCHER_4;
+    const dpusm_checksum_byteorder_t order = bt->checksum?bt->order:DPUSM_BYTEORDER_NATIVE;
+    return to?
+        dpusm->copy.to.checksum(mv, bt->buf, size, alg, order,
+            bt->batch_cksums[0], sizeof(bt->batch_cksums[0])):
+        dpusm->copy.from.checksum(mv, bt->buf, size, alg, order,
+            bt->batch_cksums[0], sizeof(bt->batch_cksums[0]));
+}
+
+/* checksum the checksum_many ranges as one buffer */
+static int
+run_checksum_ctx(bench_thread_t *bt) {
+    void *ctx = dpusm->checksum_ctx.init(provider, bt->checksum, bt->order);
+    if (!ctx) {
+        return DPUSM_NOT_SUPPORTED;
+    }
+
+    for(size_t i = 0; i < BATCH; i++) {
+        const int rc = dpusm->checksum_ctx.update(ctx, bt->batch_handles[i],
+            bt->batch_offsets[i], bt->batch_sizes[i]);
+        if (rc != DPUSM_OK) {
+            dpusm->checksum_ctx.free(ctx);
+            return rc;
+        }
+    }
+
+    return dpusm->checksum_ctx.final(ctx, bt->batch_cksums[0], sizeof(bt->batch_cksums[0]));
+}
+
+/* returns the DPUSM return code and the number of bytes processed */
+static int
+run_op(bench_thread_t *bt, bench_op_t op, u64 *bytes) {
+    dpusm_mv_t mv = { .handle = bt->src, .offset = 0 };
+    int rc = DPUSM_OK;
+
+    *bytes = size;
+
+    switch (op) {
+        case BENCH_ALLOC_FREE: {
+            void *handle = dpusm->alloc(provider, size);
+            if (!handle) {
+                return DPUSM_ERROR;
+            }
+            *bytes = 0;
+            return dpusm->free(handle);
+        }
+        case BENCH_COPY_FROM_GENERIC:
+            mv.handle = bt->dst;
+            return dpusm->copy.from.generic(&mv, bt->buf, size);
+        case BENCH_COPY_TO_GENERIC:
+            return dpusm->copy.to.generic(&mv, bt->buf, size);
+        case BENCH_COPY_FROM_PTR:
+            mv.handle = bt->dst;
+            return dpusm->copy.from.ptr(&mv, bt->buf, size);
+        case BENCH_COPY_TO_PTR:
+            return dpusm->copy.to.ptr(&mv, bt->buf, size);
+        case BENCH_COPY_FROM_SCATTERLIST:
+            mv.handle = bt->dst;
+            return dpusm->copy.from.scatterlist(&mv, &bt->sg, 1, size);
+        case BENCH_COPY_TO_SCATTERLIST:
+            return dpusm->copy.to.scatterlist(&mv, &bt->sg, 1, size);
+        case BENCH_COPY_FROM_AUTOMATIC:
+            mv.handle = bt->dst;
+            return dpusm->copy.from.automatic(&mv, bt->buf, size);
+        case BENCH_COPY_TO_AUTOMATIC:
+            return dpusm->copy.to.automatic(&mv, bt->buf, size);
+        case BENCH_COPY_FROM_ASYNC:
+            mv.handle = bt->dst;
+            return run_async_copy(&mv, bt->buf, 0);
+        case BENCH_COPY_TO_ASYNC:
+            return run_async_copy(&mv, bt->buf, 1);
+        case BENCH_COPY_FROM_CHECKSUM:
+            mv.handle = bt->dst;
+            return run_copy_checksum(bt, &mv, 0);
+        case BENCH_COPY_TO_CHECKSUM:
+            return run_copy_checksum(bt, &mv, 1);
+        case BENCH_COMPRESS: {
+            size_t d_len = size;
+            return bt->compress?
+                dpusm->compress(bt->compress, 0, bt->src, size, bt->dst, &d_len):
+                DPUSM_NOT_SUPPORTED;
+        }
+        case BENCH_COMPRESS_BOUNDED: {
+            /* src is half zeros, so this should always fit */
+            size_t d_len = size;
+            return bt->compress?
+                dpusm->compress_bounded(bt->compress, 0, bt->src, size, bt->dst, &d_len, 87):
+                DPUSM_NOT_SUPPORTED;
+        }
+        case BENCH_COMPRESS_MANY:
+            if (!bt->compress || !bt->batch_dsts[BATCH - 1]) {
+                return DPUSM_NOT_SUPPORTED;
+            }
+            for(size_t i = 0; i < BATCH; i++) {
+                bt->batch_d_lens[i] = bt->batch_sizes[i];
+            }
+            return dpusm->compress_many(bt->compress, 0, BATCH,
+                bt->batch_srcs, bt->batch_sizes, bt->batch_dsts, bt->batch_d_lens, NULL);
+        case BENCH_COMPRESSIBILITY: {
+            unsigned int percent = 0;
+            return dpusm->compressibility.handle(bt->src, 0, size, &percent);
+        }
+        case BENCH_DECOMPRESS: {
+            size_t d_len = size;
+            int level = 0;
+            return bt->cmp?
+                dpusm->decompress(bt->compress, &level, bt->cmp, bt->c_len, bt->dst, &d_len):
+                DPUSM_NOT_SUPPORTED;
+        }
+        case BENCH_CHECKSUM: {
+            u8 cksum[64];
+            return bt->checksum?
+                dpusm->checksum(bt->checksum, bt->order, bt->src, size, cksum, sizeof(cksum)):
+                DPUSM_NOT_SUPPORTED;
+        }
+        case BENCH_CHECKSUM_MANY:
+            return bt->checksum?
+                dpusm->checksum_many(bt->checksum, bt->order, BATCH,
+                    bt->batch_handles, bt->batch_offsets, bt->batch_sizes,
+                    bt->batch_cksums, sizeof(bt->batch_cksums[0]), NULL):
+                DPUSM_NOT_SUPPORTED;
+        case BENCH_CHECKSUM_VERIFY_MANY:
+            return bt->verify?
+                dpusm->checksum_verify_many(bt->checksum, bt->order, BATCH,
+                    bt->batch_handles, bt->batch_offsets, bt->batch_sizes,
+                    bt->batch_expected, sizeof(bt->batch_expected[0]), NULL):
+                DPUSM_NOT_SUPPORTED;
+        case BENCH_CHECKSUM_CTX:
+            return bt->checksum?
+                run_checksum_ctx(bt):
+                DPUSM_NOT_SUPPORTED;
+        case BENCH_RAID_GEN:
+            *bytes = (u64) size * raid_data;
+            return bt->raid?dpusm->raid.gen(bt->raid):DPUSM_NOT_SUPPORTED;
+        case BENCH_RAID_REC: {
+            /* rebuild the first data column */
+            int tgt = raid_parity;
+            *bytes = (u64) size * raid_data;
+            return bt->raid?dpusm->raid.rec(bt->raid, &tgt, 1):DPUSM_NOT_SUPPORTED;
+        }
+        case BENCH_ZERO_FILL:
+            return dpusm->zero_fill(bt->dst, 0, size);
+        case BENCH_ALL_ZEROS:
+            rc = dpusm->all_zeros(bt->dst, 0, size);
+            /* DPUSM_BAD_RESULT just means the buffer was not all zeros */
+            return (rc == DPUSM_BAD_RESULT)?DPUSM_OK:rc;
+        default:
+            break;
+    }
+
+    return DPUSM_NOT_SUPPORTED;
+}
+
+static int
+bench_thread_fn(void *arg) {
+    bench_thread_t *bt = (bench_thread_t *) arg;
+    size_t next = 0;
+    size_t remaining = bt->schedule_len;
+
+    while (remaining && (ktime_get_ns() < bt->end)) {
+        const bench_op_t op = bt->schedule[next];
+        next = (next + 1) % bt->schedule_len;
+
+        bench_stats_t *stats = &bt->stats[op];
+        if (stats->unsupported) {
+            continue;
+        }
+
+        u64 bytes = 0;
+        const u64 start = ktime_get_ns();
+        const int rc = run_op(bt, op, &bytes);
+        const u64 ns = ktime_get_ns() - start;
+
+        if (rc == DPUSM_OK) {
+            stats->ops++;
+            stats->bytes += bytes;
+            stats->hist[bucket(ns)]++;
+        }
+        else if (is_unsupported(rc)) {
+            stats->unsupported = true;
+            for(size_t i = 0; i < bt->schedule_len; i++) {
+                remaining -= (bt->schedule[i] == op);
+            }
+        }
+        else {
+            stats->errors++;
+        }
+
+        cond_resched();
+    }
+
+    complete(&bt->done);
+    return 0;
+}
+
+/* fill in the schedule from the ops parameter */
+static int
+parse_ops(bench_thread_t *bt) {
+    bt->schedule_len = 0;
+
+    if (!strcmp(ops, "all")) {
+        for(size_t op = 0; op < BENCH_OPS; op++) {
+            bt->schedule[bt->schedule_len++] = op;
+        }
+        return 0;
+    }
+
+    char *copy = kstrdup(ops, GFP_KERNEL);
+    if (!copy) {
+        return -ENOMEM;
+    }
+
+    int rc = 0;
+    char *cur = copy;
+    char *entry = NULL;
+    while (!rc && (entry = strsep(&cur, ","))) {
+        if (!*entry) {
+            continue;
+        }
+
+        unsigned int weight = 1;
+        char *name = strsep(&entry, ":");
+        if (entry && (kstrtouint(entry, 10, &weight) || !weight || (weight > MAX_WEIGHT))) {
+            printk("%s error: Bad weight for \"%s\" (1-%d)\n",
+                   module_name(THIS_MODULE), name, MAX_WEIGHT);
+            rc = -EINVAL;
+            break;
+        }
+
+        size_t op = 0;
+        while ((op < BENCH_OPS) && strcmp(name, BENCH_OP_STR[op])) {
+            op++;
+        }
+
+        if (op == BENCH_OPS) {
+            printk("%s error: Unknown operation \"%s\"\n", module_name(THIS_MODULE), name);
+            rc = -EINVAL;
+            break;
+        }
+
+        while (weight-- && (bt->schedule_len < MAX_SCHEDULE)) {
+            bt->schedule[bt->schedule_len++] = op;
+        }
+    }
+
+    kfree(copy);
+    return (!rc && !bt->schedule_len)?-EINVAL:rc;
+}
+
+static void
+bench_thread_fini(bench_thread_t *bt) {
+    if (bt->raid) {
+        dpusm->raid.free(bt->raid);
+    }
+
+    for(size_t i = 0; i < bt->ncols; i++) {
+        dpusm->free(bt->cols[i]);
+    }
+
+    if (bt->cmp) {
+        dpusm->free(bt->cmp);
+    }
+
+    for(size_t i = 0; i < BATCH; i++) {
+        if (bt->batch_dsts[i]) {
+            dpusm->free(bt->batch_dsts[i]);
+        }
+        if (bt->batch_srcs[i]) {
+            dpusm->free(bt->batch_srcs[i]);
+        }
+    }
+
+    if (bt->dst) {
+        dpusm->free(bt->dst);
+    }
+
+    if (bt->src) {
+        dpusm->free(bt->src);
+    }
+
+    kfree(bt->buf);
+    kvfree(bt);
+}
+
+/* lowest bit that is set, or 0 */
+static u64
+first_alg(u64 algs) {
+    return algs & -algs;
+}
+
+static bench_thread_t *
+bench_thread_init(void) {
+    bench_thread_t *bt = kvzalloc(sizeof(bench_thread_t), GFP_KERNEL);
+    if (!bt) {
+        return NULL;
+    }
+
+    init_completion(&bt->done);
+
+    if (parse_ops(bt)) {
+        goto error;
+    }
+
+    /* half zeros, half text, so compressors have something to do */
+    bt->buf = kmalloc(size, GFP_KERNEL);
+    if (!bt->buf) {
+        goto error;
+    }
+    memset(bt->buf, 0, size / 2);
+    for(size_t i = size / 2; i < size; i++) {
+        ((char *) bt->buf)[i] = 'A' + (i % 26);
+    }
+    sg_init_one(&bt->sg, bt->buf, size);
+
+    bt->src = dpusm->alloc(provider, size);
+    bt->dst = dpusm->alloc(provider, size);
+    if (!bt->src || !bt->dst) {
+        goto error;
+    }
+
+    dpusm_mv_t mv = { .handle = bt->src, .offset = 0 };
+    if (dpusm->copy.from.generic(&mv, bt->buf, size) != DPUSM_OK) {
+        goto error;
+    }
+
+    bt->compress = first_alg(caps->compress);
+    if (bt->compress) {
+        bt->cmp = dpusm->alloc(provider, size);
+        bt->c_len = size;
+        if (bt->cmp &&
+            (dpusm->compress(bt->compress, 0, bt->src, size, bt->cmp, &bt->c_len) != DPUSM_OK)) {
+            dpusm->free(bt->cmp);
+            bt->cmp = NULL;
+        }
+    }
+
+    bt->checksum = first_alg(caps->checksum);
+    bt->order = first_alg(caps->checksum_byteorder);
+    for(size_t i = 0; i < BATCH; i++) {
+        bt->batch_handles[i] = bt->src;
+        bt->batch_sizes[i] = size / BATCH;
+        bt->batch_offsets[i] = i * bt->batch_sizes[i];
+    }
+
+    /* stops at the first failure, so compress_many checks the last one */
+    for(size_t i = 0; i < BATCH; i++) {
+        bt->batch_srcs[i] = dpusm->alloc_ref(bt->src, bt->batch_offsets[i], bt->batch_sizes[i]);
+        bt->batch_dsts[i] = bt->batch_srcs[i]?
+            dpusm->alloc_ref(bt->dst, bt->batch_offsets[i], bt->batch_sizes[i]):NULL;
+        if (!bt->batch_dsts[i]) {
+            break;
+        }
+    }
+
+    bt->verify = bt->checksum &&
+        (dpusm->checksum_many(bt->checksum, bt->order, BATCH,
+            bt->batch_handles, bt->batch_offsets, bt->batch_sizes,
+            bt->batch_expected, sizeof(bt->batch_expected[0]), NULL) == DPUSM_OK);
+
+    const size_t ncols = raid_parity + raid_data;
+    if ((caps->raid & (DPUSM_RAID_1_GEN << (raid_parity - 1))) &&
+        (ncols <= MAX_COLUMNS)) {
+        bt->raid = dpusm->raid.alloc(provider, raid_parity, raid_data);
+        for(bt->ncols = 0; bt->raid && (bt->ncols < ncols); bt->ncols++) {
+            void *col = dpusm->alloc(provider, size);
+            if (!col) {
+                break;
+            }
+
+            bt->cols[bt->ncols] = col;
+            dpusm->raid.set_column(bt->raid, bt->ncols, col, size);
+        }
+    }
+
+    return bt;
+
+  error:
+    bench_thread_fini(bt);
+    return NULL;
+}
+
+static int
+bench_run(void) {
+    if (!threads || !size || !raid_parity || (raid_parity > 3)) {
+        return -EINVAL;
+    }
+
+    provider = dpusm->get(provider_name);
+    if (!provider) {
+        printk("%s error: Could not find \"%s\".\n", module_name(THIS_MODULE), provider_name);
+        return -ENODEV;
+    }
+
+    int rc = 0;
+    if (dpusm->capabilities(provider, &caps) != DPUSM_OK) {
+        rc = -ENODEV;
+        goto put;
+    }
+
+    bench_thread_t **bts = kcalloc(threads, sizeof(bench_thread_t *), GFP_KERNEL);
+    if (!bts) {
+        rc = -ENOMEM;
+        goto put;
+    }
+
+    unsigned int started = 0;
+    for(unsigned int i = 0; i < threads; i++) {
+        bts[i] = bench_thread_init();
+        if (!bts[i]) {
+            rc = -ENOMEM;
+            goto free;
+        }
+    }
+
+    const u64 start = ktime_get_ns();
+    for(; started < threads; started++) {
+        bench_thread_t *bt = bts[started];
+        bt->end = start + (u64) duration_ms * NSEC_PER_MSEC;
+        bt->task = kthread_run(bench_thread_fn, bt, "dpusm_bench/%u", started);
+        if (IS_ERR(bt->task)) {
+            rc = PTR_ERR(bt->task);
+            break;
+        }
+    }
+
+    for(unsigned int i = 0; i < started; i++) {
+        wait_for_completion(&bts[i]->done);
+    }
+
+    /* merge per-thread results */
+    memset(&results, 0, sizeof(results));
+    strscpy(results.provider, provider_name, sizeof(results.provider));
+    results.size = size;
+    results.threads = started;
+    results.elapsed_ns = ktime_get_ns() - start;
+    for(unsigned int i = 0; i < started; i++) {
+        for(size_t op = 0; op < BENCH_OPS; op++) {
+            const bench_stats_t *src = &bts[i]->stats[op];
+            bench_stats_t *dst = &results.stats[op];
+            dst->ops += src->ops;
+            dst->bytes += src->bytes;
+            dst->errors += src->errors;
+            dst->unsupported |= src->unsupported;
+            for(size_t b = 0; b < BUCKETS; b++) {
+                dst->hist[b] += src->hist[b];
+            }
+        }
+    }
+
+  free:
+    for(unsigned int i = 0; i < threads; i++) {
+        if (bts[i]) {
+            bench_thread_fini(bts[i]);
+        }
+    }
+    kfree(bts);
+
+  put:
+    dpusm->put(provider);
+    provider = NULL;
+    caps = NULL;
+
+    return rc;
+}
+
+static int
+bench_results_show(struct seq_file *m, void *v) {
+    mutex_lock(&bench_lock);
+
+    seq_printf(m, "provider %s, %u byte buffers, %u threads, %llu ms\n",
+               results.provider, results.size, results.threads,
+               div64_u64(results.elapsed_ns, NSEC_PER_MSEC));
+    seq_printf(m, "%-24s %12s %12s %10s %10s %10s %10s %8s\n",
+               "op", "ops", "ops/s", "GB/s", "p50 ns", "p99 ns", "p99.9 ns", "errors");
+
+    const u64 elapsed = results.elapsed_ns?results.elapsed_ns:1;
+    for(size_t op = 0; op < BENCH_OPS; op++) {
+        const bench_stats_t *stats = &results.stats[op];
+        if (stats->unsupported && !stats->ops) {
+            seq_printf(m, "%-24s %12s\n", BENCH_OP_STR[op], "unsupported");
+            continue;
+        }
+
+        /* bytes per ns is GB/s - keep 3 decimal places */
+        const u64 mbps = div64_u64(stats->bytes * 1000, elapsed);
+        seq_printf(m, "%-24s %12llu %12llu %6llu.%03llu %10llu %10llu %10llu %8llu\n",
+                   BENCH_OP_STR[op], stats->ops,
+                   div64_u64(stats->ops * NSEC_PER_SEC, elapsed),
+                   mbps / 1000, mbps % 1000,
+                   percentile(stats, 500), percentile(stats, 990), percentile(stats, 999),
+                   stats->errors);
+    }
+
+    mutex_unlock(&bench_lock);
+    return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(bench_results);
+
+static ssize_t
+bench_run_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+    mutex_lock(&bench_lock);
+    const int rc = bench_run();
+    mutex_unlock(&bench_lock);
+    return rc?rc:count;
+}
+
+static const struct file_operations bench_run_fops = {
+    .owner = THIS_MODULE,
+    .open  = simple_open,
+    .write = bench_run_write,
+};
+
+static int __init
+dpusm_bench_init(void) {
+    dpusm = dpusm_initialize();
+    if (!dpusm) {
+        printk("%s error: Could not initialze DPUSM.\n", module_name(THIS_MODULE));
+        return -EFAULT;
+    }
+
+    mutex_lock(&bench_lock);
+    const int rc = bench_run();
+    mutex_unlock(&bench_lock);
+    if (rc) {
+        return rc;
+    }
+
+    bench_debugfs = debugfs_create_dir("dpusm_bench", NULL);
+    debugfs_create_file("results", 0444, bench_debugfs, NULL, &bench_results_fops);
+    debugfs_create_file("run", 0200, bench_debugfs, NULL, &bench_run_fops);
+
+    return 0;
+}
+
+static void __exit
+dpusm_bench_exit(void) {
+    debugfs_remove_recursive(bench_debugfs);
+    printk("%s exited\n", module_name(THIS_MODULE));
+}
+
+module_init(dpusm_bench_init);
+module_exit(dpusm_bench_exit);
+
+MODULE_LICENSE("OSS + BSD 3");
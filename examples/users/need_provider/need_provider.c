@@ -1,8 +1,10 @@
+#include <linux/completion.h>
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
 
+#include <dpusm/checksum.h>     /* the DPUSM's host checksums, to check the provider's */
 #include <dpusm/user_api.h>     /* the DPUSM User API */
 #include <dpusm/provider_api.h> /* the DPUSM Provider API (not normally included by users) */
 
@@ -12,6 +14,12 @@ const size_t TEST_BUF_LEN  = sizeof(TEST_BUF) - 1;
 const dpusm_uf_t *dpusm = NULL;
 void *provider = NULL;
 
+static void
+copy_done(void *ptr, int error) {
+    BUG_ON(error != DPUSM_OK);
+    complete((struct completion *) ptr);
+}
+
 static int
 use_provider(const char *provider_name, bool invalidate) {
     provider = dpusm->get(provider_name);
@@ -50,8 +58,139 @@ use_provider(const char *provider_name, bool invalidate) {
     /* contents should match */
     BUG_ON(memcmp(buf, TEST_BUF, TEST_BUF_LEN));
 
+    /* let the DPUSM pick the copy function */
+    memset(buf, 0, TEST_BUF_LEN);
+    BUG_ON(dpusm->copy.to.automatic(&mv_on, buf, TEST_BUF_LEN) != DPUSM_OK);
+    BUG_ON(memcmp(buf, TEST_BUF, TEST_BUF_LEN));
+
+    /* copy without blocking, then wait for the completion */
+    struct completion copied;
+    init_completion(&copied);
+    memset(buf, 0, TEST_BUF_LEN);
+    BUG_ON(dpusm->copy.to.async(&mv_on, buf, TEST_BUF_LEN, copy_done, &copied) != DPUSM_OK);
+    wait_for_completion(&copied);
+    BUG_ON(memcmp(buf, TEST_BUF, TEST_BUF_LEN));
+
+    /* rewrite the allocation one byte at a time through a staged range */
+    BUG_ON(dpusm->stage.begin(handle, 0, TEST_BUF_LEN) != DPUSM_OK);
+    for(size_t i = 0; i < TEST_BUF_LEN; i++) {
+        const char c = TEST_BUF[TEST_BUF_LEN - 1 - i];
+        dpusm_mv_t mv_byte = { .handle = handle, .offset = i };
+        BUG_ON(dpusm->copy.from.generic(&mv_byte, &c, 1) != DPUSM_OK);
+    }
+
+    /* reading the handle writes out the staged bytes first */
+    dpusm->copy.to.generic(&mv_on, buf, TEST_BUF_LEN);
+    for(size_t i = 0; i < TEST_BUF_LEN; i++) {
+        BUG_ON(((char *) buf)[i] != TEST_BUF[TEST_BUF_LEN - 1 - i]);
+    }
+    BUG_ON(dpusm->stage.end(handle) != DPUSM_OK);
+
+    /* restore the original contents */
+    dpusm->copy.from.generic(&mv_off, TEST_BUF, TEST_BUF_LEN);
+
+    /* copy and checksum in one pass - the DPUSM computes fletcher itself if the provider cannot */
+    u64 from_cksum[4];
+    u64 to_cksum[4];
+    const size_t cksum_len = TEST_BUF_LEN & ~(sizeof(u32) - 1);
+    BUG_ON(dpusm->copy.from.checksum(&mv_off, TEST_BUF, cksum_len,
+        DPUSM_CHECKSUM_FLETCHER_4, DPUSM_BYTEORDER_NATIVE,
+        from_cksum, sizeof(from_cksum)) != DPUSM_OK);
+    memset(buf, 0, TEST_BUF_LEN);
+    BUG_ON(dpusm->copy.to.checksum(&mv_on, buf, cksum_len,
+        DPUSM_CHECKSUM_FLETCHER_4, DPUSM_BYTEORDER_NATIVE,
+        to_cksum, sizeof(to_cksum)) != DPUSM_OK);
+    BUG_ON(memcmp(buf, TEST_BUF, cksum_len));
+    BUG_ON(memcmp(from_cksum, to_cksum, sizeof(from_cksum)));
+
+    /* providers without checksums cannot verify */
+    const int verified = dpusm->checksum_verify(DPUSM_CHECKSUM_FLETCHER_4,
+        DPUSM_BYTEORDER_NATIVE, handle, cksum_len, from_cksum, sizeof(from_cksum));
+    BUG_ON((verified != DPUSM_OK) && (verified != DPUSM_NOT_IMPLEMENTED));
+    if (verified == DPUSM_OK) {
+        from_cksum[3]++;
+        BUG_ON(dpusm->checksum_verify(DPUSM_CHECKSUM_FLETCHER_4,
+            DPUSM_BYTEORDER_NATIVE, handle, cksum_len,
+            from_cksum, sizeof(from_cksum)) != DPUSM_CHECKSUM_MISMATCH);
+    }
+
+    /* the estimate from the handle has to match the estimate from memory */
+    unsigned int handle_percent = 0;
+    unsigned int buf_percent = 0;
+    BUG_ON(dpusm->compressibility.handle(handle, 0, TEST_BUF_LEN, &handle_percent) != DPUSM_OK);
+    BUG_ON(dpusm->compressibility.buf(TEST_BUF, TEST_BUF_LEN, &buf_percent) != DPUSM_OK);
+    BUG_ON((handle_percent != buf_percent) || (buf_percent > 100));
+
     kfree(buf);
 
+    /* reference each byte of the allocation at once */
+    void *refs[sizeof(TEST_BUF) - 1];
+    size_t offsets[sizeof(TEST_BUF) - 1];
+    size_t sizes[sizeof(TEST_BUF) - 1];
+    for(size_t i = 0; i < TEST_BUF_LEN; i++) {
+        offsets[i] = i;
+        sizes[i] = 1;
+    }
+    BUG_ON(dpusm->alloc_ref_many(handle, TEST_BUF_LEN, offsets, sizes, refs) != DPUSM_OK);
+
+    for(size_t i = 0; i < TEST_BUF_LEN; i++) {
+        char c = 0;
+        dpusm_mv_t mv_ref = { .handle = refs[i], .offset = 0 };
+        dpusm->copy.to.generic(&mv_ref, &c, 1);
+        BUG_ON(c != TEST_BUF[i]);
+    }
+
+    BUG_ON(dpusm->free_many(TEST_BUF_LEN, refs) != DPUSM_OK);
+
+    /* copy offloader data to memory asynchronously and poll for the result */
+    void *queue = dpusm->async.queue_create(provider, 1);
+    BUG_ON(!queue);
+
+    char async_buf[sizeof(TEST_BUF) - 1];
+    dpusm_op_t op = {
+        .type    = DPUSM_OP_COPY_TO,
+        .copy_to = {
+            .mv   = { .handle = handle, .offset = 0 },
+            .buf  = async_buf,
+            .size = TEST_BUF_LEN,
+        },
+    };
+    BUG_ON(dpusm->async.submit(queue, &op) != DPUSM_OK);
+    BUG_ON(dpusm->async.drain(queue) != DPUSM_OK);
+
+    dpusm_op_t *done = NULL;
+    BUG_ON(dpusm->async.poll(queue, &done, 1) != 1);
+    BUG_ON(done != &op);
+    BUG_ON(op.rc != DPUSM_OK);
+    BUG_ON(memcmp(async_buf, TEST_BUF, TEST_BUF_LEN));
+
+    BUG_ON(dpusm->async.queue_destroy(queue) != DPUSM_OK);
+
+    /* overwrite the allocation and read it back as one chain */
+    char chain_buf[sizeof(TEST_BUF) - 1];
+    dpusm_op_t stages[] = {
+        {
+            .type      = DPUSM_OP_COPY_FROM,
+            .copy_from = {
+                .mv   = { .handle = handle, .offset = 0 },
+                .buf  = TEST_BUF,
+                .size = TEST_BUF_LEN,
+            },
+        },
+        {
+            .type    = DPUSM_OP_COPY_TO,
+            .copy_to = {
+                .mv   = { .handle = handle, .offset = 0 },
+                .buf  = chain_buf,
+                .size = TEST_BUF_LEN,
+            },
+        },
+    };
+    size_t completed = 0;
+    BUG_ON(dpusm->chain(stages, 2, &completed) != DPUSM_OK);
+    BUG_ON(completed != 2);
+    BUG_ON(memcmp(chain_buf, TEST_BUF, TEST_BUF_LEN));
+
     /* free offloader allocation */
     dpusm->free(handle);
 
@@ -61,6 +200,268 @@ use_provider(const char *provider_name, bool invalidate) {
     return 0;
 }
 
+/* copy between allocations from two different providers */
+static int
+use_peers(const char *src_name, const char *dst_name) {
+    void *src_provider = dpusm->get(src_name);
+    if (!src_provider) {
+        printk("%s error: Could not find \"%s\".\n", module_name(THIS_MODULE), src_name);
+        return -ENODEV;
+    }
+
+    void *dst_provider = dpusm->get(dst_name);
+    if (!dst_provider) {
+        printk("%s error: Could not find \"%s\".\n", module_name(THIS_MODULE), dst_name);
+        dpusm->put(src_provider);
+        return -ENODEV;
+    }
+
+    void *src = dpusm->alloc(src_provider, TEST_BUF_LEN);
+    void *dst = dpusm->alloc(dst_provider, TEST_BUF_LEN);
+    BUG_ON(!src || !dst);
+
+    dpusm_mv_t mv_src = { .handle = src, .offset = 0 };
+    dpusm_mv_t mv_dst = { .handle = dst, .offset = 0 };
+    dpusm->copy.from.generic(&mv_src, TEST_BUF, TEST_BUF_LEN);
+    BUG_ON(dpusm->copy.peer(&mv_dst, &mv_src, TEST_BUF_LEN) != DPUSM_OK);
+
+    char buf[sizeof(TEST_BUF) - 1];
+    dpusm->copy.to.generic(&mv_dst, buf, TEST_BUF_LEN);
+    BUG_ON(memcmp(buf, TEST_BUF, TEST_BUF_LEN));
+
+    dpusm->free(dst);
+    dpusm->free(src);
+    dpusm->put(dst_provider);
+    dpusm->put(src_provider);
+
+    return 0;
+}
+
+/* bigger than TEST_BUF so that there is something to compress */
+#define SW_TEST_LEN 4096
+
+/* fill a handle and a host buffer with copies of TEST_BUF */
+static void *
+sw_test_data(void *provider, char **buf) {
+    *buf = kmalloc(SW_TEST_LEN, GFP_KERNEL);
+    BUG_ON(!*buf);
+    for(size_t i = 0; i < SW_TEST_LEN; i++) {
+        (*buf)[i] = TEST_BUF[i % TEST_BUF_LEN];
+    }
+
+    void *handle = dpusm->alloc(provider, SW_TEST_LEN);
+    BUG_ON(!handle);
+
+    dpusm_mv_t mv = { .handle = handle, .offset = 0 };
+    BUG_ON(dpusm->copy.from.generic(&mv, *buf, SW_TEST_LEN) != DPUSM_OK);
+    return handle;
+}
+
+/* compress and decompress with TEST_BUF as the dictionary */
+static void
+use_dict(void *provider, dpusm_pc_t *caps) {
+    if (!(caps->compress & DPUSM_COMPRESS_ZSTD_3)) {
+        printk("%s: no zstd, skipping dictionaries\n", module_name(THIS_MODULE));
+        return;
+    }
+
+    void *dict = dpusm->dict.load(provider, DPUSM_COMPRESS_ZSTD_3, TEST_BUF, TEST_BUF_LEN);
+    BUG_ON(!dict);
+
+    char *expected = NULL;
+    void *src = sw_test_data(provider, &expected);
+    void *cmp = dpusm->alloc(provider, 2 * SW_TEST_LEN);
+    void *dst = dpusm->alloc(provider, SW_TEST_LEN);
+    BUG_ON(!cmp || !dst);
+
+    size_t c_len = 2 * SW_TEST_LEN;
+    BUG_ON(dpusm->dict.compress(dict, DPUSM_COMPRESS_ZSTD_3, 0,
+        src, SW_TEST_LEN, cmp, &c_len) != DPUSM_OK);
+    BUG_ON(c_len >= SW_TEST_LEN);
+
+    int level = 0;
+    size_t d_len = SW_TEST_LEN;
+    BUG_ON(dpusm->dict.decompress(dict, DPUSM_COMPRESS_ZSTD_3, &level,
+        cmp, c_len, dst, &d_len) != DPUSM_OK);
+    BUG_ON(d_len != SW_TEST_LEN);
+
+    char *actual = kmalloc(SW_TEST_LEN, GFP_KERNEL);
+    BUG_ON(!actual);
+    dpusm_mv_t mv = { .handle = dst, .offset = 0 };
+    BUG_ON(dpusm->copy.to.generic(&mv, actual, SW_TEST_LEN) != DPUSM_OK);
+    BUG_ON(memcmp(actual, expected, SW_TEST_LEN));
+
+    kfree(actual);
+    dpusm->free(dst);
+    dpusm->free(cmp);
+    dpusm->free(src);
+    kfree(expected);
+    BUG_ON(dpusm->dict.free(dict) != DPUSM_OK);
+}
+
+/* every algorithm should get the original data back, framed the way other implementations expect */
+static void
+use_compress(void *provider, dpusm_pc_t *caps) {
+    char *expected = NULL;
+    void *src = sw_test_data(provider, &expected);
+    void *cmp = dpusm->alloc(provider, 2 * SW_TEST_LEN);
+    void *dst = dpusm->alloc(provider, SW_TEST_LEN);
+    char *actual = kmalloc(2 * SW_TEST_LEN, GFP_KERNEL);
+    BUG_ON(!cmp || !dst || !actual);
+
+    for(u64 algs = caps->compress; algs; algs &= algs - 1) {
+        const u64 alg = algs & -algs;
+        BUG_ON(!(caps->decompress & alg));
+
+        size_t c_len = 2 * SW_TEST_LEN;
+        BUG_ON(dpusm->compress(alg, 0, src, SW_TEST_LEN, cmp, &c_len) != DPUSM_OK);
+
+        dpusm_mv_t mv_cmp = { .handle = cmp, .offset = 0 };
+        BUG_ON(dpusm->copy.to.generic(&mv_cmp, actual, c_len) != DPUSM_OK);
+        if (alg & DPUSM_COMPRESS_LZ4) {
+            /* big-endian length of the block that follows */
+            const u8 *len = (const u8 *) actual;
+            BUG_ON(((len[0] << 24) | (len[1] << 16) | (len[2] << 8) | len[3]) != c_len - 4);
+        }
+        else if (alg <= DPUSM_COMPRESS_GZIP_9) {
+            /* zlib header for deflate */
+            const u8 *hdr = (const u8 *) actual;
+            BUG_ON(((hdr[0] & 0x0f) != 8) || (((hdr[0] << 8) | hdr[1]) % 31));
+        }
+
+        int level = 0;
+        size_t d_len = SW_TEST_LEN;
+        BUG_ON(dpusm->decompress(alg, &level, cmp, c_len, dst, &d_len) != DPUSM_OK);
+        BUG_ON(d_len != SW_TEST_LEN);
+
+        dpusm_mv_t mv_dst = { .handle = dst, .offset = 0 };
+        BUG_ON(dpusm->copy.to.generic(&mv_dst, actual, SW_TEST_LEN) != DPUSM_OK);
+        BUG_ON(memcmp(actual, expected, SW_TEST_LEN));
+    }
+
+    kfree(actual);
+    dpusm->free(dst);
+    dpusm->free(cmp);
+    dpusm->free(src);
+    kfree(expected);
+}
+
+/* the provider has to write the same checksums as the DPUSM computes on the host */
+static void
+use_checksum(void *provider, dpusm_pc_t *caps) {
+    char *buf = NULL;
+    void *handle = sw_test_data(provider, &buf);
+
+    for(u64 algs = caps->checksum; algs; algs &= algs - 1) {
+        const u64 alg = algs & -algs;
+        for(u64 orders = caps->checksum_byteorder; orders; orders &= orders - 1) {
+            const u64 order = orders & -orders;
+            u8 expected[64];
+            u8 actual[64];
+
+            dpusm_host_cksum_t hc;
+            if (dpusm_host_cksum_init(&hc, alg, order) != DPUSM_OK) {
+                continue;
+            }
+            BUG_ON(dpusm_host_cksum_update(&hc, buf, SW_TEST_LEN) != DPUSM_OK);
+            BUG_ON(dpusm_host_cksum_final(&hc, expected, sizeof(expected)) != DPUSM_OK);
+            dpusm_host_cksum_fini(&hc);
+
+            BUG_ON(dpusm->checksum(alg, order, handle, SW_TEST_LEN,
+                actual, sizeof(actual)) != DPUSM_OK);
+            BUG_ON(memcmp(actual, expected, sizeof(expected)));
+        }
+    }
+
+    dpusm->free(handle);
+    kfree(buf);
+}
+
+#define SW_RAID_PARITY 2
+#define SW_RAID_DATA   4
+#define SW_RAID_COLS   (SW_RAID_PARITY + SW_RAID_DATA)
+#define SW_RAID_SIZE   512
+
+/* lose data columns after generating parity and reconstruct them */
+static void
+use_raid(void *provider, dpusm_pc_t *caps) {
+    if (!(caps->raid & DPUSM_RAID_2_GEN) || !(caps->raid & DPUSM_RAID_2_REC)) {
+        printk("%s: no RAID 2, skipping RAID\n", module_name(THIS_MODULE));
+        return;
+    }
+
+    void *raid = dpusm->raid.alloc(provider, SW_RAID_PARITY, SW_RAID_DATA);
+    BUG_ON(!raid);
+
+    void *cols[SW_RAID_COLS];
+    char *expected = kmalloc(SW_RAID_COLS * SW_RAID_SIZE, GFP_KERNEL);
+    char *actual = kmalloc(SW_RAID_SIZE, GFP_KERNEL);
+    BUG_ON(!expected || !actual);
+
+    for(size_t c = 0; c < SW_RAID_COLS; c++) {
+        char *col = expected + (c * SW_RAID_SIZE);
+        for(size_t i = 0; i < SW_RAID_SIZE; i++) {
+            col[i] = TEST_BUF[(c + i) % TEST_BUF_LEN] + c;
+        }
+
+        cols[c] = dpusm->alloc(provider, SW_RAID_SIZE);
+        BUG_ON(!cols[c]);
+
+        dpusm_mv_t mv = { .handle = cols[c], .offset = 0 };
+        BUG_ON(dpusm->copy.from.generic(&mv, col, SW_RAID_SIZE) != DPUSM_OK);
+        BUG_ON(dpusm->raid.set_column(raid, c, cols[c], SW_RAID_SIZE) != DPUSM_OK);
+    }
+
+    BUG_ON(dpusm->raid.gen(raid) != DPUSM_OK);
+
+    /* one data column, then two */
+    int tgts[] = { SW_RAID_PARITY + 1, SW_RAID_COLS - 1 };
+    for(int ntgts = 1; ntgts <= 2; ntgts++) {
+        memset(actual, 0, SW_RAID_SIZE);
+        for(int t = 0; t < ntgts; t++) {
+            dpusm_mv_t mv = { .handle = cols[tgts[t]], .offset = 0 };
+            BUG_ON(dpusm->copy.from.generic(&mv, actual, SW_RAID_SIZE) != DPUSM_OK);
+        }
+
+        BUG_ON(dpusm->raid.rec(raid, tgts, ntgts) != DPUSM_OK);
+
+        for(int t = 0; t < ntgts; t++) {
+            dpusm_mv_t mv = { .handle = cols[tgts[t]], .offset = 0 };
+            BUG_ON(dpusm->copy.to.generic(&mv, actual, SW_RAID_SIZE) != DPUSM_OK);
+            BUG_ON(memcmp(actual, expected + (tgts[t] * SW_RAID_SIZE), SW_RAID_SIZE));
+        }
+    }
+
+    BUG_ON(dpusm->raid.free(raid) != DPUSM_OK);
+    for(size_t c = 0; c < SW_RAID_COLS; c++) {
+        dpusm->free(cols[c]);
+    }
+    kfree(actual);
+    kfree(expected);
+}
+
+/* operations that only the software provider implements */
+static int
+use_software(const char *provider_name) {
+    void *provider = dpusm->get(provider_name);
+    if (!provider) {
+        printk("%s error: Could not find \"%s\".\n", module_name(THIS_MODULE), provider_name);
+        return -ENODEV;
+    }
+
+    dpusm_pc_t *caps = NULL;
+    BUG_ON(dpusm->capabilities(provider, &caps) != DPUSM_OK);
+
+    use_compress(provider, caps);
+    use_checksum(provider, caps);
+    use_raid(provider, caps);
+    use_dict(provider, caps);
+
+    dpusm->put(provider);
+
+    return 0;
+}
+
 static int __init
 dpusm_need_provider_init(void) {
     dpusm = dpusm_initialize();
@@ -72,6 +473,8 @@ dpusm_need_provider_init(void) {
     int rc = 0;
     rc = (rc == 0)?use_provider("example_bsd_dpusm_provider", 0):rc;
     rc = (rc == 0)?use_provider("example_gpl_dpusm_provider", 0):rc;
+    rc = (rc == 0)?use_peers("example_bsd_dpusm_provider", "example_gpl_dpusm_provider"):rc;
+    rc = (rc == 0)?use_software("example_software_dpusm_provider"):rc;
 
     /* down providers while they are in use */
     use_provider("example_bsd_dpusm_provider", 1);
@@ -8,4 +8,12 @@ void *dpusm_mem_alloc(size_t size);
 void dpusm_mem_free(void *ptr, size_t size);
 void dpusm_mem_stats(size_t *total, size_t *count, size_t *size);
 
+struct kmem_cache;
+struct kmem_cache *dpusm_mem_cache_create(const char *name, size_t size);
+void dpusm_mem_cache_destroy(struct kmem_cache *cache);
+void *dpusm_mem_cache_alloc(struct kmem_cache *cache);
+void dpusm_mem_cache_free(struct kmem_cache *cache, void *ptr);
+size_t dpusm_mem_cache_alloc_bulk(struct kmem_cache *cache, size_t count, void **ptrs);
+void dpusm_mem_cache_free_bulk(struct kmem_cache *cache, size_t count, void **ptrs);
+
 #endif
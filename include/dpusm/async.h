@@ -0,0 +1,29 @@
+#ifndef _DATA_PROCESSING_UNIT_SERVICES_MODULE_ASYNC_H
+#define _DATA_PROCESSING_UNIT_SERVICES_MODULE_ASYNC_H
+
+#include <dpusm/common.h>
+
+/*
+ * asynchronous submission and completion queues
+ *
+ * Operations are passed to the provider if it has its own
+ * queues. Otherwise, they are run on a workqueue with the
+ * synchronous functions.
+ */
+
+/* called by dpusm.c when the module is loaded and unloaded */
+int dpusm_async_init(void);
+void dpusm_async_fini(void);
+
+/* run a copy on the workqueue - called by user.c for providers without async copies */
+int dpusm_async_copy_emulate(dpusm_mv_t *mv, void *buf, size_t size, bool to,
+    dpusm_cc_t copy_completion, void *cc_args);
+
+/* user facing functions - see user_api.h */
+void *dpusm_async_queue_create(void *provider, unsigned int depth);
+int dpusm_async_submit(void *queue, dpusm_op_t *op);
+int dpusm_async_poll(void *queue, dpusm_op_t **ops, int max);
+int dpusm_async_drain(void *queue);
+int dpusm_async_queue_destroy(void *queue);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _DATA_PROCESSING_UNIT_SERVICES_MODULE_CHECKSUM_H
+#define _DATA_PROCESSING_UNIT_SERVICES_MODULE_CHECKSUM_H
+
+#include <dpusm/common.h>
+
+struct shash_desc;
+
+/*
+ * checksums of host memory
+ *
+ * Used by copies with checksums when the provider cannot compute
+ * the checksum itself. Fletcher is computed directly and SHA-2
+ * through the kernel's crypto API.
+ *
+ * Exported so providers that checksum in host memory do not need
+ * their own copy. They may update fletcher[] directly with a faster
+ * implementation.
+ */
+typedef struct dpusm_host_cksum {
+    dpusm_checksum_t alg;
+    int byteswap;
+    u64 fletcher[4];
+    struct shash_desc *desc;
+} dpusm_host_cksum_t;
+
+/* called by user.c when the module is loaded and unloaded */
+void dpusm_host_cksum_load(void);
+void dpusm_host_cksum_unload(void);
+
+/* dpusm_checksum_t bitmap of what init accepts */
+u64 dpusm_host_cksum_algorithms(void);
+
+/* returns DPUSM_NOT_SUPPORTED if alg cannot be computed on the host */
+int dpusm_host_cksum_init(dpusm_host_cksum_t *hc, dpusm_checksum_t alg,
+    dpusm_checksum_byteorder_t order);
+
+/* for fletcher, size has to be a multiple of the block size */
+int dpusm_host_cksum_update(dpusm_host_cksum_t *hc, const void *buf, size_t size);
+
+/* write the checksum like the providers would - always call fini afterwards */
+int dpusm_host_cksum_final(dpusm_host_cksum_t *hc, void *cksum, size_t cksum_size);
+void dpusm_host_cksum_fini(dpusm_host_cksum_t *hc);
+
+#endif
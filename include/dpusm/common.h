@@ -1,6 +1,8 @@
 #ifndef _FILE_SERVICES_MODULE_COMMON_H
 #define _FILE_SERVICES_MODULE_COMMON_H
 
+#include <linux/math64.h>
+#include <linux/time64.h>
 #include <linux/types.h>
 
 #define DPUSM_OK                    0
@@ -12,6 +14,9 @@
 #define DPUSM_NOT_IMPLEMENTED       6 /* function is not implemented */
 #define DPUSM_NOT_SUPPORTED         7 /* function is implemented, but specific operation is not supported */
 #define DPUSM_BAD_RESULT            8 /* function ran and returned an error */
+#define DPUSM_QUEUE_FULL            9 /* asynchronous queue has no free slots - reap completions and resubmit */
+#define DPUSM_CHECKSUM_MISMATCH     10 /* checksum was computed, but does not match the expected checksum */
+#define DPUSM_NOT_COMPRESSIBLE      11 /* compression stopped because the output would be too large */
 
 /* 0 should be considered invalid/not available when using these values */
 
@@ -24,8 +29,25 @@ typedef enum {
     DPUSM_OPTIONAL_MEM_STATS             = 1 << 5,
     DPUSM_OPTIONAL_ZERO_FILL             = 1 << 6,
     DPUSM_OPTIONAL_ALL_ZEROS             = 1 << 7,
+    DPUSM_OPTIONAL_EMBEDDED_HANDLE       = 1 << 8,
+    DPUSM_OPTIONAL_ASYNC                 = 1 << 9,
+    DPUSM_OPTIONAL_CHAIN                 = 1 << 10,
+    DPUSM_OPTIONAL_CHECKSUM_MANY         = 1 << 11,
+    DPUSM_OPTIONAL_COPY_FROM_ASYNC       = 1 << 12,
+    DPUSM_OPTIONAL_COPY_TO_ASYNC         = 1 << 13,
+    DPUSM_OPTIONAL_COPY_PEER             = 1 << 14,
+    DPUSM_OPTIONAL_CHECKSUM_CTX          = 1 << 15,
+    DPUSM_OPTIONAL_COPY_FROM_CHECKSUM    = 1 << 16,
+    DPUSM_OPTIONAL_COPY_TO_CHECKSUM      = 1 << 17,
+    DPUSM_OPTIONAL_CHECKSUM_VERIFY       = 1 << 18,
+    DPUSM_OPTIONAL_CHECKSUM_VERIFY_MANY  = 1 << 19,
+    DPUSM_OPTIONAL_COMPRESS_BOUNDED      = 1 << 20,
+    DPUSM_OPTIONAL_COMPRESSIBILITY       = 1 << 21,
+    DPUSM_OPTIONAL_DICT                  = 1 << 22,
+    DPUSM_OPTIONAL_COMPRESS_MANY         = 1 << 23,
+    DPUSM_OPTIONAL_DECOMPRESS_MANY       = 1 << 24,
 
-    DPUSM_OPTIONAL_MAX                   = 1 << 8,
+    DPUSM_OPTIONAL_MAX                   = 1 << 25,
 } dpusm_optional_t;
 
 extern const char *DPUSM_OPTIONAL_STR[];
@@ -121,20 +143,53 @@ typedef enum {
 
 extern const char *DPUSM_IO_STR[];
 
+/*
+ * what a provider expects a single algorithm to do
+ *
+ * Filled in by the provider at registration and returned by
+ * dpusm->algorithm_properties. Callers can use these to decide
+ * whether a buffer is worth sending to the provider. 0 means
+ * unknown or no limit.
+ */
+typedef struct dpusm_algorithm_properties {
+    u64 max_size;       /* largest input in bytes */
+    u64 alignment;      /* inputs have to be a multiple of this many bytes */
+    u64 throughput;     /* bytes per second once running */
+    u64 latency_ns;     /* time taken by an operation on a tiny input */
+} dpusm_ap_t;
+
 /* each member is a bitmask of capabilities */
 typedef struct dpusm_provider_capabilities {
-    int optional;             // dpusm_optional_t
-    int compress;             // dpusm_compress_t
-    int decompress;           // dpusm_decompress_t
-    int checksum;             // dpusm_checksum_t
-    int checksum_byteorder;   // dpusm_byteorder_t
-    int raid;                 // dpusm_raid_t
-    int io;                   // dpusm_io_t
+    u64 optional;             // dpusm_optional_t
+    u64 compress;             // dpusm_compress_t
+    u64 decompress;           // dpusm_decompress_t
+    u64 checksum;             // dpusm_checksum_t
+    u64 checksum_byteorder;   // dpusm_byteorder_t
+    u64 raid;                 // dpusm_raid_t
+    u64 io;                   // dpusm_io_t
 } dpusm_pc_t;
 
 /* expects only one bit will be set, so only returns first set bit */
-int enum2index(int mask);
-const char *enum2str(const char **strs, int mask);
+int enum2index(u64 mask);
+const char *enum2str(const char **strs, u64 mask);
+
+/* whether or not the provider accepts size bytes */
+static inline int
+dpusm_ap_fits(const dpusm_ap_t *props, u64 size) {
+    return (!props->max_size || (size <= props->max_size)) &&
+           (!props->alignment || !(size % props->alignment));
+}
+
+/* expected time in nanoseconds to process size bytes - 0 if unknown */
+static inline u64
+dpusm_ap_time_ns(const dpusm_ap_t *props, u64 size) {
+    if (!props->throughput) {
+        return 0;
+    }
+
+    /* size * NSEC_PER_SEC does not fit in 64 bits for sizes over about 18 GB */
+    return props->latency_ns + mul_u64_u64_div_u64(size, NSEC_PER_SEC, props->throughput);
+}
 
 /*
  * use this struct to copy data to and from offloader memory
@@ -155,4 +210,137 @@ typedef dpusm_disk_write_completion_t dpusm_dwc_t;
 typedef void (*dpusm_disk_flush_completion_t)(void *ptr, int error);
 typedef dpusm_disk_flush_completion_t dpusm_dfc_t;
 
+/* callback to run after completing asynchronous copies */
+typedef void (*dpusm_copy_completion_t)(void *ptr, int error);
+typedef dpusm_copy_completion_t dpusm_cc_t;
+
+/* operations that can be submitted asynchronously or chained */
+typedef enum {
+    DPUSM_OP_COMPRESS,
+    DPUSM_OP_DECOMPRESS,
+    DPUSM_OP_CHECKSUM,
+    DPUSM_OP_RAID_GEN,
+    DPUSM_OP_RAID_REC,
+    DPUSM_OP_COPY_FROM,
+    DPUSM_OP_COPY_TO,
+    DPUSM_OP_FILE_WRITE,
+    DPUSM_OP_RAID_SET_COLUMN,
+    DPUSM_OP_DISK_WRITE,
+
+    DPUSM_OP_MAX,
+} dpusm_op_type_t;
+
+/*
+ * chained operations only: use the output length of the previous
+ * stage (*d_len of a compress or decompress) as this stage's input
+ * size (s_len, size, or data_size)
+ */
+#define DPUSM_OP_SIZE_FROM_PREV (1U << 0)
+
+typedef struct dpusm_op dpusm_op_t;
+
+/* callback to run after completing an asynchronous operation */
+typedef void (*dpusm_op_completion_t)(dpusm_op_t *op);
+
+/*
+ * description of an asynchronous operation
+ *
+ * The arguments are the same as the synchronous functions'.
+ * Output pointers (d_len, cksum, etc.) must remain valid
+ * until the operation completes.
+ */
+struct dpusm_op {
+    dpusm_op_type_t type;
+    unsigned int flags;
+
+    union {
+        struct {
+            dpusm_compress_t alg;
+            int level;
+            void *src;
+            size_t s_len;
+            void *dst;
+            size_t *d_len;
+        } compress;
+
+        struct {
+            dpusm_decompress_t alg;
+            int *level;
+            void *src;
+            size_t s_len;
+            void *dst;
+            size_t *d_len;
+        } decompress;
+
+        struct {
+            dpusm_checksum_t alg;
+            dpusm_checksum_byteorder_t order;
+            void *data;
+            size_t size;
+            void *cksum;
+            size_t cksum_size;
+        } checksum;
+
+        struct {
+            void *raid;
+        } raid_gen;
+
+        struct {
+            void *raid;
+            int *tgts;
+            int ntgts;
+        } raid_rec;
+
+        struct {
+            dpusm_mv_t mv;
+            const void *buf;
+            size_t size;
+        } copy_from;
+
+        struct {
+            dpusm_mv_t mv;
+            void *buf;
+            size_t size;
+        } copy_to;
+
+        struct {
+            void *fp_handle;
+            void *data;
+            size_t size;
+            size_t trailing_zeros;
+            loff_t offset;
+            uint8_t ashift;
+            ssize_t *resid;
+            int *err;
+        } file_write;
+
+        struct {
+            void *raid;
+            uint64_t c;
+            void *col;
+            size_t size;
+        } raid_set_column;
+
+        struct {
+            void *disk;
+            void *data;
+            size_t data_size;
+            size_t trailing_zeros;
+            uint64_t io_offset;
+            int flags;
+            dpusm_dwc_t write_completion;
+            void *wc_args;
+        } disk_write;
+    };
+
+    /* return value of the operation - set before completion is called */
+    int rc;
+
+    /* if NULL, the operation is returned by poll instead */
+    dpusm_op_completion_t completion;
+
+    /* owned by the submitter */
+    void *private;
+};
+
 #endif
@@ -0,0 +1,26 @@
+#ifndef _DATA_PROCESSING_UNIT_SERVICES_MODULE_DEBUG_H
+#define _DATA_PROCESSING_UNIT_SERVICES_MODULE_DEBUG_H
+
+#include <linux/jump_label.h>
+#include <linux/printk.h>
+
+/*
+ * verbose messages are off by default and cost a single
+ * patched-out branch until enabled at runtime with
+ *
+ *     echo 1 > /sys/module/dpusm/parameters/debug
+ *
+ * defined in dpusm.c
+ */
+DECLARE_STATIC_KEY_FALSE(dpusm_debug_key);
+
+#define dpusm_debug_enabled() static_branch_unlikely(&dpusm_debug_key)
+
+#define dpusm_debug(fmt, ...)                                   \
+    do {                                                        \
+        if (dpusm_debug_enabled()) {                            \
+            printk(fmt, ##__VA_ARGS__);                         \
+        }                                                       \
+    } while (0)
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _DATA_PROCESSING_UNIT_SERVICES_MODULE_POOL_H
+#define _DATA_PROCESSING_UNIT_SERVICES_MODULE_POOL_H
+
+#include <linux/types.h>
+
+/*
+ * per-CPU, per-size class, per-provider cache of freed handles
+ *
+ * Only allocations that are exactly a power of 2 in size,
+ * between 4K and 1M inclusive, are cached.
+ *
+ * Caching is opt-in: providers only get a pool if the pool_high
+ * module parameter is not 0 when they are registered.
+ */
+
+#define DPUSM_POOL_MIN_SHIFT 12 /* 4K */
+#define DPUSM_POOL_MAX_SHIFT 20 /* 1M */
+#define DPUSM_POOL_CLASSES   (DPUSM_POOL_MAX_SHIFT - DPUSM_POOL_MIN_SHIFT + 1)
+#define DPUSM_POOL_DEPTH_MAX 64 /* upper limit of pool_high */
+
+typedef struct dpusm_pool dpusm_pool_t;
+
+struct dentry;
+
+/* called by dpusm.c when the module is loaded and unloaded */
+int dpusm_pool_init(struct dentry *debugfs);
+void dpusm_pool_fini(void);
+
+/* returns NULL if pooling is disabled */
+dpusm_pool_t *dpusm_pool_create(const char *name);
+
+/* returns all cached handles to the provider */
+void dpusm_pool_destroy(dpusm_pool_t *pool);
+
+/* returns -1 if allocations of this size are not cached */
+int dpusm_pool_class(size_t size);
+
+/* returns NULL on miss */
+void *dpusm_pool_get(dpusm_pool_t *pool, int class);
+
+/* returns 1 if the pool took the handle and 0 if the caller should free it */
+int dpusm_pool_put(dpusm_pool_t *pool, int class, void *handle);
+
+#endif
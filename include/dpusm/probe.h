@@ -0,0 +1,26 @@
+#ifndef _DATA_PROCESSING_UNIT_SERVICES_MODULE_PROBE_H
+#define _DATA_PROCESSING_UNIT_SERVICES_MODULE_PROBE_H
+
+#include <dpusm/common.h>
+
+/*
+ * compressibility estimates on the host
+ *
+ * Used when the provider cannot estimate compressibility itself. A few
+ * evenly spaced samples are read instead of the whole buffer.
+ */
+
+/* bytes in each sample and samples taken from each buffer */
+#define DPUSM_PROBE_SAMPLE_SIZE 256
+#define DPUSM_PROBE_SAMPLES     16
+
+/* where sample i of a buffer of size bytes starts */
+size_t dpusm_probe_sample_offset(size_t size, size_t i);
+
+/* estimate from samples that have already been gathered into buf */
+int dpusm_probe_samples(const void *buf, size_t size, unsigned int *percent);
+
+/* estimate from a host buffer */
+int dpusm_probe(const void *buf, size_t size, unsigned int *percent);
+
+#endif
@@ -2,28 +2,61 @@
 #define _DATA_PROCESSING_UNIT_SERVICES_MODULE_PROVIDER_H
 
 #include <linux/atomic.h>
+#include <linux/hashtable.h>
 #include <linux/list.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/rculist.h>
+#include <linux/stringhash.h>
+#include <linux/wait.h>
 
+#include <dpusm/pool.h>
 #include <dpusm/provider_api.h>
 
+/* log2 of the number of buckets in the provider name index */
+#define DPUSM_PROVIDER_HASH_BITS 6
+
+/* how long unregistration waits for users to return a provider */
+#define DPUSM_PROVIDER_DRAIN_TIMEOUT (10 * HZ)
+
+/* default copy.*.automatic thresholds */
+#define DPUSM_COPY_PTR_MIN_DEFAULT         4096
+#define DPUSM_COPY_SCATTERLIST_MIN_DEFAULT 65536
+
+struct dentry;
+
 /* single provider data */
 typedef struct dpusm_provider_handle {
     struct module *module;
+    u32 name_hash;           /* hash of module_name(module) */
+    size_t name_len;         /* strlen(module_name(module)) */
     dpusm_pc_t capabilities; /* constant set of capabilities */
+    dpusm_ap_t *props;       /* properties of each supported algorithm, or NULL (see dpusmph_algorithm_properties) */
+    size_t nprops;
     const dpusm_pf_t *funcs; /* reference to a struct */
-    atomic_t refs;           /* how many users are holding this provider */
-    struct list_head list;
+    long __percpu *refs;     /* how many users are holding this provider (sum over all CPUs) */
+    bool draining;           /* unregistering - puts wake drain */
+    wait_queue_head_t drain;
+    int handle_class;        /* cache for DPUSM handles with embedded provider handles */
+    dpusm_pool_t *pool;      /* freed handles to reuse - NULL if pooling is disabled */
+    size_t copy_ptr_min;     /* copy.*.automatic thresholds - tunable in debugfs */
+    size_t copy_scatterlist_min;
+    struct dentry *debugfs;  /* /sys/kernel/debug/dpusm/<provider> */
+    struct list_head list;   /* RCU protected */
+    struct hlist_node node;  /* RCU protected - entry in dpusm_t.index */
     struct dpusm_provider_handle *self;
 } dpusm_ph_t;
 
 typedef struct {
-    struct list_head providers;  /* list of providers */
+    struct list_head providers;  /* list of providers (RCU protected) */
+    DECLARE_HASHTABLE(index, DPUSM_PROVIDER_HASH_BITS); /* providers keyed by name hash (RCU protected) */
     size_t count;                /* count of registered providers */
-    struct mutex lock;
-    atomic_t active;             /* how many providers are active (may be larger than count) */
+    struct mutex lock;           /* serializes writers - readers use RCU */
+    struct dentry *debugfs;      /* /sys/kernel/debug/dpusm */
+    long __percpu *active;       /* how many providers are active (may be larger than count) */
                                  /* this is not tied to the provider/count */
+                                 /* sum over all CPUs */
 } dpusm_t;
 
 int dpusm_provider_register(dpusm_t *dpusm, struct module *module, const dpusm_pf_t *funcs);
@@ -36,7 +69,12 @@ int dpusm_provider_unregister(dpusm_t *dpusm, struct module *module);
 dpusm_ph_t **dpusm_provider_get(dpusm_t *dpusm, const char *name);
 int dpusm_provider_put(dpusm_t *dpusm, void *handle);
 
+/* total number of references held across all providers */
+long dpusm_provider_active(dpusm_t *dpusm);
+
 /* called by user.c */
+int dpusmph_algorithm_properties(const dpusm_ph_t *dpusmph, dpusm_op_type_t type,
+    u64 alg, dpusm_ap_t *props);
 void *dpusm_get(const char *name);
 int dpusm_put(void *handle);
 
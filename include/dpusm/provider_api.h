@@ -6,6 +6,9 @@
 
 #include <dpusm/common.h>
 
+/* largest embedded provider handle */
+#define DPUSM_PRIVATE_SIZE_MAX 256
+
 /* provider should copy whatever data it needs out of here */
 typedef struct dpusm_provider_disk_data {
     const char *path;
@@ -25,9 +28,14 @@ typedef struct dpusm_provider_functions {
      * When the provider is registered, the DPUSM will call
      * this function once while gathering capabilities.
      */
-    int (*algorithms)(int *compress, int *decompress,
-                      int *checksum, int *checksum_byteorder,
-                      int *raid);
+    int (*algorithms)(u64 *compress, u64 *decompress,
+                      u64 *checksum, u64 *checksum_byteorder,
+                      u64 *raid);
+
+    /*
+     * alloc, alloc_ref, and free are not required
+     * if the embedded handle functions are defined
+     */
 
     /* get a new offloader handle */
     void *(*alloc)(size_t size);
@@ -60,6 +68,24 @@ typedef struct dpusm_provider_functions {
                 struct scatterlist *sgl,
                 unsigned int nents,
                 size_t size);
+
+            /*
+             * optional
+             * start a copy and return - call copy_completion(cc_args, rc)
+             * exactly once when it finishes (from any context)
+             */
+            int (*async)(dpusm_mv_t *mv, const void *buf, size_t size,
+                dpusm_cc_t copy_completion, void *cc_args);
+
+            /*
+             * optional
+             * copy like generic and checksum the copied bytes in the
+             * same pass - return DPUSM_NOT_SUPPORTED for algorithms
+             * that cannot be computed during the copy
+             */
+            int (*checksum)(dpusm_mv_t *mv, const void *buf, size_t size,
+                dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+                void *cksum, size_t cksum_size);
         } from;
 
         /* offloader -> memory */
@@ -77,13 +103,59 @@ typedef struct dpusm_provider_functions {
                 struct scatterlist *sgl,
                 unsigned int nents,
                 size_t size);
+
+            /*
+             * optional
+             * start a copy and return - call copy_completion(cc_args, rc)
+             * exactly once when it finishes (from any context)
+             */
+            int (*async)(dpusm_mv_t *mv, void *buf, size_t size,
+                dpusm_cc_t copy_completion, void *cc_args);
+
+            /* optional - see from.checksum */
+            int (*checksum)(dpusm_mv_t *mv, void *buf, size_t size,
+                dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+                void *cksum, size_t cksum_size);
         } to;
+
+        /*
+         * optional
+         * copy size bytes between one of this provider's handles and
+         * a handle that belongs to the provider named remote (which
+         * may be this provider) without going through host memory
+         *
+         * to_remote is 1 when local is the source and 0 when it is
+         * the destination. Return DPUSM_NOT_SUPPORTED if the remote
+         * provider cannot be reached.
+         */
+        int (*peer)(dpusm_mv_t *local, const char *remote,
+            dpusm_mv_t *remote_mv, size_t size, int to_remote);
+
+        /*
+         * optional
+         * smallest copies that copy.*.automatic sends through ptr
+         * and scatterlist (0 uses the DPUSM defaults)
+         *
+         * can be changed at runtime in /sys/kernel/debug/dpusm/<provider>/
+         */
+        size_t ptr_min;
+        size_t scatterlist_min;
     } copy;
 
     /*
      * optional
      */
 
+    /*
+     * describe an algorithm returned by algorithms
+     *
+     * Called once at registration for each compress (type is
+     * DPUSM_OP_COMPRESS), decompress, and checksum algorithm. Leave
+     * fields that are not known as 0. If this is not defined or does
+     * not return DPUSM_OK, the algorithm's properties are all 0.
+     */
+    int (*algorithm_properties)(dpusm_op_type_t type, u64 alg, dpusm_ap_t *props);
+
     /*
      * Run immediately after obtaining a handle
      *     called by dpusm
@@ -100,6 +172,44 @@ typedef struct dpusm_provider_functions {
      */
     void (*at_disconnect)(void);
 
+    /*
+     * embedded handles
+     *
+     * If private_size is not 0, each offloader handle is allocated by
+     * the DPUSM in the same allocation as the DPUSM's own handle. The
+     * space (private_size bytes, 8 byte aligned, at most
+     * DPUSM_PRIVATE_SIZE_MAX) is passed to alloc_private and
+     * alloc_ref_private to be filled in place, and is the handle
+     * passed to all other functions. These are used instead of
+     * alloc, alloc_ref, and free.
+     *
+     * free_private should release whatever the handle owns, but not
+     * the space itself.
+     */
+    size_t private_size;
+    int (*alloc_private)(void *handle, size_t size);
+    int (*alloc_ref_private)(void *handle, void *src, size_t offset, size_t size);
+    int (*free_private)(void *handle);
+
+    /*
+     * batched handle operations
+     *
+     * Fulfill a whole set of allocations with one round trip. If
+     * these are not defined, the DPUSM will loop over the single
+     * handle functions.
+     *
+     * If private_size is not 0, handles[i] point to embedded handles
+     * that should be filled in place. Otherwise, the new handles
+     * should be written to handles[i].
+     *
+     * Return DPUSM_OK only if all count handles were created. On
+     * failure, nothing should be left allocated.
+     */
+    int (*alloc_many)(size_t count, size_t *sizes, void **handles);
+    int (*alloc_ref_many)(void *src, size_t count, size_t *offsets,
+        size_t *sizes, void **handles);
+    int (*free_many)(size_t count, void **handles);
+
     /*
      * memory statistics
      * definition will depend on the provider, but in general:
@@ -124,6 +234,59 @@ typedef struct dpusm_provider_functions {
     int (*compress)(dpusm_compress_t alg, int level,
         void *src, size_t s_len, void *dst, size_t *d_len);
 
+    /*
+     * optional batched compression - see compress_many in user_api.h
+     *
+     * Entries are independent, so they can be spread across all of the
+     * provider's engines. rcs is never NULL and every entry should be
+     * filled in. levels may be NULL. If these are not defined, the
+     * DPUSM calls compress or decompress for each entry.
+     */
+    int (*compress_many)(dpusm_compress_t alg, int level, size_t count,
+        void **srcs, size_t *s_lens, void **dsts, size_t *d_lens, int *rcs);
+    int (*decompress_many)(dpusm_decompress_t alg, int *levels, size_t count,
+        void **srcs, size_t *s_lens, void **dsts, size_t *d_lens, int *rcs);
+
+    /*
+     * optional
+     * compress, but return DPUSM_NOT_COMPRESSIBLE as soon as the
+     * output is known to not fit in *d_len bytes
+     */
+    int (*compress_bounded)(dpusm_compress_t alg, int level,
+        void *src, size_t s_len, void *dst, size_t *d_len);
+
+    /*
+     * optional
+     * estimate the compressed size of size bytes at offset in handle
+     * as a percentage of size (100 if it will not compress)
+     *
+     * This should be much cheaper than compressing. If this is not
+     * defined, the DPUSM copies a few samples of the data to the
+     * host and estimates from their entropy.
+     */
+    int (*compressibility)(void *handle, size_t offset, size_t size,
+        unsigned int *percent);
+
+    /*
+     * optional compression dictionaries
+     *
+     * load copies a dictionary of size bytes out of buf and keeps it
+     * on the provider until free is called, so it is not sent again
+     * with each block. algs is every compress and decompress algorithm
+     * the dictionary will be used with. Return NULL on error.
+     *
+     * compress and decompress are the same as the functions without
+     * dictionaries.
+     */
+    struct {
+        void *(*load)(dpusm_compress_t algs, const void *buf, size_t size);
+        int (*compress)(void *dict, dpusm_compress_t alg, int level,
+            void *src, size_t s_len, void *dst, size_t *d_len);
+        int (*decompress)(void *dict, dpusm_decompress_t alg, int *level,
+            void *src, size_t s_len, void *dst, size_t *d_len);
+        void (*free)(void *dict);
+    } dict;
+
     /* pass in usable space in dst, get back decompressed length */
     int (*decompress)(dpusm_decompress_t alg, int *level,
         void *src, size_t s_len, void *dst, size_t *d_len);
@@ -133,6 +296,53 @@ typedef struct dpusm_provider_functions {
         void *data, size_t size,
         void *cksum, size_t cksum_size);
 
+    /*
+     * optional batched checksum - see checksum_many in user_api.h
+     *
+     * rcs is never NULL and every entry should be filled in. If this
+     * is not defined, the DPUSM calls checksum for each range.
+     */
+    int (*checksum_many)(dpusm_checksum_t alg,
+        dpusm_checksum_byteorder_t order, size_t count,
+        void **handles, size_t *offsets, size_t *sizes,
+        void *cksums, size_t cksum_size, int *rcs);
+
+    /*
+     * optional checksum verification - see checksum_verify in user_api.h
+     *
+     * Return DPUSM_OK if the checksum matches expected and
+     * DPUSM_CHECKSUM_MISMATCH if it does not. checksum_verify_many
+     * should fill in every entry of rcs. If these are not defined, the
+     * DPUSM calls checksum or checksum_many and compares the checksums
+     * itself.
+     */
+    int (*checksum_verify)(dpusm_checksum_t alg,
+        dpusm_checksum_byteorder_t order,
+        void *data, size_t size,
+        const void *expected, size_t cksum_size);
+    int (*checksum_verify_many)(dpusm_checksum_t alg,
+        dpusm_checksum_byteorder_t order, size_t count,
+        void **handles, size_t *offsets, size_t *sizes,
+        const void *expected, size_t cksum_size, int *rcs);
+
+    /*
+     * optional incremental checksums - see checksum_ctx in user_api.h
+     *
+     * init returns a context, or NULL on error. update adds size
+     * bytes at offset in handle to the checksum. final writes the
+     * checksum of everything added so far. free is called once the
+     * context is no longer needed, whether or not final was called.
+     *
+     * If these are not defined, the DPUSM copies the segments into
+     * one handle and calls checksum.
+     */
+    struct {
+        void *(*init)(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order);
+        int (*update)(void *ctx, void *handle, size_t offset, size_t size);
+        int (*final)(void *ctx, void *cksum, size_t cksum_size);
+        void (*free)(void *ctx);
+    } checksum_ctx;
+
     struct {
         int (*can_compute)(size_t nparity, size_t ndata,
             size_t *col_sizes, int rec);
@@ -183,6 +393,40 @@ typedef struct dpusm_provider_functions {
             void *fc_args);
         void (*close)(void *private);
     } disk;
+
+    /*
+     * run stages in order, stopping at the first stage that fails
+     *
+     * The handles in stages are offloader handles. Set the rc of
+     * each stage that ran (including the one that failed), and set
+     * completed to the number of stages that succeeded.
+     * DPUSM_OP_SIZE_FROM_PREV must be honored. Completion
+     * callbacks in the stages are not used.
+     *
+     * If this is not defined, the DPUSM runs the stages one at a time.
+     */
+    int (*chain)(dpusm_op_t *stages, size_t count, size_t *completed);
+
+    /*
+     * asynchronous operations
+     *
+     * create should return a queue that can hold depth
+     * operations in flight, or NULL on error.
+     *
+     * submit should return DPUSM_OK if the operation was accepted.
+     * The handles in op are offloader handles. When the operation
+     * finishes, the provider should set op->rc and call
+     * op->completion(op) exactly once. The completion may be
+     * called from any context.
+     *
+     * If these are not defined, the DPUSM runs operations
+     * submitted to asynchronous queues on a workqueue.
+     */
+    struct {
+        void *(*create)(unsigned int depth);
+        int (*submit)(void *queue, dpusm_op_t *op);
+        void (*destroy)(void *queue);
+    } async;
 } dpusm_pf_t;
 
 /* returns -ERRNO instead of DPUSM_* */
@@ -0,0 +1,115 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM dpusm
+
+#if !defined(_DATA_PROCESSING_UNIT_SERVICES_MODULE_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _DATA_PROCESSING_UNIT_SERVICES_MODULE_TRACE_H
+
+#include <linux/module.h>
+#include <linux/tracepoint.h>
+
+/*
+ * registry events
+ *
+ * enable with
+ *     echo 1 > /sys/kernel/tracing/events/dpusm/enable
+ */
+DECLARE_EVENT_CLASS(dpusm_provider_class,
+    TP_PROTO(const char *name, const void *provider),
+    TP_ARGS(name, provider),
+    TP_STRUCT__entry(
+        __array(char, name, MODULE_NAME_LEN)
+        __field(const void *, provider)
+    ),
+    TP_fast_assign(
+        strscpy(__entry->name, name, MODULE_NAME_LEN);
+        __entry->provider = provider;
+    ),
+    TP_printk("provider=%s (%p)", __entry->name, __entry->provider)
+);
+
+DEFINE_EVENT(dpusm_provider_class, dpusm_provider_register,
+    TP_PROTO(const char *name, const void *provider),
+    TP_ARGS(name, provider));
+
+DEFINE_EVENT(dpusm_provider_class, dpusm_provider_invalidate,
+    TP_PROTO(const char *name, const void *provider),
+    TP_ARGS(name, provider));
+
+/* provider is NULL if the lookup failed */
+DEFINE_EVENT(dpusm_provider_class, dpusm_provider_get,
+    TP_PROTO(const char *name, const void *provider),
+    TP_ARGS(name, provider));
+
+DEFINE_EVENT(dpusm_provider_class, dpusm_provider_put,
+    TP_PROTO(const char *name, const void *provider),
+    TP_ARGS(name, provider));
+
+TRACE_EVENT(dpusm_provider_unregister,
+    TP_PROTO(const char *name, const void *provider, long refs),
+    TP_ARGS(name, provider, refs),
+    TP_STRUCT__entry(
+        __array(char, name, MODULE_NAME_LEN)
+        __field(const void *, provider)
+        __field(long, refs)
+    ),
+    TP_fast_assign(
+        strscpy(__entry->name, name, MODULE_NAME_LEN);
+        __entry->provider = provider;
+        __entry->refs = refs;
+    ),
+    TP_printk("provider=%s (%p) refs=%ld",
+              __entry->name, __entry->provider, __entry->refs)
+);
+
+/* handle events */
+DECLARE_EVENT_CLASS(dpusm_handle_class,
+    TP_PROTO(const void *provider, const void *dpusmh, const void *handle),
+    TP_ARGS(provider, dpusmh, handle),
+    TP_STRUCT__entry(
+        __field(const void *, provider)
+        __field(const void *, dpusmh)
+        __field(const void *, handle)
+    ),
+    TP_fast_assign(
+        __entry->provider = provider;
+        __entry->dpusmh = dpusmh;
+        __entry->handle = handle;
+    ),
+    TP_printk("provider=%p dpusm_handle=%p provider_handle=%p",
+              __entry->provider, __entry->dpusmh, __entry->handle)
+);
+
+DEFINE_EVENT(dpusm_handle_class, dpusm_handle_construct,
+    TP_PROTO(const void *provider, const void *dpusmh, const void *handle),
+    TP_ARGS(provider, dpusmh, handle));
+
+DEFINE_EVENT(dpusm_handle_class, dpusm_handle_free,
+    TP_PROTO(const void *provider, const void *dpusmh, const void *handle),
+    TP_ARGS(provider, dpusmh, handle));
+
+/* staged copies written to the offloader */
+TRACE_EVENT(dpusm_stage_flush,
+    TP_PROTO(const void *dpusmh, size_t offset, size_t size),
+    TP_ARGS(dpusmh, offset, size),
+    TP_STRUCT__entry(
+        __field(const void *, dpusmh)
+        __field(size_t, offset)
+        __field(size_t, size)
+    ),
+    TP_fast_assign(
+        __entry->dpusmh = dpusmh;
+        __entry->offset = offset;
+        __entry->size = size;
+    ),
+    TP_printk("dpusm_handle=%p offset=%zu size=%zu",
+              __entry->dpusmh, __entry->offset, __entry->size)
+);
+
+#endif
+
+/* this header is found through -I$(DPUSM)/include */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH dpusm
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE trace
+#include <trace/define_trace.h>
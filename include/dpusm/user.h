@@ -0,0 +1,31 @@
+#ifndef _DATA_PROCESSING_UNIT_SERVICES_MODULE_USER_H
+#define _DATA_PROCESSING_UNIT_SERVICES_MODULE_USER_H
+
+#include <dpusm/common.h>
+
+/* called by dpusm.c when the module is loaded and unloaded */
+int dpusm_user_init(void);
+void dpusm_user_fini(void);
+
+/*
+ * called by provider.c when registering a provider that
+ * embeds its handles in DPUSM handles (private_size != 0)
+ *
+ * Returns the size class of the cache its handles come from.
+ */
+int dpusm_handle_class(size_t private_size);
+
+/* run an operation with the synchronous user functions */
+int dpusm_op_run(dpusm_op_t *op);
+
+/*
+ * copy uop into pop, replacing DPUSM handles with offloader handles
+ *
+ * All handles have to come from provider.
+ */
+int dpusm_op_unwrap(void *provider, dpusm_op_t *uop, dpusm_op_t *pop);
+
+/* called by pool.c to return cached handles to their providers */
+int dpusm_handle_free_many(size_t count, void **handles);
+
+#endif
@@ -42,6 +42,16 @@ typedef struct dpusm_user_functions {
     /* capabilities provided by the provider */
     int (*capabilities)(void *provider, dpusm_pc_t **caps);
 
+    /*
+     * properties of one algorithm in capabilities
+     *
+     * type is DPUSM_OP_COMPRESS, DPUSM_OP_DECOMPRESS, or
+     * DPUSM_OP_CHECKSUM. Returns DPUSM_NOT_SUPPORTED if alg is not
+     * a single algorithm the provider supports for type.
+     */
+    int (*algorithm_properties)(void *provider, dpusm_op_type_t type,
+        u64 alg, dpusm_ap_t *props);
+
     /* get a new handle */
     void *(*alloc)(void *provider, size_t size);
 
@@ -54,6 +64,20 @@ typedef struct dpusm_user_functions {
     /* free a handle */
     int (*free)(void *handle);
 
+    /*
+     * batched versions of alloc, alloc_ref, and free
+     *
+     * alloc_many and alloc_ref_many fill in handles[0..count) and
+     * either create all count handles or none of them (handles are
+     * set to NULL on failure). alloc_ref_many creates count references
+     * into the same src. free_many accepts handles from any providers.
+     */
+    int (*alloc_many)(void *provider, size_t count, size_t *sizes,
+        void **handles);
+    int (*alloc_ref_many)(void *src, size_t count, size_t *offsets,
+        size_t *sizes, void **handles);
+    int (*free_many)(size_t count, void **handles);
+
     /* associate a pointer with a pre-existing handle */
     int (*associate_handle)(void *handle, void *ptr);
 
@@ -74,6 +98,37 @@ typedef struct dpusm_user_functions {
                 struct scatterlist *sgl,
                 unsigned int nents,
                 size_t size);
+
+            /*
+             * always available
+             * picks generic, ptr, or scatterlist based on where buf
+             * is, size, and what the provider supports
+             */
+            int (*automatic)(dpusm_mv_t *mv, const void *buf, size_t size);
+
+            /*
+             * always available
+             * returns DPUSM_OK once the copy has started, after which
+             * copy_completion(cc_args, rc) is called exactly once, from
+             * any context, possibly before this returns - buf must
+             * remain valid until then
+             */
+            int (*async)(dpusm_mv_t *mv, const void *buf, size_t size,
+                dpusm_cc_t copy_completion, void *cc_args);
+
+            /*
+             * always available
+             * copy like automatic and write the checksum of the copied
+             * bytes to cksum
+             *
+             * The provider computes the checksum during the copy if it
+             * can. Otherwise, the DPUSM checksums buf a chunk at a time
+             * as the chunks are copied. If neither can compute alg, the
+             * data is copied and then checksummed by the provider.
+             */
+            int (*checksum)(dpusm_mv_t *mv, const void *buf, size_t size,
+                dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+                void *cksum, size_t cksum_size);
         } from;
 
         /* offloader -> memory */
@@ -92,9 +147,60 @@ typedef struct dpusm_user_functions {
                 struct scatterlist *sgl,
                 unsigned int nents,
                 size_t size);
+
+            /*
+             * always available
+             * picks generic, ptr, or scatterlist based on where buf
+             * is, size, and what the provider supports
+             */
+            int (*automatic)(dpusm_mv_t *mv, void *buf, size_t size);
+
+            /*
+             * always available
+             * returns DPUSM_OK once the copy has started, after which
+             * copy_completion(cc_args, rc) is called exactly once, from
+             * any context, possibly before this returns - buf must
+             * remain valid until then
+             */
+            int (*async)(dpusm_mv_t *mv, void *buf, size_t size,
+                dpusm_cc_t copy_completion, void *cc_args);
+
+            /* always available - see from.checksum */
+            int (*checksum)(dpusm_mv_t *mv, void *buf, size_t size,
+                dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+                void *cksum, size_t cksum_size);
         } to;
+
+        /*
+         * always available
+         * copy between two handles, which may belong to different
+         * providers - the ranges should not overlap
+         *
+         * Providers copy directly between each other when one of
+         * them can reach the other. Otherwise, the data goes through
+         * a DPUSM bounce buffer.
+         */
+        int (*peer)(dpusm_mv_t *dst, dpusm_mv_t *src, size_t size);
     } copy;
 
+    /*
+     * always available
+     *
+     * buffer copy.from.generic calls that land in [offset, offset + size)
+     * of a handle in host memory and write them to the offloader with
+     * one copy per contiguous run of written bytes
+     *
+     * Staged copies are written out by flush and end, and before any
+     * other operation uses the handle. Freeing the handle drops them.
+     * Writes through other handles to the same memory (references)
+     * are not seen by the staged range.
+     */
+    struct {
+        int (*begin)(void *handle, size_t offset, size_t size);
+        int (*flush)(void *handle);
+        int (*end)(void *handle);
+    } stage;
+
     /*
      * optional
      */
@@ -124,6 +230,74 @@ typedef struct dpusm_user_functions {
     int (*compress)(dpusm_compress_t alg, int level,
         void *src, size_t s_len, void *dst, size_t *d_len);
 
+    /*
+     * compress count independent buffers with one algorithm
+     *
+     * Entry i compresses s_lens[i] bytes of srcs[i] into dsts[i], which
+     * has d_lens[i] bytes of usable space, and sets d_lens[i] to the
+     * compressed length. All handles have to come from the same
+     * provider. If rcs is not NULL, the return value of each entry is
+     * written to rcs[i].
+     *
+     * Returns DPUSM_OK if every entry was compressed, otherwise the
+     * return value of the first one that failed.
+     */
+    int (*compress_many)(dpusm_compress_t alg, int level, size_t count,
+        void **srcs, size_t *s_lens, void **dsts, size_t *d_lens, int *rcs);
+
+    /* decompress_many is the same - levels may be NULL */
+    int (*decompress_many)(dpusm_decompress_t alg, int *levels, size_t count,
+        void **srcs, size_t *s_lens, void **dsts, size_t *d_lens, int *rcs);
+
+    /*
+     * compress, but give up with DPUSM_NOT_COMPRESSIBLE if the output
+     * would be larger than max_percent of s_len (or *d_len)
+     *
+     * Providers that cannot stop early compress the whole buffer
+     * and the length is checked afterwards.
+     */
+    int (*compress_bounded)(dpusm_compress_t alg, int level,
+        void *src, size_t s_len, void *dst, size_t *d_len,
+        unsigned int max_percent);
+
+    /*
+     * estimate the compressed size of data before compressing it, as
+     * a percentage of its size (100 if it will not compress)
+     *
+     * handle estimates size bytes at offset in a handle on the
+     * provider if it can, or from a few samples copied to the host.
+     * buf estimates a host buffer without involving a provider.
+     */
+    struct {
+        int (*handle)(void *handle, size_t offset, size_t size,
+            unsigned int *percent);
+        int (*buf)(const void *buf, size_t size, unsigned int *percent);
+    } compressibility;
+
+    /*
+     * compression dictionaries, for small blocks that compress
+     * poorly on their own
+     *
+     * load sends a dictionary to the provider once and returns a
+     * dictionary handle, or NULL if the provider does not support
+     * dictionaries or some of algs. The dictionary stays on the
+     * provider until free is called.
+     *
+     * compress and decompress are the same as the functions without
+     * dictionaries. src, dst, and dict have to come from the same
+     * provider. Data compressed with a dictionary can only be
+     * decompressed with the same dictionary.
+     */
+    struct {
+        void *(*load)(void *provider, dpusm_compress_t algs,
+            const void *buf, size_t size);
+        int (*compress)(void *dict, dpusm_compress_t alg, int level,
+            void *src, size_t s_len, void *dst, size_t *d_len);
+        int (*decompress)(void *dict, dpusm_decompress_t alg, int *level,
+            void *src, size_t s_len, void *dst, size_t *d_len);
+        int (*free)(void *dict);
+    } dict;
+
     /* pass in usable space in dst, get back decompressed length */
     int (*decompress)(dpusm_decompress_t alg, int *level,
         void *src, size_t s_len, void *dst, size_t *d_len);
@@ -133,6 +307,78 @@ typedef struct dpusm_user_functions {
         void *data, size_t size,
         void *cksum, size_t cksum_size);
 
+    /*
+     * checksum count ranges of handles with one algorithm
+     *
+     * Range i is sizes[i] bytes at offsets[i] in handles[i], and its
+     * checksum is written to cksums + i * cksum_size. All handles have
+     * to come from the same provider. If rcs is not NULL, the return
+     * value of each checksum is written to rcs[i].
+     *
+     * Returns DPUSM_OK if every checksum was computed, otherwise the
+     * return value of the first one that failed.
+     */
+    int (*checksum_many)(dpusm_checksum_t alg,
+        dpusm_checksum_byteorder_t order, size_t count,
+        void **handles, size_t *offsets, size_t *sizes,
+        void *cksums, size_t cksum_size, int *rcs);
+
+    /*
+     * check data against a known checksum without copying the
+     * checksum back
+     *
+     * expected holds cksum_size bytes laid out the way checksum would
+     * write them. Returns DPUSM_OK if the checksums match and
+     * DPUSM_CHECKSUM_MISMATCH if they do not. If the provider cannot
+     * compare checksums itself, the DPUSM computes the checksum and
+     * compares it on the host.
+     */
+    int (*checksum_verify)(dpusm_checksum_t alg,
+        dpusm_checksum_byteorder_t order,
+        void *data, size_t size,
+        const void *expected, size_t cksum_size);
+
+    /*
+     * checksum_verify for count ranges - see checksum_many
+     *
+     * The expected checksum of range i is at expected + i * cksum_size.
+     * Returns DPUSM_OK if every range matched, otherwise the return
+     * value of the first one that did not.
+     */
+    int (*checksum_verify_many)(dpusm_checksum_t alg,
+        dpusm_checksum_byteorder_t order, size_t count,
+        void **handles, size_t *offsets, size_t *sizes,
+        const void *expected, size_t cksum_size, int *rcs);
+
+    /*
+     * checksum data spread across several handles without copying
+     * it into one handle first
+     *
+     * init returns a checksum context handle, or NULL if provider
+     * does not support alg and order. update adds size bytes at
+     * offset in handle, which has to come from the same provider,
+     * to the checksum. Segments are checksummed in the order they
+     * are added, as if they were one buffer. For fletcher, every
+     * segment but the last has to be a multiple of the block size
+     * (16 bytes for fletcher-2, 4 bytes for fletcher-4).
+     *
+     * final writes the checksum to cksum and frees the context.
+     * free releases the context without a checksum.
+     *
+     * Added handles have to stay allocated and unchanged until
+     * final is called. For providers without native support, the
+     * DPUSM copies each segment to the host when it is added and
+     * checksums it there, so init returns NULL if the host cannot
+     * compute alg either.
+     */
+    struct {
+        void *(*init)(void *provider, dpusm_checksum_t alg,
+            dpusm_checksum_byteorder_t order);
+        int (*update)(void *ctx, void *handle, size_t offset, size_t size);
+        int (*final)(void *ctx, void *cksum, size_t cksum_size);
+        int (*free)(void *ctx);
+    } checksum_ctx;
+
     struct {
         int (*can_compute)(void *provider, size_t nparity, size_t ndata,
             size_t *col_sizes, int rec);
@@ -183,6 +429,51 @@ typedef struct dpusm_user_functions {
             void *fc_args);
         int (*close)(void *disk_handle);
     } disk;
+
+    /*
+     * run stages in order as one request, stopping at the first
+     * stage that fails
+     *
+     * All handles have to come from the same provider. Each stage
+     * that ran has its rc set, and results such as compressed
+     * lengths and checksums are written to the stage's output
+     * pointers. completed is set to the number of stages that
+     * succeeded. Set DPUSM_OP_SIZE_FROM_PREV in a stage's flags
+     * to feed it the output length of the previous stage, e.g.
+     * checksum and write the result of a compress.
+     *
+     * Returns DPUSM_OK or the return value of the failed stage.
+     * Providers without native chaining have their stages run
+     * one at a time by the DPUSM.
+     */
+    int (*chain)(dpusm_op_t *stages, size_t count, size_t *completed);
+
+    /*
+     * asynchronous operations
+     *
+     * queue_create returns a queue that can hold depth operations
+     * that have not been reaped yet, or NULL on error. Operations
+     * submitted to a queue should use handles from its provider.
+     *
+     * submit returns DPUSM_QUEUE_FULL if there is no space in the
+     * queue. When an operation finishes, op->rc is set and
+     * op->completion(op) is called (from any context). If
+     * op->completion is NULL, the operation is returned by poll
+     * instead.
+     *
+     * poll fills in up to max finished operations and returns how
+     * many were filled in. drain waits for all submitted operations
+     * to finish. queue_destroy drains the queue before destroying it.
+     *
+     * Providers without native support run operations on a workqueue.
+     */
+    struct {
+        void *(*queue_create)(void *provider, unsigned int depth);
+        int (*submit)(void *queue, dpusm_op_t *op);
+        int (*poll)(void *queue, dpusm_op_t **ops, int max);
+        int (*drain)(void *queue);
+        int (*queue_destroy)(void *queue);
+    } async;
 } dpusm_uf_t;
 
 /*
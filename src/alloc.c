@@ -40,6 +40,70 @@ void dpusm_mem_free(void *ptr, size_t size) {
 #endif
 }
 
+/*
+ * fixed size allocations that are created and destroyed at high rates
+ *
+ * The slab allocator keeps per-CPU freelists for each cache, so
+ * alloc/free cycles from the same CPU usually do not touch any
+ * shared state.
+ */
+struct kmem_cache *dpusm_mem_cache_create(const char *name, size_t size) {
+    return kmem_cache_create(name, size, 0, 0, NULL);
+}
+
+void dpusm_mem_cache_destroy(struct kmem_cache *cache) {
+    kmem_cache_destroy(cache);
+}
+
+void *dpusm_mem_cache_alloc(struct kmem_cache *cache) {
+    void *ptr = kmem_cache_alloc(cache, GFP_KERNEL);
+    if (ptr) {
+#if DPUSM_TRACK_ALLOCS
+        const size_t size = kmem_cache_size(cache);
+        atomic_add(1,    &alloc_count);
+        atomic_add(1,    &active_count);
+        atomic_add(size, &active_size);
+#endif
+    }
+    return ptr;
+}
+
+/* returns count on success and 0 on failure - nothing is allocated on failure */
+size_t dpusm_mem_cache_alloc_bulk(struct kmem_cache *cache, size_t count, void **ptrs) {
+    const size_t allocated = kmem_cache_alloc_bulk(cache, GFP_KERNEL, count, ptrs);
+    if (allocated) {
+#if DPUSM_TRACK_ALLOCS
+        const size_t size = kmem_cache_size(cache);
+        atomic_add(allocated,        &alloc_count);
+        atomic_add(allocated,        &active_count);
+        atomic_add(allocated * size, &active_size);
+#endif
+    }
+    return allocated;
+}
+
+void dpusm_mem_cache_free_bulk(struct kmem_cache *cache, size_t count, void **ptrs) {
+#if DPUSM_TRACK_ALLOCS
+    const size_t size = kmem_cache_size(cache);
+#endif
+    kmem_cache_free_bulk(cache, count, ptrs);
+#if DPUSM_TRACK_ALLOCS
+    atomic_sub(count,        &active_count);
+    atomic_sub(count * size, &active_size);
+#endif
+}
+
+void dpusm_mem_cache_free(struct kmem_cache *cache, void *ptr) {
+#if DPUSM_TRACK_ALLOCS
+    const size_t size = kmem_cache_size(cache);
+#endif
+    kmem_cache_free(cache, ptr);
+#if DPUSM_TRACK_ALLOCS
+    atomic_sub(1,    &active_count);
+    atomic_sub(size, &active_size);
+#endif
+}
+
 void dpusm_mem_stats(size_t *total, size_t *count, size_t *size) {
 #if DPUSM_TRACK_ALLOCS
     if (total) {
@@ -0,0 +1,319 @@
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include <dpusm/alloc.h>
+#include <dpusm/async.h>
+#include <dpusm/debug.h>
+#include <dpusm/provider.h>
+#include <dpusm/user.h>
+#include <dpusm/user_api.h>
+
+typedef struct dpusm_async_queue dpusm_async_queue_t;
+
+typedef struct dpusm_async_req {
+    dpusm_op_t pop;              /* operation with offloader handles */
+    dpusm_op_t *uop;             /* operation that was submitted */
+    dpusm_async_queue_t *queue;
+    struct work_struct work;     /* used when emulating */
+    struct list_head list;       /* free or done list */
+} dpusm_async_req_t;
+
+struct dpusm_async_queue {
+    dpusm_ph_t **provider;
+    void *pqueue;                /* provider queue, or NULL if emulating */
+    unsigned int depth;
+    dpusm_async_req_t *reqs;
+
+    spinlock_t lock;             /* completions can come from any context */
+    struct list_head free;
+    struct list_head done;       /* completed operations waiting to be polled */
+    unsigned int inflight;       /* submitted, but not completed */
+    wait_queue_head_t wait;
+};
+
+/* returns NULL if the provider has gone away */
+static const dpusm_pf_t *
+dpusm_async_funcs(dpusm_ph_t **provider) {
+    return (provider && *provider)?READ_ONCE((*provider)->funcs):NULL;
+}
+
+/* runs emulated operations */
+static struct workqueue_struct *dpusm_async_wq = NULL;
+
+int
+dpusm_async_init(void) {
+    dpusm_async_wq = alloc_workqueue("dpusm_async", WQ_UNBOUND, 0);
+    return dpusm_async_wq?0:-ENOMEM;
+}
+
+void
+dpusm_async_fini(void) {
+    destroy_workqueue(dpusm_async_wq);
+    dpusm_async_wq = NULL;
+}
+
+static void
+dpusm_async_complete(dpusm_async_req_t *req, int rc) {
+    dpusm_async_queue_t *queue = req->queue;
+    dpusm_op_t *uop = req->uop;
+    unsigned long flags;
+
+    /* the callback owns uop, so it cannot be read after the call */
+    const dpusm_op_completion_t completion = uop->completion;
+
+    uop->rc = rc;
+
+    /* run the callback before the slot can be reused or the queue drained */
+    if (completion) {
+        completion(uop);
+    }
+
+    spin_lock_irqsave(&queue->lock, flags);
+    list_add_tail(&req->list, completion?&queue->free:&queue->done);
+    queue->inflight--;
+    wake_up(&queue->wait);
+    spin_unlock_irqrestore(&queue->lock, flags);
+}
+
+/* called by the provider */
+static void
+dpusm_async_provider_completion(dpusm_op_t *pop) {
+    dpusm_async_req_t *req = (dpusm_async_req_t *) pop->private;
+    dpusm_async_complete(req, pop->rc);
+}
+
+static void
+dpusm_async_work(struct work_struct *work) {
+    dpusm_async_req_t *req = container_of(work, dpusm_async_req_t, work);
+    dpusm_async_complete(req, dpusm_op_run(req->uop));
+}
+
+/* copies in emulated queues use copy.*.async */
+static void
+dpusm_async_copy_done(void *ptr, int error) {
+    dpusm_async_complete((dpusm_async_req_t *) ptr, error);
+}
+
+typedef struct dpusm_async_copy {
+    dpusm_op_t op;
+    dpusm_cc_t copy_completion;
+    void *cc_args;
+    struct work_struct work;
+} dpusm_async_copy_t;
+
+static void
+dpusm_async_copy_work(struct work_struct *work) {
+    dpusm_async_copy_t *copy = container_of(work, dpusm_async_copy_t, work);
+    const int rc = dpusm_op_run(&copy->op);
+    const dpusm_cc_t copy_completion = copy->copy_completion;
+    void *cc_args = copy->cc_args;
+
+    dpusm_mem_free(copy, sizeof(*copy));
+    copy_completion(cc_args, rc);
+}
+
+int
+dpusm_async_copy_emulate(dpusm_mv_t *mv, void *buf, size_t size, bool to,
+    dpusm_cc_t copy_completion, void *cc_args) {
+    dpusm_async_copy_t *copy = dpusm_mem_alloc(sizeof(dpusm_async_copy_t));
+    if (!copy) {
+        return DPUSM_ERROR;
+    }
+
+    if (to) {
+        copy->op.type = DPUSM_OP_COPY_TO;
+        copy->op.copy_to.mv = *mv;
+        copy->op.copy_to.buf = buf;
+        copy->op.copy_to.size = size;
+    }
+    else {
+        copy->op.type = DPUSM_OP_COPY_FROM;
+        copy->op.copy_from.mv = *mv;
+        copy->op.copy_from.buf = buf;
+        copy->op.copy_from.size = size;
+    }
+
+    copy->copy_completion = copy_completion;
+    copy->cc_args = cc_args;
+    INIT_WORK(&copy->work, dpusm_async_copy_work);
+    queue_work(dpusm_async_wq, &copy->work);
+
+    return DPUSM_OK;
+}
+
+void *
+dpusm_async_queue_create(void *provider, unsigned int depth) {
+    dpusm_ph_t **dpusmph = (dpusm_ph_t **) provider;
+    const dpusm_pf_t *funcs = dpusm_async_funcs(dpusmph);
+    if (!funcs || !depth) {
+        return NULL;
+    }
+
+    dpusm_async_queue_t *queue = dpusm_mem_alloc(sizeof(dpusm_async_queue_t));
+    if (!queue) {
+        return NULL;
+    }
+
+    queue->reqs = dpusm_mem_alloc(depth * sizeof(dpusm_async_req_t));
+    if (!queue->reqs) {
+        dpusm_mem_free(queue, sizeof(*queue));
+        return NULL;
+    }
+
+    queue->provider = dpusmph;
+    queue->pqueue = NULL;
+    queue->depth = depth;
+    spin_lock_init(&queue->lock);
+    INIT_LIST_HEAD(&queue->free);
+    INIT_LIST_HEAD(&queue->done);
+    queue->inflight = 0;
+    init_waitqueue_head(&queue->wait);
+
+    for(unsigned int i = 0; i < depth; i++) {
+        dpusm_async_req_t *req = &queue->reqs[i];
+        req->queue = queue;
+        INIT_WORK(&req->work, dpusm_async_work);
+        list_add_tail(&req->list, &queue->free);
+    }
+
+    /* use the provider's queues if it has them */
+    if (funcs->async.create) {
+        queue->pqueue = funcs->async.create(depth);
+        if (!queue->pqueue) {
+            dpusm_mem_free(queue->reqs, depth * sizeof(dpusm_async_req_t));
+            dpusm_mem_free(queue, sizeof(*queue));
+            return NULL;
+        }
+    }
+
+    return queue;
+}
+
+int
+dpusm_async_submit(void *queue, dpusm_op_t *op) {
+    dpusm_async_queue_t *q = (dpusm_async_queue_t *) queue;
+    if (!q || !op) {
+        return DPUSM_ERROR;
+    }
+
+    const dpusm_pf_t *funcs = dpusm_async_funcs(q->provider);
+    if (!funcs) {
+        return DPUSM_PROVIDER_INVALIDATED;
+    }
+
+    unsigned long flags;
+    spin_lock_irqsave(&q->lock, flags);
+    dpusm_async_req_t *req = list_first_entry_or_null(&q->free, dpusm_async_req_t, list);
+    if (!req) {
+        spin_unlock_irqrestore(&q->lock, flags);
+        return DPUSM_QUEUE_FULL;
+    }
+    list_del(&req->list);
+    q->inflight++;
+    spin_unlock_irqrestore(&q->lock, flags);
+
+    req->uop = op;
+
+    const dpusm_uf_t *uf = dpusm_initialize();
+    int rc = DPUSM_OK;
+    if (q->pqueue) {
+        rc = dpusm_op_unwrap(q->provider, op, &req->pop);
+        if (rc == DPUSM_OK) {
+            req->pop.rc = DPUSM_OK;
+            req->pop.completion = dpusm_async_provider_completion;
+            req->pop.private = req;
+            rc = funcs->async.submit(q->pqueue, &req->pop);
+        }
+    }
+    else if (op->type == DPUSM_OP_COPY_FROM) {
+        rc = uf->copy.from.async(&op->copy_from.mv, op->copy_from.buf,
+            op->copy_from.size, dpusm_async_copy_done, req);
+    }
+    else if (op->type == DPUSM_OP_COPY_TO) {
+        rc = uf->copy.to.async(&op->copy_to.mv, op->copy_to.buf,
+            op->copy_to.size, dpusm_async_copy_done, req);
+    }
+    else {
+        queue_work(dpusm_async_wq, &req->work);
+    }
+
+    /* the operation was not accepted - give the slot back */
+    if (rc != DPUSM_OK) {
+        spin_lock_irqsave(&q->lock, flags);
+        list_add(&req->list, &q->free);
+        q->inflight--;
+        wake_up(&q->wait);
+        spin_unlock_irqrestore(&q->lock, flags);
+    }
+
+    return rc;
+}
+
+int
+dpusm_async_poll(void *queue, dpusm_op_t **ops, int max) {
+    dpusm_async_queue_t *q = (dpusm_async_queue_t *) queue;
+    if (!q || !ops || (max < 0)) {
+        return DPUSM_ERROR;
+    }
+
+    int count = 0;
+    unsigned long flags;
+    spin_lock_irqsave(&q->lock, flags);
+    while (count < max) {
+        dpusm_async_req_t *req = list_first_entry_or_null(&q->done, dpusm_async_req_t, list);
+        if (!req) {
+            break;
+        }
+
+        ops[count++] = req->uop;
+        list_move(&req->list, &q->free);
+    }
+    spin_unlock_irqrestore(&q->lock, flags);
+
+    return count;
+}
+
+static bool
+dpusm_async_idle(dpusm_async_queue_t *q) {
+    unsigned long flags;
+    spin_lock_irqsave(&q->lock, flags);
+    const bool idle = !q->inflight;
+    spin_unlock_irqrestore(&q->lock, flags);
+    return idle;
+}
+
+int
+dpusm_async_drain(void *queue) {
+    dpusm_async_queue_t *q = (dpusm_async_queue_t *) queue;
+    if (!q) {
+        return DPUSM_ERROR;
+    }
+
+    wait_event(q->wait, dpusm_async_idle(q));
+    return DPUSM_OK;
+}
+
+/* operations that completed but were not polled are dropped */
+int
+dpusm_async_queue_destroy(void *queue) {
+    dpusm_async_queue_t *q = (dpusm_async_queue_t *) queue;
+    if (!q) {
+        return DPUSM_ERROR;
+    }
+
+    dpusm_async_drain(q);
+
+    if (q->pqueue) {
+        const dpusm_pf_t *funcs = dpusm_async_funcs(q->provider);
+        if (funcs) {
+            funcs->async.destroy(q->pqueue);
+        }
+    }
+
+    dpusm_mem_free(q->reqs, q->depth * sizeof(dpusm_async_req_t));
+    dpusm_mem_free(q, sizeof(*q));
+    return DPUSM_OK;
+}
@@ -0,0 +1,194 @@
+#include <crypto/hash.h>
+#include <linux/err.h>
+#include <linux/limits.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/swab.h>
+
+#include <dpusm/checksum.h>
+
+/* fletcher checksums are written out like ZFS's zio_cksum_t */
+#define FLETCHER_CKSUM_SIZE (4 * sizeof(u64))
+
+typedef struct dpusm_host_sha {
+    dpusm_checksum_t alg;
+    const char *name;
+    struct crypto_shash *tfm;  /* NULL if the kernel does not have it */
+} dpusm_host_sha_t;
+
+static dpusm_host_sha_t dpusm_host_shas[] = {
+    { DPUSM_CHECKSUM_SHA224, "sha224" },
+    { DPUSM_CHECKSUM_SHA256, "sha256" },
+    { DPUSM_CHECKSUM_SHA384, "sha384" },
+    { DPUSM_CHECKSUM_SHA512, "sha512" },
+};
+
+#define DPUSM_HOST_SHAS (sizeof(dpusm_host_shas) / sizeof(dpusm_host_shas[0]))
+
+void
+dpusm_host_cksum_load(void) {
+    for(size_t i = 0; i < DPUSM_HOST_SHAS; i++) {
+        struct crypto_shash *tfm = crypto_alloc_shash(dpusm_host_shas[i].name, 0, 0);
+        dpusm_host_shas[i].tfm = IS_ERR(tfm)?NULL:tfm;
+    }
+}
+
+void
+dpusm_host_cksum_unload(void) {
+    for(size_t i = 0; i < DPUSM_HOST_SHAS; i++) {
+        if (dpusm_host_shas[i].tfm) {
+            crypto_free_shash(dpusm_host_shas[i].tfm);
+            dpusm_host_shas[i].tfm = NULL;
+        }
+    }
+}
+
+u64
+dpusm_host_cksum_algorithms(void) {
+    u64 algs = DPUSM_CHECKSUM_FLETCHER_2 | DPUSM_CHECKSUM_FLETCHER_4;
+    for(size_t i = 0; i < DPUSM_HOST_SHAS; i++) {
+        if (dpusm_host_shas[i].tfm) {
+            algs |= dpusm_host_shas[i].alg;
+        }
+    }
+
+    return algs;
+}
+
+int
+dpusm_host_cksum_init(dpusm_host_cksum_t *hc, dpusm_checksum_t alg,
+    dpusm_checksum_byteorder_t order) {
+    memset(hc, 0, sizeof(*hc));
+    hc->alg = alg;
+    hc->byteswap = (order == DPUSM_BYTEORDER_BYTESWAP);
+
+    if ((alg == DPUSM_CHECKSUM_FLETCHER_2) || (alg == DPUSM_CHECKSUM_FLETCHER_4)) {
+        return DPUSM_OK;
+    }
+
+    for(size_t i = 0; i < DPUSM_HOST_SHAS; i++) {
+        struct crypto_shash *tfm = dpusm_host_shas[i].tfm;
+        if ((dpusm_host_shas[i].alg != alg) || !tfm) {
+            continue;
+        }
+
+        hc->desc = kmalloc(sizeof(struct shash_desc) + crypto_shash_descsize(tfm),
+            GFP_KERNEL);
+        if (!hc->desc) {
+            return DPUSM_ERROR;
+        }
+
+        hc->desc->tfm = tfm;
+        if (crypto_shash_init(hc->desc)) {
+            dpusm_host_cksum_fini(hc);
+            return DPUSM_ERROR;
+        }
+
+        return DPUSM_OK;
+    }
+
+    return DPUSM_NOT_SUPPORTED;
+}
+
+static void
+dpusm_fletcher_2(dpusm_host_cksum_t *hc, const u64 *ip, size_t size) {
+    const u64 *end = ip + (size / sizeof(u64));
+    u64 a0 = hc->fletcher[0], a1 = hc->fletcher[1];
+    u64 b0 = hc->fletcher[2], b1 = hc->fletcher[3];
+
+    for(; ip < end; ip += 2) {
+        a0 += hc->byteswap?swab64(ip[0]):ip[0];
+        a1 += hc->byteswap?swab64(ip[1]):ip[1];
+        b0 += a0;
+        b1 += a1;
+    }
+
+    hc->fletcher[0] = a0;
+    hc->fletcher[1] = a1;
+    hc->fletcher[2] = b0;
+    hc->fletcher[3] = b1;
+}
+
+static void
+dpusm_fletcher_4(dpusm_host_cksum_t *hc, const u32 *ip, size_t size) {
+    const u32 *end = ip + (size / sizeof(u32));
+    u64 a = hc->fletcher[0], b = hc->fletcher[1];
+    u64 c = hc->fletcher[2], d = hc->fletcher[3];
+
+    for(; ip < end; ip++) {
+        a += hc->byteswap?swab32(ip[0]):ip[0];
+        b += a;
+        c += b;
+        d += c;
+    }
+
+    hc->fletcher[0] = a;
+    hc->fletcher[1] = b;
+    hc->fletcher[2] = c;
+    hc->fletcher[3] = d;
+}
+
+int
+dpusm_host_cksum_update(dpusm_host_cksum_t *hc, const void *buf, size_t size) {
+    switch (hc->alg) {
+        case DPUSM_CHECKSUM_FLETCHER_2:
+            if (size % (2 * sizeof(u64))) {
+                return DPUSM_ERROR;
+            }
+            dpusm_fletcher_2(hc, buf, size);
+            return DPUSM_OK;
+        case DPUSM_CHECKSUM_FLETCHER_4:
+            if (size % sizeof(u32)) {
+                return DPUSM_ERROR;
+            }
+            dpusm_fletcher_4(hc, buf, size);
+            return DPUSM_OK;
+        default:
+            break;
+    }
+
+    if (!hc->desc || (size > UINT_MAX)) {
+        return DPUSM_ERROR;
+    }
+
+    return crypto_shash_update(hc->desc, buf, size)?DPUSM_BAD_RESULT:DPUSM_OK;
+}
+
+/* SHA-2 digests are written as bytes and zero padded */
+int
+dpusm_host_cksum_final(dpusm_host_cksum_t *hc, void *cksum, size_t cksum_size) {
+    if (!cksum) {
+        return DPUSM_ERROR;
+    }
+
+    if (!hc->desc) {
+        if (cksum_size < FLETCHER_CKSUM_SIZE) {
+            return DPUSM_ERROR;
+        }
+        memcpy(cksum, hc->fletcher, FLETCHER_CKSUM_SIZE);
+        return DPUSM_OK;
+    }
+
+    const unsigned int digest_size = crypto_shash_digestsize(hc->desc->tfm);
+    if (cksum_size < digest_size) {
+        return DPUSM_ERROR;
+    }
+
+    const int err = crypto_shash_final(hc->desc, cksum);
+    memset(((u8 *) cksum) + digest_size, 0, cksum_size - digest_size);
+    return err?DPUSM_BAD_RESULT:DPUSM_OK;
+}
+
+void
+dpusm_host_cksum_fini(dpusm_host_cksum_t *hc) {
+    kfree_sensitive(hc->desc);
+    hc->desc = NULL;
+}
+
+/* provider facing functions */
+EXPORT_SYMBOL(dpusm_host_cksum_algorithms);
+EXPORT_SYMBOL(dpusm_host_cksum_init);
+EXPORT_SYMBOL(dpusm_host_cksum_update);
+EXPORT_SYMBOL(dpusm_host_cksum_final);
+EXPORT_SYMBOL(dpusm_host_cksum_fini);
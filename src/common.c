@@ -1,3 +1,4 @@
+#include <linux/bitops.h>
 #include <linux/module.h>
 
 #include <dpusm/common.h>
@@ -11,6 +12,23 @@ const char *DPUSM_OPTIONAL_STR[] = {
     "mem_stats",
     "zero_fill",
     "all_zeros",
+    "embedded_handle",
+    "async",
+    "chain",
+    "checksum_many",
+    "copy_from_async",
+    "copy_to_async",
+    "copy_peer",
+    "checksum_ctx",
+    "copy_from_checksum",
+    "copy_to_checksum",
+    "checksum_verify",
+    "checksum_verify_many",
+    "compress_bounded",
+    "compressibility",
+    "dict",
+    "compress_many",
+    "decompress_many",
 };
 
 const char *DPUSM_COMPRESS_STR[] = {
@@ -113,19 +131,14 @@ const char *DPUSM_IO_STR[] = {
 };
 
 /* expects only one bit will be set, so only returns first set bit */
-int enum2index(int mask) {
+int enum2index(u64 mask) {
 	if (mask == 0) return -1;
 
-    int index = 0;
-    while (!(mask & 1)) {
-        mask >>= 1;
-        index++;
-    }
-    return index;
+    return __ffs64(mask);
 }
 
 EXPORT_SYMBOL(enum2index);
 
-const char *enum2str(const char **strs, int mask) {
+const char *enum2str(const char **strs, u64 mask) {
     return strs[enum2index(mask)];
 }
@@ -1,15 +1,62 @@
 /* SPDX-License-Identifier: (GPL-2.0 WITH interfaces-note) OR BSD-3-Clause */
 
+#include <linux/debugfs.h>
 #include <linux/init.h>
+#include <linux/jump_label.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/kernel.h>
 
 #include <dpusm/alloc.h>
+#include <dpusm/async.h>
+#include <dpusm/debug.h>
+#include <dpusm/pool.h>
 #include <dpusm/provider.h>
+#include <dpusm/user.h>
+
+#define CREATE_TRACE_POINTS
+#include <dpusm/trace.h>
 
 /* global list of providers */
 static dpusm_t dpusm;
 
+/* /sys/kernel/debug/dpusm */
+static struct dentry *dpusm_debugfs = NULL;
+
+/* verbose messages - see debug.h */
+DEFINE_STATIC_KEY_FALSE(dpusm_debug_key);
+
+static int
+dpusm_debug_set(const char *val, const struct kernel_param *kp) {
+    bool enable = false;
+    const int rc = kstrtobool(val, &enable);
+    if (rc) {
+        return rc;
+    }
+
+    if (enable) {
+        static_branch_enable(&dpusm_debug_key);
+    }
+    else {
+        static_branch_disable(&dpusm_debug_key);
+    }
+
+    return 0;
+}
+
+static int
+dpusm_debug_get(char *buffer, const struct kernel_param *kp) {
+    return sprintf(buffer, "%d\n", dpusm_debug_enabled()?1:0);
+}
+
+static const struct kernel_param_ops dpusm_debug_ops = {
+    .set = dpusm_debug_set,
+    .get = dpusm_debug_get,
+};
+
+module_param_cb(debug, &dpusm_debug_ops, NULL, 0644);
+MODULE_PARM_DESC(debug, "Print verbose messages on hot paths (0/1)");
+
 int
 dpusm_register_bsd(struct module *module, const dpusm_pf_t *funcs) {
     return dpusm_provider_register(&dpusm, module, funcs);
@@ -65,12 +112,43 @@ dpusm_put(void *handle) {
 static int __init
 dpusm_init(void) {
     INIT_LIST_HEAD(&dpusm.providers);
+    hash_init(dpusm.index);
     dpusm.count = 0;
     mutex_init(&dpusm.lock);
 
-    atomic_set(&dpusm.active, 0);
+    dpusm.active = alloc_percpu(long);
+    if (!dpusm.active) {
+        return -ENOMEM;
+    }
+
     dpusm_mem_init();
 
+    int rc = dpusm_user_init();
+    if (rc) {
+        free_percpu(dpusm.active);
+        return rc;
+    }
+
+    dpusm_debugfs = debugfs_create_dir("dpusm", NULL);
+    dpusm.debugfs = dpusm_debugfs;
+
+    rc = dpusm_pool_init(dpusm_debugfs);
+    if (rc) {
+        debugfs_remove_recursive(dpusm_debugfs);
+        dpusm_user_fini();
+        free_percpu(dpusm.active);
+        return rc;
+    }
+
+    rc = dpusm_async_init();
+    if (rc) {
+        dpusm_pool_fini();
+        debugfs_remove_recursive(dpusm_debugfs);
+        dpusm_user_fini();
+        free_percpu(dpusm.active);
+        return rc;
+    }
+
     printk("DPUSM init\n");
     return 0;
 }
@@ -79,9 +157,9 @@ static void __exit
 dpusm_exit(void) {
     while (mutex_lock_interruptible(&dpusm.lock));
 
-    const int active = atomic_read(&dpusm.active);
+    const long active = dpusm_provider_active(&dpusm);
     if (unlikely(active)) {
-        printk("Exiting with %d active references to providers\n", active);
+        printk("Exiting with %ld active references to providers\n", active);
     }
 
     if (unlikely(dpusm.count)) {
@@ -102,6 +180,13 @@ dpusm_exit(void) {
 
     mutex_unlock(&dpusm.lock);
 
+    free_percpu(dpusm.active);
+
+    dpusm_async_fini();
+    dpusm_pool_fini();
+    debugfs_remove_recursive(dpusm_debugfs);
+    dpusm_user_fini();
+
 #if DPUSM_TRACK_ALLOCS
     size_t alloc_count = 0;
     size_t active_count = 0;
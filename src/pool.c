@@ -0,0 +1,373 @@
+#include <linux/debugfs.h>
+#include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/shrinker.h>
+#include <linux/spinlock.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+
+#include <dpusm/alloc.h>
+#include <dpusm/pool.h>
+#include <dpusm/user.h>
+
+static unsigned int pool_high = 0;
+module_param(pool_high, uint, 0644);
+MODULE_PARM_DESC(pool_high, "Handles cached per CPU per size class before draining to pool_low (0 disables pools for newly registered providers)");
+
+static unsigned int pool_low = 0;
+module_param(pool_low, uint, 0644);
+MODULE_PARM_DESC(pool_low, "Handles left per CPU per size class after draining");
+
+typedef struct dpusm_pool_class {
+    unsigned int count;
+    void *handles[DPUSM_POOL_DEPTH_MAX];
+} dpusm_pool_class_t;
+
+typedef struct dpusm_pool_cpu {
+    spinlock_t lock; /* uncontended except when shrinking */
+    dpusm_pool_class_t classes[DPUSM_POOL_CLASSES];
+    u64 hits;        /* dpusm_pool_get returned a handle */
+    u64 misses;      /* dpusm_pool_get returned NULL */
+    u64 released;    /* handles returned to the provider */
+} dpusm_pool_cpu_t;
+
+struct dpusm_pool {
+    const char *name;
+    dpusm_pool_cpu_t __percpu *cpus;
+    struct list_head list;
+};
+
+/* all pools, for the shrinker and debugfs */
+static LIST_HEAD(pools);
+static DEFINE_MUTEX(pools_lock);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+static struct shrinker *pool_shrinker = NULL;
+#else
+static struct shrinker pool_shrinker_s;
+#endif
+
+static struct dentry *pool_debugfs = NULL;
+
+static void
+dpusm_pool_watermarks(unsigned int *high, unsigned int *low) {
+    *high = min_t(unsigned int, READ_ONCE(pool_high), DPUSM_POOL_DEPTH_MAX);
+    *low = min_t(unsigned int, READ_ONCE(pool_low), *high?(*high - 1):0);
+}
+
+/*
+ * move up to max handles out of a CPU's pool into out
+ * returns the number of handles moved
+ */
+static size_t
+dpusm_pool_cpu_drain(dpusm_pool_cpu_t *pc, void **out, size_t max) {
+    size_t moved = 0;
+    spin_lock(&pc->lock);
+    for(size_t c = 0; (c < DPUSM_POOL_CLASSES) && (moved < max); c++) {
+        dpusm_pool_class_t *class = &pc->classes[c];
+        while (class->count && (moved < max)) {
+            out[moved++] = class->handles[--class->count];
+        }
+    }
+    pc->released += moved;
+    spin_unlock(&pc->lock);
+    return moved;
+}
+
+/* returns the number of handles released, up to max */
+static unsigned long
+dpusm_pool_drain(dpusm_pool_t *pool, unsigned long max) {
+    void *batch[DPUSM_POOL_DEPTH_MAX];
+    unsigned long released = 0;
+    int cpu;
+    for_each_possible_cpu(cpu) {
+        dpusm_pool_cpu_t *pc = per_cpu_ptr(pool->cpus, cpu);
+        while (released < max) {
+            const size_t moved = dpusm_pool_cpu_drain(pc, batch,
+                min_t(unsigned long, DPUSM_POOL_DEPTH_MAX, max - released));
+            if (!moved) {
+                break;
+            }
+
+            dpusm_handle_free_many(moved, batch);
+            released += moved;
+        }
+    }
+    return released;
+}
+
+static unsigned long
+dpusm_pool_count(dpusm_pool_t *pool) {
+    unsigned long count = 0;
+    int cpu;
+    for_each_possible_cpu(cpu) {
+        dpusm_pool_cpu_t *pc = per_cpu_ptr(pool->cpus, cpu);
+        for(size_t c = 0; c < DPUSM_POOL_CLASSES; c++) {
+            count += READ_ONCE(pc->classes[c].count);
+        }
+    }
+    return count;
+}
+
+/*
+ * Providers can block in free_many, and freeing handles allocates,
+ * so the shrinker only asks for handles to be released. They are
+ * released on a workqueue, outside of reclaim.
+ */
+static atomic_long_t pool_reclaim = ATOMIC_LONG_INIT(0);
+
+static void
+dpusm_pool_reclaim(struct work_struct *work) {
+    mutex_lock(&pools_lock);
+    unsigned long target = atomic_long_xchg(&pool_reclaim, 0);
+    dpusm_pool_t *pool = NULL;
+    list_for_each_entry(pool, &pools, list) {
+        if (!target) {
+            break;
+        }
+        target -= dpusm_pool_drain(pool, target);
+    }
+    mutex_unlock(&pools_lock);
+}
+
+static DECLARE_WORK(pool_reclaim_work, dpusm_pool_reclaim);
+
+static unsigned long
+dpusm_pool_shrink_count(struct shrinker *shrinker, struct shrink_control *sc) {
+    /* don't wait on the registry while reclaiming */
+    if (!mutex_trylock(&pools_lock)) {
+        return 0;
+    }
+
+    unsigned long count = 0;
+    dpusm_pool_t *pool = NULL;
+    list_for_each_entry(pool, &pools, list) {
+        count += dpusm_pool_count(pool);
+    }
+    mutex_unlock(&pools_lock);
+    return count?count:SHRINK_EMPTY;
+}
+
+static unsigned long
+dpusm_pool_shrink_scan(struct shrinker *shrinker, struct shrink_control *sc) {
+    /* don't wait on the registry while reclaiming */
+    if (!mutex_trylock(&pools_lock)) {
+        return SHRINK_STOP;
+    }
+
+    unsigned long count = 0;
+    dpusm_pool_t *pool = NULL;
+    list_for_each_entry(pool, &pools, list) {
+        count += dpusm_pool_count(pool);
+    }
+    mutex_unlock(&pools_lock);
+
+    const unsigned long released = min(count, sc->nr_to_scan);
+    if (!released) {
+        return SHRINK_STOP;
+    }
+
+    atomic_long_add(released, &pool_reclaim);
+    schedule_work(&pool_reclaim_work);
+    return released;
+}
+
+static int
+dpusm_pool_stats_show(struct seq_file *m, void *v) {
+    seq_printf(m, "%-32s %5s %12s %12s %12s %8s\n",
+               "provider", "class", "hits", "misses", "released", "cached");
+
+    mutex_lock(&pools_lock);
+    dpusm_pool_t *pool = NULL;
+    list_for_each_entry(pool, &pools, list) {
+        u64 hits = 0;
+        u64 misses = 0;
+        u64 released = 0;
+        unsigned long cached[DPUSM_POOL_CLASSES] = {0};
+
+        int cpu;
+        for_each_possible_cpu(cpu) {
+            dpusm_pool_cpu_t *pc = per_cpu_ptr(pool->cpus, cpu);
+            spin_lock(&pc->lock);
+            hits += pc->hits;
+            misses += pc->misses;
+            released += pc->released;
+            for(size_t c = 0; c < DPUSM_POOL_CLASSES; c++) {
+                cached[c] += pc->classes[c].count;
+            }
+            spin_unlock(&pc->lock);
+        }
+
+        seq_printf(m, "%-32s %5s %12llu %12llu %12llu %8s\n",
+                   pool->name, "all", hits, misses, released, "");
+        for(size_t c = 0; c < DPUSM_POOL_CLASSES; c++) {
+            seq_printf(m, "%-32s %4luK %12s %12s %12s %8lu\n",
+                       pool->name, (1UL << (DPUSM_POOL_MIN_SHIFT + c)) >> 10,
+                       "", "", "", cached[c]);
+        }
+    }
+    mutex_unlock(&pools_lock);
+    return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(dpusm_pool_stats);
+
+int
+dpusm_pool_init(struct dentry *debugfs) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+    pool_shrinker = shrinker_alloc(0, "dpusm-pool");
+    if (!pool_shrinker) {
+        return -ENOMEM;
+    }
+    pool_shrinker->count_objects = dpusm_pool_shrink_count;
+    pool_shrinker->scan_objects = dpusm_pool_shrink_scan;
+    shrinker_register(pool_shrinker);
+#else
+    pool_shrinker_s.count_objects = dpusm_pool_shrink_count;
+    pool_shrinker_s.scan_objects = dpusm_pool_shrink_scan;
+    pool_shrinker_s.seeks = DEFAULT_SEEKS;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 0, 0)
+    const int rc = register_shrinker(&pool_shrinker_s, "dpusm-pool");
+#else
+    const int rc = register_shrinker(&pool_shrinker_s);
+#endif
+    if (rc) {
+        return rc;
+    }
+#endif
+
+    pool_debugfs = debugfs_create_file("pool", 0444, debugfs, NULL,
+                                       &dpusm_pool_stats_fops);
+    return 0;
+}
+
+void
+dpusm_pool_fini(void) {
+    debugfs_remove(pool_debugfs);
+    pool_debugfs = NULL;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+    shrinker_free(pool_shrinker);
+    pool_shrinker = NULL;
+#else
+    unregister_shrinker(&pool_shrinker_s);
+#endif
+
+    cancel_work_sync(&pool_reclaim_work);
+}
+
+dpusm_pool_t *
+dpusm_pool_create(const char *name) {
+    if (!READ_ONCE(pool_high)) {
+        return NULL;
+    }
+
+    dpusm_pool_t *pool = dpusm_mem_alloc(sizeof(dpusm_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->name = name;
+    pool->cpus = alloc_percpu(dpusm_pool_cpu_t);
+    if (!pool->cpus) {
+        dpusm_mem_free(pool, sizeof(*pool));
+        return NULL;
+    }
+
+    int cpu;
+    for_each_possible_cpu(cpu) {
+        spin_lock_init(&per_cpu_ptr(pool->cpus, cpu)->lock);
+    }
+
+    mutex_lock(&pools_lock);
+    list_add(&pool->list, &pools);
+    mutex_unlock(&pools_lock);
+
+    return pool;
+}
+
+void
+dpusm_pool_destroy(dpusm_pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+
+    mutex_lock(&pools_lock);
+    list_del(&pool->list);
+    mutex_unlock(&pools_lock);
+
+    dpusm_pool_drain(pool, ULONG_MAX);
+
+    free_percpu(pool->cpus);
+    dpusm_mem_free(pool, sizeof(*pool));
+}
+
+int
+dpusm_pool_class(size_t size) {
+    if ((size < (1UL << DPUSM_POOL_MIN_SHIFT)) ||
+        (size > (1UL << DPUSM_POOL_MAX_SHIFT)) ||
+        !is_power_of_2(size)) {
+        return -1;
+    }
+
+    return ilog2(size) - DPUSM_POOL_MIN_SHIFT;
+}
+
+void *
+dpusm_pool_get(dpusm_pool_t *pool, int class) {
+    void *handle = NULL;
+    dpusm_pool_cpu_t *pc = raw_cpu_ptr(pool->cpus);
+
+    spin_lock(&pc->lock);
+    dpusm_pool_class_t *pcc = &pc->classes[class];
+    if (pcc->count) {
+        handle = pcc->handles[--pcc->count];
+        pc->hits++;
+    }
+    else {
+        pc->misses++;
+    }
+    spin_unlock(&pc->lock);
+
+    return handle;
+}
+
+int
+dpusm_pool_put(dpusm_pool_t *pool, int class, void *handle) {
+    unsigned int high = 0;
+    unsigned int low = 0;
+    dpusm_pool_watermarks(&high, &low);
+    if (!high) {
+        return 0;
+    }
+
+    void *batch[DPUSM_POOL_DEPTH_MAX];
+    size_t drained = 0;
+    dpusm_pool_cpu_t *pc = raw_cpu_ptr(pool->cpus);
+
+    spin_lock(&pc->lock);
+    dpusm_pool_class_t *pcc = &pc->classes[class];
+
+    /* reached the high watermark - drain down to the low watermark */
+    if (pcc->count >= high) {
+        while (pcc->count > low) {
+            batch[drained++] = pcc->handles[--pcc->count];
+        }
+    }
+
+    pcc->handles[pcc->count++] = handle;
+    pc->released += drained;
+    spin_unlock(&pc->lock);
+
+    /* return handles to the provider without holding the lock */
+    if (drained) {
+        dpusm_handle_free_many(drained, batch);
+    }
+
+    return 1;
+}
@@ -0,0 +1,81 @@
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/string.h>
+
+#include <dpusm/alloc.h>
+#include <dpusm/probe.h>
+
+/*
+ * log2(x) with 2 fractional bits, which is enough to tell
+ * incompressible data apart from everything else
+ */
+static unsigned int
+dpusm_probe_log2(u64 x) {
+    return ilog2(x * x * x * x);
+}
+
+size_t
+dpusm_probe_sample_offset(size_t size, size_t i) {
+    if (size <= DPUSM_PROBE_SAMPLE_SIZE * DPUSM_PROBE_SAMPLES) {
+        return i * DPUSM_PROBE_SAMPLE_SIZE;
+    }
+
+    /* spread the samples from the start of the buffer to the end */
+    return div64_u64((u64) (size - DPUSM_PROBE_SAMPLE_SIZE) * i,
+                     DPUSM_PROBE_SAMPLES - 1);
+}
+
+/* Shannon entropy of the byte distribution as a percentage of 8 bits per byte */
+int
+dpusm_probe_samples(const void *buf, size_t size, unsigned int *percent) {
+    if (!buf || !percent || !size ||
+        (size > DPUSM_PROBE_SAMPLE_SIZE * DPUSM_PROBE_SAMPLES)) {
+        return DPUSM_ERROR;
+    }
+
+    u32 counts[256];
+    memset(counts, 0, sizeof(counts));
+    for(size_t i = 0; i < size; i++) {
+        counts[((const u8 *) buf)[i]]++;
+    }
+
+    const unsigned int log_size = dpusm_probe_log2(size);
+    u64 bits = 0;
+    for(size_t i = 0; i < 256; i++) {
+        if (counts[i]) {
+            bits += (u64) counts[i] * (log_size - dpusm_probe_log2(counts[i]));
+        }
+    }
+
+    /* bits has 2 fractional bits, and there are 8 bits per byte */
+    *percent = min_t(u64, div64_u64(bits * 100, (u64) size * 8 * 4), 100);
+    return DPUSM_OK;
+}
+
+int
+dpusm_probe(const void *buf, size_t size, unsigned int *percent) {
+    if (!buf || !size) {
+        return DPUSM_ERROR;
+    }
+
+    if (size <= DPUSM_PROBE_SAMPLE_SIZE * DPUSM_PROBE_SAMPLES) {
+        return dpusm_probe_samples(buf, size, percent);
+    }
+
+    u8 *samples = dpusm_mem_alloc(DPUSM_PROBE_SAMPLE_SIZE * DPUSM_PROBE_SAMPLES);
+    if (!samples) {
+        return DPUSM_ERROR;
+    }
+
+    for(size_t i = 0; i < DPUSM_PROBE_SAMPLES; i++) {
+        memcpy(samples + i * DPUSM_PROBE_SAMPLE_SIZE,
+               ((const u8 *) buf) + dpusm_probe_sample_offset(size, i),
+               DPUSM_PROBE_SAMPLE_SIZE);
+    }
+
+    const int rc = dpusm_probe_samples(samples,
+        DPUSM_PROBE_SAMPLE_SIZE * DPUSM_PROBE_SAMPLES, percent);
+    dpusm_mem_free(samples, DPUSM_PROBE_SAMPLE_SIZE * DPUSM_PROBE_SAMPLES);
+    return rc;
+}
@@ -1,5 +1,10 @@
 #include <dpusm/alloc.h>
+#include <dpusm/debug.h>
 #include <dpusm/provider.h>
+#include <dpusm/trace.h>
+#include <dpusm/user.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 /* masks for bad function groups */
 static const int DPUSM_PROVIDER_BAD_GROUP_STRUCT   = (1 << 0);
@@ -8,6 +13,10 @@ static const int DPUSM_PROVIDER_BAD_GROUP_RAID_GEN = (1 << 2);
 static const int DPUSM_PROVIDER_BAD_GROUP_RAID_REC = (1 << 3);
 static const int DPUSM_PROVIDER_BAD_GROUP_FILE     = (1 << 4);
 static const int DPUSM_PROVIDER_BAD_GROUP_DISK     = (1 << 5);
+static const int DPUSM_PROVIDER_BAD_GROUP_EMBEDDED = (1 << 6);
+static const int DPUSM_PROVIDER_BAD_GROUP_ASYNC    = (1 << 7);
+static const int DPUSM_PROVIDER_BAD_GROUP_CKSUM    = (1 << 8);
+static const int DPUSM_PROVIDER_BAD_GROUP_DICT     = (1 << 9);
 
 static const char *DPUSM_PROVIDER_BAD_GROUP_STRINGS[] = {
     "STRUCT",
@@ -16,6 +25,10 @@ static const char *DPUSM_PROVIDER_BAD_GROUP_STRINGS[] = {
     "RAID_REC",
     "FILE",
     "DISK",
+    "EMBEDDED",
+    "ASYNC",
+    "CHECKSUM_CTX",
+    "DICT",
 };
 
 /* check provider sanity when loading */
@@ -33,13 +46,21 @@ dpusm_provider_sane_at_load(const dpusm_pf_t *funcs)
 
     const int required = (
         !!funcs->algorithms +
-        !!funcs->alloc +
-        !!funcs->alloc_ref +
         !!funcs->get_size +
-        !!funcs->free +
         !!funcs->copy.from.generic +
         !!funcs->copy.to.generic);
 
+    const int handles = (
+        !!funcs->alloc +
+        !!funcs->alloc_ref +
+        !!funcs->free);
+
+    const int embedded = (
+        !!funcs->private_size +
+        !!funcs->alloc_private +
+        !!funcs->alloc_ref_private +
+        !!funcs->free_private);
+
     const int raid_gen = (
         !!funcs->raid.can_compute +
         !!funcs->raid.alloc +
@@ -63,31 +84,57 @@ dpusm_provider_sane_at_load(const dpusm_pf_t *funcs)
         !!funcs->disk.flush +
         !!funcs->disk.close);
 
+    const int async = (
+        !!funcs->async.create +
+        !!funcs->async.submit +
+        !!funcs->async.destroy);
+
+    const int cksum_ctx = (
+        !!funcs->checksum_ctx.init +
+        !!funcs->checksum_ctx.update +
+        !!funcs->checksum_ctx.final +
+        !!funcs->checksum_ctx.free);
+
+    const int dict = (
+        !!funcs->dict.load +
+        !!funcs->dict.compress +
+        !!funcs->dict.decompress +
+        !!funcs->dict.free);
+
     // get bitmap of bad function groups
     const int rc = (
-        (!(required == 7)?DPUSM_PROVIDER_BAD_GROUP_REQUIRED:0) |
+        (!((required == 4) && ((handles == 3) || ((handles == 0) && (embedded == 4))))?DPUSM_PROVIDER_BAD_GROUP_REQUIRED:0) |
+        (!((embedded == 0) || ((embedded == 4) && (funcs->private_size <= DPUSM_PRIVATE_SIZE_MAX)))?DPUSM_PROVIDER_BAD_GROUP_EMBEDDED:0) |
         (!((raid_gen == 0) || (raid_gen == 5))?DPUSM_PROVIDER_BAD_GROUP_RAID_GEN:0) |
         (!((raid_rec == 0) || ((raid_gen == 5) && (raid_rec == 2)))?DPUSM_PROVIDER_BAD_GROUP_RAID_REC:0) |
         (!((file == 0) || (file == 3))?DPUSM_PROVIDER_BAD_GROUP_FILE:0) |
-        (!((disk == 0) || (disk == 5))?DPUSM_PROVIDER_BAD_GROUP_DISK:0)
+        (!((disk == 0) || (disk == 5))?DPUSM_PROVIDER_BAD_GROUP_DISK:0) |
+        (!((async == 0) || (async == 3))?DPUSM_PROVIDER_BAD_GROUP_ASYNC:0) |
+        (!((cksum_ctx == 0) || ((cksum_ctx == 4) && funcs->checksum))?DPUSM_PROVIDER_BAD_GROUP_CKSUM:0) |
+        (!((dict == 0) || ((dict == 4) && funcs->compress && funcs->decompress))?DPUSM_PROVIDER_BAD_GROUP_DICT:0)
     );
 
     return rc;
 }
 
-/* simple linear search */
-/* caller locks */
+static u32
+dpusm_name_hash(const char *name, size_t name_len) {
+    return full_name_hash(NULL, name, name_len);
+}
+
+/* hash table lookup */
+/* caller either holds dpusm->lock or is in an RCU read-side critical section */
 static dpusm_ph_t **
 find_provider(dpusm_t *dpusm, const char *name) {
     const size_t name_len = strlen(name);
-
-    struct list_head *it = NULL;
-    list_for_each(it, &dpusm->providers) {
-        dpusm_ph_t *dpusmph = list_entry(it, dpusm_ph_t, list);
-        const char *p_name = module_name(dpusmph->module);
-        const size_t p_name_len = strlen(p_name);
-        if (name_len == p_name_len) {
-            if (memcmp(name, p_name, p_name_len) == 0) {
+    const u32 name_hash = dpusm_name_hash(name, name_len);
+
+    dpusm_ph_t *dpusmph = NULL;
+    hash_for_each_possible_rcu(dpusm->index, dpusmph, node, name_hash,
+                               lockdep_is_held(&dpusm->lock)) {
+        if ((dpusmph->name_hash == name_hash) &&
+            (dpusmph->name_len == name_len)) {
+            if (memcmp(name, module_name(dpusmph->module), name_len) == 0) {
                 return &dpusmph->self;
             }
         }
@@ -96,9 +143,25 @@ find_provider(dpusm_t *dpusm, const char *name) {
     return NULL;
 }
 
+/* sum of per-CPU counters - only exact when nothing can increment them */
+static long
+dpusm_percpu_sum(long __percpu *counts)
+{
+    long sum = 0;
+    int cpu;
+    for_each_possible_cpu(cpu) {
+        sum += *per_cpu_ptr(counts, cpu);
+    }
+    return sum;
+}
+
 static void
 dpusmph_destroy(dpusm_ph_t *dpusmph)
 {
+    if (dpusmph->props) {
+        dpusm_mem_free(dpusmph->props, dpusmph->nprops * sizeof(dpusm_ap_t));
+    }
+    free_percpu(dpusmph->refs);
     dpusm_mem_free(dpusmph, sizeof(*dpusmph));
 }
 
@@ -107,12 +170,121 @@ static void print_supported(const char *name, const char *func)
     printk("Provider %s supports %s\n", name, func);
 }
 
+/*
+ * The properties are only kept for algorithms the provider supports,
+ * compress first, then decompress, then checksum, each in bit order,
+ * so an algorithm's entry is the number of supported algorithms
+ * before it.
+ */
+static ssize_t
+dpusmph_props_index(const dpusm_pc_t *caps, dpusm_op_type_t type, u64 alg)
+{
+    u64 algs = 0;
+    size_t base = 0;
+    switch (type) {
+        case DPUSM_OP_COMPRESS:
+            algs = caps->compress;
+            break;
+        case DPUSM_OP_DECOMPRESS:
+            algs = caps->decompress;
+            base = hweight64(caps->compress);
+            break;
+        case DPUSM_OP_CHECKSUM:
+            algs = caps->checksum;
+            base = hweight64(caps->compress) + hweight64(caps->decompress);
+            break;
+        default:
+            return -1;
+    }
+
+    /* exactly one supported algorithm */
+    if (!alg || (alg & (alg - 1)) || !(algs & alg)) {
+        return -1;
+    }
+
+    return base + hweight64(algs & (alg - 1));
+}
+
+/* ask the provider to describe each algorithm it supports */
+static void
+dpusmph_props_init(dpusm_ph_t *dpusmph, const dpusm_pf_t *funcs)
+{
+    static const dpusm_op_type_t types[] = {
+        DPUSM_OP_COMPRESS,
+        DPUSM_OP_DECOMPRESS,
+        DPUSM_OP_CHECKSUM,
+    };
+
+    const dpusm_pc_t *caps = &dpusmph->capabilities;
+    const size_t nprops = hweight64(caps->compress) +
+                          hweight64(caps->decompress) +
+                          hweight64(caps->checksum);
+
+    /* optional - everything is unknown without them */
+    if (!funcs->algorithm_properties || !nprops) {
+        return;
+    }
+
+    dpusmph->props = dpusm_mem_alloc(nprops * sizeof(dpusm_ap_t));
+    if (!dpusmph->props) {
+        return;
+    }
+    dpusmph->nprops = nprops;
+
+    for(size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        for(u64 alg = 1ULL << 0; alg; alg <<= 1) {
+            const ssize_t i = dpusmph_props_index(caps, types[t], alg);
+            if (i < 0) {
+                continue;
+            }
+
+            dpusm_ap_t *ap = &dpusmph->props[i];
+            if (funcs->algorithm_properties(types[t], alg, ap) != DPUSM_OK) {
+                memset(ap, 0, sizeof(*ap));
+            }
+        }
+    }
+}
+
+int
+dpusmph_algorithm_properties(const dpusm_ph_t *dpusmph, dpusm_op_type_t type,
+    u64 alg, dpusm_ap_t *props)
+{
+    const ssize_t i = dpusmph_props_index(&dpusmph->capabilities, type, alg);
+    if (i < 0) {
+        return DPUSM_NOT_SUPPORTED;
+    }
+
+    if (dpusmph->props) {
+        *props = dpusmph->props[i];
+    }
+    else {
+        memset(props, 0, sizeof(*props));
+    }
+
+    return DPUSM_OK;
+}
+
 static dpusm_ph_t *
 dpusmph_init(struct module *module, const dpusm_pf_t *funcs)
 {
     const char *name = module_name(module);
     dpusm_ph_t *dpusmph = dpusm_mem_alloc(sizeof(dpusm_ph_t));
     if (dpusmph) {
+        memset(dpusmph, 0, sizeof(*dpusmph));
+
+        dpusmph->refs = alloc_percpu(long);
+        if (!dpusmph->refs) {
+            dpusmph_destroy(dpusmph);
+            return NULL;
+        }
+        init_waitqueue_head(&dpusmph->drain);
+
+        dpusmph->copy_ptr_min = funcs->copy.ptr_min?
+            funcs->copy.ptr_min:DPUSM_COPY_PTR_MIN_DEFAULT;
+        dpusmph->copy_scatterlist_min = funcs->copy.scatterlist_min?
+            funcs->copy.scatterlist_min:DPUSM_COPY_SCATTERLIST_MIN_DEFAULT;
+
         /* fill in capabilities bitmasks */
         if (funcs->copy.from.ptr) {
             dpusmph->capabilities.optional |= DPUSM_OPTIONAL_COPY_FROM_PTR;
@@ -134,6 +306,31 @@ dpusmph_init(struct module *module, const dpusm_pf_t *funcs)
             print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_COPY_TO_SCATTERLIST));
         }
 
+        if (funcs->copy.peer) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_COPY_PEER;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_COPY_PEER));
+        }
+
+        if (funcs->copy.from.async) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_COPY_FROM_ASYNC;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_COPY_FROM_ASYNC));
+        }
+
+        if (funcs->copy.to.async) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_COPY_TO_ASYNC;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_COPY_TO_ASYNC));
+        }
+
+        if (funcs->copy.from.checksum) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_COPY_FROM_CHECKSUM;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_COPY_FROM_CHECKSUM));
+        }
+
+        if (funcs->copy.to.checksum) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_COPY_TO_CHECKSUM;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_COPY_TO_CHECKSUM));
+        }
+
         if (funcs->associate_handle) {
             dpusmph->capabilities.optional |= DPUSM_OPTIONAL_ASSOCIATE_HANDLE;
             print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_ASSOCIATE_HANDLE));
@@ -154,6 +351,72 @@ dpusmph_init(struct module *module, const dpusm_pf_t *funcs)
             print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_ALL_ZEROS));
         }
 
+        /* already checked for sanity */
+        if (funcs->private_size) {
+            dpusmph->handle_class = dpusm_handle_class(funcs->private_size);
+
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_EMBEDDED_HANDLE;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_EMBEDDED_HANDLE));
+        }
+
+        if (funcs->checksum_many) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_CHECKSUM_MANY;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_CHECKSUM_MANY));
+        }
+
+        /* already checked for sanity */
+        if (funcs->dict.load) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_DICT;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_DICT));
+        }
+
+        if (funcs->compress_many) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_COMPRESS_MANY;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_COMPRESS_MANY));
+        }
+
+        if (funcs->decompress_many) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_DECOMPRESS_MANY;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_DECOMPRESS_MANY));
+        }
+
+        if (funcs->compress_bounded) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_COMPRESS_BOUNDED;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_COMPRESS_BOUNDED));
+        }
+
+        if (funcs->compressibility) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_COMPRESSIBILITY;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_COMPRESSIBILITY));
+        }
+
+        if (funcs->checksum_verify) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_CHECKSUM_VERIFY;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_CHECKSUM_VERIFY));
+        }
+
+        if (funcs->checksum_verify_many) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_CHECKSUM_VERIFY_MANY;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_CHECKSUM_VERIFY_MANY));
+        }
+
+        /* already checked for sanity */
+        if (funcs->checksum_ctx.init) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_CHECKSUM_CTX;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_CHECKSUM_CTX));
+        }
+
+        if (funcs->chain) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_CHAIN;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_CHAIN));
+        }
+
+        /* already checked for sanity */
+        if (funcs->async.create) {
+            dpusmph->capabilities.optional |= DPUSM_OPTIONAL_ASYNC;
+            print_supported(name, enum2str(DPUSM_OPTIONAL_STR, DPUSM_OPTIONAL_ASYNC));
+        }
+
         if (funcs->algorithms(&dpusmph->capabilities.compress,
                               &dpusmph->capabilities.decompress,
                               &dpusmph->capabilities.checksum,
@@ -167,7 +430,7 @@ dpusmph_init(struct module *module, const dpusm_pf_t *funcs)
             dpusmph->capabilities.compress = 0;
         }
 
-        for(size_t i = 1 << 0; i < DPUSM_COMPRESS_MAX; i <<= 1) {
+        for(u64 i = 1ULL << 0; i < DPUSM_COMPRESS_MAX; i <<= 1) {
             if (dpusmph->capabilities.compress & i) {
                 print_supported(name, enum2str(DPUSM_COMPRESS_STR, i));
             }
@@ -177,7 +440,7 @@ dpusmph_init(struct module *module, const dpusm_pf_t *funcs)
             dpusmph->capabilities.decompress = 0;
         }
 
-        for(size_t i = 1 << 0; i < DPUSM_COMPRESS_MAX; i <<= 1) {
+        for(u64 i = 1ULL << 0; i < DPUSM_COMPRESS_MAX; i <<= 1) {
             if (dpusmph->capabilities.decompress & i) {
                 print_supported(name, enum2str(DPUSM_DECOMPRESS_STR, i));
             }
@@ -188,13 +451,15 @@ dpusmph_init(struct module *module, const dpusm_pf_t *funcs)
             dpusmph->capabilities.checksum_byteorder = 0;
         }
 
-        for(size_t i = 1 << 0; i < DPUSM_CHECKSUM_MAX; i <<= 1) {
+        for(u64 i = 1ULL << 0; i < DPUSM_CHECKSUM_MAX; i <<= 1) {
             if (dpusmph->capabilities.checksum & i) {
                 print_supported(name, enum2str(DPUSM_CHECKSUM_STR, i));
             }
         }
 
-        for(size_t i = 1 << 0; i < DPUSM_BYTEORDER_MAX; i <<= 1) {
+        dpusmph_props_init(dpusmph, funcs);
+
+        for(u64 i = 1ULL << 0; i < DPUSM_BYTEORDER_MAX; i <<= 1) {
             if (dpusmph->capabilities.checksum_byteorder & i) {
                 print_supported(name, enum2str(DPUSM_CHECKSUM_BYTEORDER_STR, i));
             }
@@ -205,7 +470,7 @@ dpusmph_init(struct module *module, const dpusm_pf_t *funcs)
             dpusmph->capabilities.raid = 0;
         }
 
-        for(size_t i = 1 << 0; i < DPUSM_RAID_MAX; i <<= 1) {
+        for(u64 i = 1ULL << 0; i < DPUSM_RAID_MAX; i <<= 1) {
             if (dpusmph->capabilities.raid & i) {
                 print_supported(name, enum2str(DPUSM_RAID_STR, i));
             }
@@ -229,15 +494,54 @@ dpusmph_init(struct module *module, const dpusm_pf_t *funcs)
             dpusmph->capabilities.io &= ~DPUSM_IO_DISK;
         }
 
+        /* optional - registration continues without a pool */
+        dpusmph->pool = dpusm_pool_create(name);
+
         dpusmph->module = module;
+        dpusmph->name_len = strlen(name);
+        dpusmph->name_hash = dpusm_name_hash(name, dpusmph->name_len);
         dpusmph->funcs = funcs;
         dpusmph->self = dpusmph;
-        atomic_set(&dpusmph->refs, 0);
     }
 
     return dpusmph;
 }
 
+/* print the algorithms of one capability bitmask */
+static void
+dpusm_algorithms_print(struct seq_file *m, const dpusm_ph_t *dpusmph,
+    dpusm_op_type_t type, const char *name, const char **strs, u64 algs, u64 max)
+{
+    for(u64 i = 1ULL << 0; i < max; i <<= 1) {
+        dpusm_ap_t ap;
+        if ((algs & i) &&
+            (dpusmph_algorithm_properties(dpusmph, type, i, &ap) == DPUSM_OK)) {
+            seq_printf(m, "%-10s %-24s %12llu %9llu %14llu %10llu\n",
+                       name, enum2str(strs, i),
+                       ap.max_size, ap.alignment, ap.throughput, ap.latency_ns);
+        }
+    }
+}
+
+static int
+dpusm_algorithms_show(struct seq_file *m, void *v)
+{
+    const dpusm_ph_t *dpusmph = (dpusm_ph_t *) m->private;
+    const dpusm_pc_t *caps = &dpusmph->capabilities;
+
+    seq_printf(m, "%-10s %-24s %12s %9s %14s %10s\n",
+               "type", "algorithm", "max_size", "alignment", "bytes/s", "latency_ns");
+    dpusm_algorithms_print(m, dpusmph, DPUSM_OP_COMPRESS, "compress",
+                           DPUSM_COMPRESS_STR, caps->compress, DPUSM_COMPRESS_MAX);
+    dpusm_algorithms_print(m, dpusmph, DPUSM_OP_DECOMPRESS, "decompress",
+                           DPUSM_DECOMPRESS_STR, caps->decompress, DPUSM_COMPRESS_MAX);
+    dpusm_algorithms_print(m, dpusmph, DPUSM_OP_CHECKSUM, "checksum",
+                           DPUSM_CHECKSUM_STR, caps->checksum, DPUSM_CHECKSUM_MAX);
+    return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(dpusm_algorithms);
+
 /* add a new provider */
 int
 dpusm_provider_register(dpusm_t *dpusm, struct module *module, const dpusm_pf_t *funcs) {
@@ -287,17 +591,63 @@ dpusm_provider_register(dpusm_t *dpusm, struct module *module, const dpusm_pf_t
         return -ECANCELED;
     }
 
-    list_add(&provider->list, &dpusm->providers);
+    /* publish the fully initialized provider to lockless readers */
+    list_add_rcu(&provider->list, &dpusm->providers);
+    hash_add_rcu(dpusm->index, &provider->node, provider->name_hash);
     dpusm->count++;
     printk("%s: DPUSM Provider \"%s\" (%p) added. Now %zu providers registered.\n",
            __func__, module_name(module), provider, dpusm->count);
+    trace_dpusm_provider_register(module_name(module), provider);
+
+    provider->debugfs = debugfs_create_dir(module_name(module), dpusm->debugfs);
+    debugfs_create_size_t("copy_ptr_min", 0644, provider->debugfs,
+                          &provider->copy_ptr_min);
+    debugfs_create_size_t("copy_scatterlist_min", 0644, provider->debugfs,
+                          &provider->copy_scatterlist_min);
+    debugfs_create_file("algorithms", 0444, provider->debugfs, provider,
+                        &dpusm_algorithms_fops);
 
     mutex_unlock(&dpusm->lock);
 
     return 0;
 }
 
+/*
+ * stop new users from finding the provider and wait for
+ * the remaining users to return it
+ *
+ * Once lookups in flight have finished, the per-CPU reference
+ * counts can only decrease, so a sum of 0 means every user is
+ * gone. Puts touch the counters in RCU read-side critical
+ * sections, so after the final grace period, nothing will touch
+ * the provider again.
+ *
+ * Returns the number of users still holding the provider if
+ * they did not return it before the timeout.
+ *
+ * caller locks
+ */
+static long
+dpusmph_kill_and_drain(dpusm_t *dpusm, dpusm_ph_t *dpusmph) {
+    hash_del_rcu(&dpusmph->node);
+    list_del_rcu(&dpusmph->list);
+    dpusm->count--;
+
+    WRITE_ONCE(dpusmph->draining, true);
+    synchronize_rcu();
+
+    long refs = 0;
+    wait_event_timeout(dpusmph->drain,
+                       (refs = dpusm_percpu_sum(dpusmph->refs)) == 0,
+                       DPUSM_PROVIDER_DRAIN_TIMEOUT);
+
+    synchronize_rcu();
+
+    return refs;
+}
+
 /* remove provider from list */
+/* caller locks */
 int
 dpusm_provider_unregister_handle(dpusm_t *dpusm, dpusm_ph_t **provider) {
     if (!provider || !*provider) {
@@ -305,21 +655,31 @@ dpusm_provider_unregister_handle(dpusm_t *dpusm, dpusm_ph_t **provider) {
         return -EINVAL;
     }
 
+    dpusm_ph_t *dpusmph = *provider;
+
     int rc = 0;
-    const int refs = atomic_read(&(*provider)->refs);
+    const long refs = dpusmph_kill_and_drain(dpusm, dpusmph);
+    trace_dpusm_provider_unregister(module_name(dpusmph->module), dpusmph, refs);
     if (refs) {
-        printk("%s: Unregistering provider \"%s\" with %d references remaining.\n",
-               __func__, module_name((*provider)->module), refs);
+        printk("%s: Unregistering provider \"%s\" with %ld references remaining.\n",
+               __func__, module_name(dpusmph->module), refs);
         rc = -EBUSY;
     }
 
-    list_del(&(*provider)->list);
-    atomic_sub(refs, &dpusm->active); /* remove this provider's references from the global active count */
+    this_cpu_sub(*dpusm->active, refs); /* remove this provider's references from the global active count */
 
-    dpusmph_destroy(*provider);
-    dpusm->count--;
+    debugfs_remove_recursive(dpusmph->debugfs);
+
+    /* cached handles need a valid provider to be freed */
+    dpusm_pool_destroy(dpusmph->pool);
 
-    *provider = NULL;
+    /* remaining users see an unregistered provider */
+    WRITE_ONCE(dpusmph->self, NULL);
+
+    /* leak the provider rather than free memory that users can still write to */
+    if (!refs) {
+        dpusmph_destroy(dpusmph);
+    }
 
     return rc;
 }
@@ -349,32 +709,48 @@ dpusm_provider_unregister(dpusm_t *dpusm, struct module *module) {
  */
 
 /* get a provider by name */
+/* lockless - only registration, unregistration, and invalidation take dpusm->lock */
 dpusm_ph_t **
 dpusm_provider_get(dpusm_t *dpusm, const char *name) {
-    while (mutex_lock_interruptible(&dpusm->lock));
+    rcu_read_lock();
     dpusm_ph_t **provider = find_provider(dpusm, name);
-    if (provider) {
-        /* make sure provider can't be unloaded before user */
-        if (!try_module_get((*provider)->module)) {
-            printk("Error: Could not increment reference count of %s\n", name);
-            return NULL;
-        }
+    if (!provider) {
+        rcu_read_unlock();
+        trace_dpusm_provider_get(name, NULL);
+        dpusm_debug("%s: Error: Did not find provider \"%s\"\n",
+                    __func__, name);
+        return NULL;
+    }
 
-        atomic_inc(&(*provider)->refs);
-        atomic_inc(&dpusm->active);
+    /*
+     * make sure provider can't be unloaded before user
+     *
+     * Providers unregister in their module exit functions, so once
+     * the module reference is held, the provider handle stays
+     * valid outside of the RCU read-side critical section.
+     */
+    if (!try_module_get((*provider)->module)) {
+        rcu_read_unlock();
+        trace_dpusm_provider_get(name, NULL);
+        dpusm_debug("Error: Could not increment reference count of %s\n", name);
+        return NULL;
+    }
 
-        printk("%s: User has been given a handle to \"%s\" (%p) (now %d users).\n",
-               __func__, name, *provider, atomic_read(&(*provider)->refs));
+    /* local increments - must happen before leaving the RCU read-side critical section */
+    this_cpu_inc(*(*provider)->refs);
+    this_cpu_inc(*dpusm->active);
+    rcu_read_unlock();
 
-        if ((*provider)->funcs->at_connect) {
-            (*provider)->funcs->at_connect();
-        }
-    }
-    else {
-        printk("%s: Error: Did not find provider \"%s\"\n",
-               __func__, name);
+    trace_dpusm_provider_get(name, *provider);
+    dpusm_debug("%s: User has been given a handle to \"%s\" (%p).\n",
+                __func__, name, *provider);
+
+    /* provider might have been invalidated */
+    const dpusm_pf_t *funcs = READ_ONCE((*provider)->funcs);
+    if (funcs && funcs->at_connect) {
+        funcs->at_connect();
     }
-    mutex_unlock(&dpusm->lock);
+
     return provider;
 }
 
@@ -389,35 +765,57 @@ dpusm_provider_put(dpusm_t *dpusm, void *handle) {
 
     struct module *module = (*provider)->module;
 
-    if (!atomic_read(&(*provider)->refs)) {
-        printk("%s Error: Cannot decrement provider \"%s\" user count already at 0.\n",
-               __func__, module_name(module));
-        return DPUSM_ERROR;
-    }
+    /* module name is only guaranteed to be valid until module_put() */
+    trace_dpusm_provider_put(module_name(module), *provider);
+    dpusm_debug("%s: User has returned a handle to \"%s\" (%p).\n",
+                __func__, module_name(module), *provider);
 
-    module_put(module);
-    atomic_dec(&(*provider)->refs);
-    atomic_dec(&dpusm->active);
-
-    if ((*provider)->funcs) { /* provider might have been invalidated */
-        if ((*provider)->funcs->at_disconnect) {
-            (*provider)->funcs->at_disconnect();
+    const dpusm_pf_t *funcs = READ_ONCE((*provider)->funcs);
+    if (funcs) { /* provider might have been invalidated */
+        if (funcs->at_disconnect) {
+            funcs->at_disconnect();
         }
     }
 
-    printk("%s: User has returned a handle to \"%s\" (%p) (now %d users).\n",
-           __func__, module_name(module), *provider, atomic_read(&(*provider)->refs));
+    /*
+     * Per-CPU counts cannot be checked for underflow here, since
+     * the reference may have been taken on a different CPU. The
+     * totals are checked when the provider is unregistered.
+     *
+     * The provider can be freed as soon as the critical section
+     * ends, so it cannot be touched after that.
+     */
+    dpusm_ph_t *dpusmph = *provider;
+    rcu_read_lock();
+    this_cpu_dec(*dpusmph->refs);
+    this_cpu_dec(*dpusm->active);
+    if (READ_ONCE(dpusmph->draining)) {
+        wake_up(&dpusmph->drain);
+    }
+    rcu_read_unlock();
+
+    /* the provider module can unload after this */
+    module_put(module);
+
     return DPUSM_OK;
 }
 
+/* only exact when no new references can be taken */
+long
+dpusm_provider_active(dpusm_t *dpusm) {
+    return dpusm_percpu_sum(dpusm->active);
+}
+
 void dpusm_provider_invalidate(dpusm_t *dpusm, const char *name) {
     while (mutex_lock_interruptible(&dpusm->lock));
     dpusm_ph_t **provider = find_provider(dpusm, name);
     if (provider && *provider) {
-        (*provider)->funcs = NULL;
+        /* lockless users see either the old functions or NULL */
+        WRITE_ONCE((*provider)->funcs, NULL);
+        trace_dpusm_provider_invalidate(name, *provider);
         memset(&(*provider)->capabilities, 0, sizeof((*provider)->capabilities));
-        printk("%s: Provider \"%s\" has been invalidated with %d users active.\n",
-               __func__, name, atomic_read(&(*provider)->refs));
+        printk("%s: Provider \"%s\" has been invalidated with about %ld users active.\n",
+               __func__, name, dpusm_percpu_sum((*provider)->refs));
         /* not decrementing module reference count here - provider is still registered */
     }
     else {
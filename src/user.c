@@ -1,6 +1,19 @@
 #include <dpusm/alloc.h>
+#include <dpusm/async.h>
+#include <dpusm/checksum.h>
+#include <dpusm/debug.h>
+#include <dpusm/pool.h>
+#include <dpusm/probe.h>
 #include <dpusm/provider.h>
+#include <dpusm/trace.h>
+#include <dpusm/user.h>
 #include <dpusm/user_api.h>
+#include <linux/bitmap.h>
+#include <linux/log2.h>
+#include <linux/mempool.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
+#include <linux/vmalloc.h>
 
 #define FUNCS(dpusmph) ((* (dpusm_ph_t **) dpusmph)->funcs)
 
@@ -11,6 +24,8 @@ typedef enum dpusm_handle_type {
     DPUSM_HANDLE_RAID,
     DPUSM_HANDLE_FILE,
     DPUSM_HANDLE_DISK,
+    DPUSM_HANDLE_CHECKSUM,
+    DPUSM_HANDLE_DICT,
 
     DPUSM_HANDLE_MAX,
 } dpusm_handle_type_t;
@@ -24,8 +39,110 @@ typedef struct dpusm_handle {
     dpusm_handle_type_t type;
     size_t size;
 #endif
+    s16 pool_class;        /* size class to cache this handle in when freed, or -1 */
+    s16 handle_class;      /* dpusm_embedded_cache this came from, or -1 */
+    bool host;             /* handle is DPUSM state, not the provider's (fallback checksum contexts) */
+    struct dpusm_stage *stage; /* host side buffer for small copies, or NULL */
+    u64 private[];         /* provider handle, if the provider embeds its handles */
 } dpusm_handle_t;
 
+#define EMBEDDED(dpusmh) ((dpusmh)->handle == (void *) (dpusmh)->private)
+
+/* dpusm_handle_t allocations */
+static struct kmem_cache *dpusm_handle_cache = NULL;
+
+/*
+ * dpusm_handle_t allocations with embedded provider handles, by
+ * private size (8, 16, ..., DPUSM_PRIVATE_SIZE_MAX bytes)
+ *
+ * These are shared by all providers so that handles can still be
+ * freed after their provider unregisters.
+ */
+#define DPUSM_EMBEDDED_CACHE_MIN 8
+#define DPUSM_EMBEDDED_CACHES    6
+#if (DPUSM_EMBEDDED_CACHE_MIN << (DPUSM_EMBEDDED_CACHES - 1)) != DPUSM_PRIVATE_SIZE_MAX
+#error "DPUSM_EMBEDDED_CACHES does not cover DPUSM_PRIVATE_SIZE_MAX"
+#endif
+static struct kmem_cache *dpusm_embedded_cache[DPUSM_EMBEDDED_CACHES];
+static const char *DPUSM_EMBEDDED_CACHE_NAMES[DPUSM_EMBEDDED_CACHES] = {
+    "dpusm_handle_8",
+    "dpusm_handle_16",
+    "dpusm_handle_32",
+    "dpusm_handle_64",
+    "dpusm_handle_128",
+    "dpusm_handle_256",
+};
+
+/* bounce buffers for copy.peer between providers that cannot reach each other */
+#define DPUSM_PEER_BOUNCE_SIZE  (64 * 1024)
+#define DPUSM_PEER_BOUNCE_COUNT 4 /* always available */
+static mempool_t *dpusm_peer_bounce = NULL;
+
+static void
+dpusm_embedded_caches_destroy(void) {
+    for(int i = 0; i < DPUSM_EMBEDDED_CACHES; i++) {
+        dpusm_mem_cache_destroy(dpusm_embedded_cache[i]);
+        dpusm_embedded_cache[i] = NULL;
+    }
+}
+
+int
+dpusm_user_init(void) {
+    dpusm_handle_cache = dpusm_mem_cache_create("dpusm_handle", sizeof(dpusm_handle_t));
+    if (!dpusm_handle_cache) {
+        return -ENOMEM;
+    }
+
+    for(int i = 0; i < DPUSM_EMBEDDED_CACHES; i++) {
+        dpusm_embedded_cache[i] = dpusm_mem_cache_create(DPUSM_EMBEDDED_CACHE_NAMES[i],
+            sizeof(dpusm_handle_t) + (DPUSM_EMBEDDED_CACHE_MIN << i));
+        if (!dpusm_embedded_cache[i]) {
+            dpusm_embedded_caches_destroy();
+            dpusm_mem_cache_destroy(dpusm_handle_cache);
+            dpusm_handle_cache = NULL;
+            return -ENOMEM;
+        }
+    }
+
+    dpusm_peer_bounce = mempool_create_kmalloc_pool(DPUSM_PEER_BOUNCE_COUNT,
+        DPUSM_PEER_BOUNCE_SIZE);
+    if (!dpusm_peer_bounce) {
+        dpusm_embedded_caches_destroy();
+        dpusm_mem_cache_destroy(dpusm_handle_cache);
+        dpusm_handle_cache = NULL;
+        return -ENOMEM;
+    }
+
+    dpusm_host_cksum_load();
+
+    return 0;
+}
+
+void
+dpusm_user_fini(void) {
+    dpusm_host_cksum_unload();
+
+    mempool_destroy(dpusm_peer_bounce);
+    dpusm_peer_bounce = NULL;
+
+    dpusm_embedded_caches_destroy();
+    dpusm_mem_cache_destroy(dpusm_handle_cache);
+    dpusm_handle_cache = NULL;
+}
+
+/* private_size has already been checked against DPUSM_PRIVATE_SIZE_MAX */
+int
+dpusm_handle_class(size_t private_size) {
+    return order_base_2(max_t(size_t, private_size, DPUSM_EMBEDDED_CACHE_MIN)) -
+        ilog2(DPUSM_EMBEDDED_CACHE_MIN);
+}
+
+/* the cache a handle came from or will come from */
+static struct kmem_cache *
+dpusm_handle_cache_of(int handle_class) {
+    return (handle_class >= 0)?dpusm_embedded_cache[handle_class]:dpusm_handle_cache;
+}
+
 static dpusm_handle_t *
 dpusm_handle_construct(void *provider, void *handle
 #ifdef DEBUG
@@ -34,22 +151,60 @@ dpusm_handle_construct(void *provider, void *handle
     ) {
     dpusm_handle_t *dpusmh = NULL;
     if (provider && handle) {
-        dpusmh = dpusm_mem_alloc(sizeof(dpusm_handle_t));
+        dpusmh = dpusm_mem_cache_alloc(dpusm_handle_cache);
         if (dpusmh) {
             dpusmh->provider = provider;
             dpusmh->handle = handle;
+            dpusmh->pool_class = -1;
+            dpusmh->handle_class = -1;
+            dpusmh->host = false;
+            dpusmh->stage = NULL;
 #ifdef DEBUG
             dpusmh->type = type;
             dpusmh->size = size;
 #endif
+            trace_dpusm_handle_construct(provider, dpusmh, handle);
         }
     }
     return dpusmh;
 }
 
+/*
+ * allocate a DPUSM handle with space for the provider's handle
+ *
+ * The provider handle is the private area, which the
+ * provider is expected to fill in before it is used.
+ */
+static dpusm_handle_t *
+dpusm_handle_construct_embedded(void *provider
+#ifdef DEBUG
+    , dpusm_handle_type_t type, size_t size
+#endif
+    ) {
+    const int handle_class = (* (dpusm_ph_t **) provider)->handle_class;
+    dpusm_handle_t *dpusmh = dpusm_mem_cache_alloc(dpusm_handle_cache_of(handle_class));
+    if (dpusmh) {
+        dpusmh->provider = provider;
+        dpusmh->handle = dpusmh->private;
+        dpusmh->pool_class = -1;
+        dpusmh->handle_class = handle_class;
+        dpusmh->host = false;
+        dpusmh->stage = NULL;
+#ifdef DEBUG
+        dpusmh->type = type;
+        dpusmh->size = size;
+#endif
+        trace_dpusm_handle_construct(provider, dpusmh, dpusmh->handle);
+    }
+    return dpusmh;
+}
+
 static void
 dpusm_handle_free(dpusm_handle_t *dpusmh) {
-    dpusm_mem_free(dpusmh, sizeof(*dpusmh));
+    trace_dpusm_handle_free(dpusmh->provider, dpusmh, dpusmh->handle);
+
+    /* does not depend on the provider, which might have unregistered */
+    dpusm_mem_cache_free(dpusm_handle_cache_of(dpusmh->handle_class), dpusmh);
 }
 
 /*
@@ -63,18 +218,20 @@ dpusm_handle_free(dpusm_handle_t *dpusmh) {
 static int
 dpusm_provider_sane(dpusm_ph_t **provider) {
     if (!provider) {
-        printk("Error: Got bad provider\n");
+        dpusm_debug("Error: Got bad provider\n");
         return DPUSM_PROVIDER_NOT_EXISTS;
     }
 
     if (!*provider) {
-        printk("Error: Unregistered provider: %p\n", provider);
-        dump_stack();
+        if (dpusm_debug_enabled()) {
+            printk("Error: Unregistered provider: %p\n", provider);
+            dump_stack();
+        }
         return DPUSM_PROVIDER_UNREGISTERED;
     }
 
     if (!FUNCS(provider)) {
-        printk("Error: Invalidated provider: %s\n", module_name((*provider)->module));
+        dpusm_debug("Error: Invalidated provider: %s\n", module_name((*provider)->module));
         return DPUSM_PROVIDER_INVALIDATED;
     }
 
@@ -88,6 +245,104 @@ dpusm_provider_sane(dpusm_ph_t **provider) {
         }                                                       \
     } while (0)
 
+/*
+ * staging: copy.from.generic calls that land in the staged range of
+ * a handle are buffered in host memory and written to the offloader
+ * with one copy per contiguous run of written bytes
+ *
+ * Only written bytes are sent, so the staged range never has to be
+ * read from the offloader first.
+ */
+typedef struct dpusm_stage {
+    void *buf;
+    size_t offset;         /* start of the staged range in the handle */
+    size_t size;
+    unsigned long *dirty;  /* one bit per byte of buf not yet written to the offloader */
+} dpusm_stage_t;
+
+#define DPUSM_STAGE_DIRTY_SIZE(size) (BITS_TO_LONGS(size) * sizeof(unsigned long))
+
+/* write dirty staged data to the offloader */
+static int
+dpusm_stage_flush_dirty(dpusm_handle_t *dpusmh) {
+    dpusm_stage_t *stage = dpusmh->stage;
+
+    size_t start = find_first_bit(stage->dirty, stage->size);
+    while (start < stage->size) {
+        const size_t end = find_next_zero_bit(stage->dirty, stage->size, start);
+
+        dpusm_mv_t actual_mv = {
+            .handle = dpusmh->handle,
+            .offset = stage->offset + start,
+        };
+
+        trace_dpusm_stage_flush(dpusmh, actual_mv.offset, end - start);
+
+        const int rc = FUNCS(dpusmh->provider)->copy.from.generic(&actual_mv,
+            (char *) stage->buf + start, end - start);
+        if (rc != DPUSM_OK) {
+            return rc;
+        }
+
+        bitmap_clear(stage->dirty, start, end - start);
+        start = find_next_bit(stage->dirty, stage->size, end);
+    }
+
+    return DPUSM_OK;
+}
+
+/* called before anything other than a staged copy touches the handle */
+static int
+dpusm_stage_sync(dpusm_handle_t *dpusmh) {
+    if (likely(!dpusmh->stage)) {
+        return DPUSM_OK;
+    }
+
+    return dpusm_stage_flush_dirty(dpusmh);
+}
+
+/* freeing a handle drops staged data */
+static void
+dpusm_stage_drop(dpusm_handle_t *dpusmh) {
+    dpusm_stage_t *stage = dpusmh->stage;
+    if (stage) {
+        dpusm_mem_free(stage->dirty, DPUSM_STAGE_DIRTY_SIZE(stage->size));
+        dpusm_mem_free(stage->buf, stage->size);
+        dpusm_mem_free(stage, sizeof(*stage));
+        dpusmh->stage = NULL;
+    }
+}
+
+/*
+ * buffer a copy into the staged range
+ *
+ * returns DPUSM_NOT_SUPPORTED if the copy does not
+ * fit in the staged range and has to be done directly
+ */
+static int
+dpusm_stage_copy(dpusm_handle_t *dpusmh, size_t offset, const void *buf, size_t size) {
+    dpusm_stage_t *stage = dpusmh->stage;
+    if ((offset < stage->offset) ||
+        (size > stage->size) ||
+        (offset - stage->offset > stage->size - size)) {
+        return DPUSM_NOT_SUPPORTED;
+    }
+
+    const size_t start = offset - stage->offset;
+    memcpy((char *) stage->buf + start, buf, size);
+    bitmap_set(stage->dirty, start, size);
+
+    return DPUSM_OK;
+}
+
+#define CHECK_STAGED(dpusmh, ret)                               \
+    do {                                                        \
+        if (dpusm_stage_sync(dpusmh) != DPUSM_OK) {             \
+            return (ret);                                       \
+        }                                                       \
+    } while (0)
+
+/* also writes out staged copies */
 #define CHECK_HANDLE(handle, new_name, ret)                     \
     dpusm_handle_t *(new_name) = NULL;                          \
     do {                                                        \
@@ -97,6 +352,7 @@ dpusm_provider_sane(dpusm_ph_t **provider) {
                                                                 \
         (new_name) = (dpusm_handle_t *) (handle);               \
         CHECK_PROVIDER((new_name)->provider, (ret));            \
+        CHECK_STAGED((new_name), (ret));                        \
     } while (0)
 
 #define SAME_PROVIDERS(lhs, new_lhs, rhs, new_rhs, ret)         \
@@ -115,6 +371,8 @@ dpusm_provider_sane(dpusm_ph_t **provider) {
         }                                                       \
                                                                 \
         CHECK_PROVIDER((new_lhs)->provider, ret);               \
+        CHECK_STAGED((new_lhs), (ret));                         \
+        CHECK_STAGED((new_rhs), (ret));                         \
     } while (0)
 
 static void *
@@ -125,12 +383,12 @@ dpusm_get_provider(const char *name) {
 
     dpusm_ph_t **provider = (dpusm_ph_t **) dpusm_get(name);
     if (!provider) {
-        printk("Error: Provider with name \"%s\" not found.\n", name);
+        dpusm_debug("Error: Provider with name \"%s\" not found.\n", name);
         return NULL;
     }
 
     if (!FUNCS(provider)) {
-        printk("Error: Provider with name \"%s\" found, but has been invalidated.\n", name);
+        dpusm_debug("Error: Provider with name \"%s\" found, but has been invalidated.\n", name);
         return NULL;
     }
 
@@ -154,6 +412,25 @@ dpusm_extract_provider(void *handle) {
     return dpusmh?dpusmh->provider:NULL;
 }
 
+/*
+ * get the offloader handle out of a DPUSM handle
+ *
+ * returns NULL if the handle is NULL, its provider is not usable,
+ * or it did not come from provider (when provider is not NULL)
+ */
+static void *
+dpusm_handle_unwrap(void *handle, void *provider) {
+    dpusm_handle_t *dpusmh = (dpusm_handle_t *) handle;
+    if (!dpusmh ||
+        (provider && (dpusmh->provider != provider)) ||
+        (dpusm_provider_sane(dpusmh->provider) != DPUSM_OK) ||
+        (dpusm_stage_sync(dpusmh) != DPUSM_OK)) {
+        return NULL;
+    }
+
+    return dpusmh->handle;
+}
+
 static int
 dpusm_get_capabilities(void *provider, dpusm_pc_t **caps) {
     CHECK_PROVIDER(provider, DPUSM_ERROR);
@@ -165,20 +442,82 @@ dpusm_get_capabilities(void *provider, dpusm_pc_t **caps) {
     return DPUSM_OK;;
 }
 
+static int
+dpusm_get_algorithm_properties(void *provider, dpusm_op_type_t type,
+    u64 alg, dpusm_ap_t *props) {
+    CHECK_PROVIDER(provider, DPUSM_ERROR);
+    if (!props) {
+        return DPUSM_ERROR;
+    }
+
+    return dpusmph_algorithm_properties(* (dpusm_ph_t **) provider, type, alg, props);
+}
+
 static void *
 dpusm_alloc(void *provider, size_t size) {
     CHECK_PROVIDER(provider, NULL);
-    return dpusm_handle_construct(provider,
-        FUNCS(provider)->alloc(size)
+
+    /* reuse a handle of the same size that was freed on this CPU */
+    dpusm_pool_t *pool = (* (dpusm_ph_t **) provider)->pool;
+    const int pool_class = pool?dpusm_pool_class(size):-1;
+    if (pool_class >= 0) {
+        dpusm_handle_t *dpusmh = dpusm_pool_get(pool, pool_class);
+        if (dpusmh) {
+            return dpusmh;
+        }
+    }
+
+    dpusm_handle_t *dpusmh = NULL;
+
+    /* single allocation - provider fills in its handle in place */
+    if (FUNCS(provider)->private_size) {
+        dpusmh = dpusm_handle_construct_embedded(provider
 #ifdef DEBUG
-        , DPUSM_HANDLE_REAL, size
+            , DPUSM_HANDLE_REAL, size
 #endif
-        );
+            );
+        if (dpusmh &&
+            (FUNCS(provider)->alloc_private(dpusmh->handle, size) != DPUSM_OK)) {
+            dpusm_handle_free(dpusmh);
+            dpusmh = NULL;
+        }
+    }
+    else {
+        dpusmh = dpusm_handle_construct(provider,
+            FUNCS(provider)->alloc(size)
+#ifdef DEBUG
+            , DPUSM_HANDLE_REAL, size
+#endif
+            );
+    }
+
+    if (dpusmh) {
+        dpusmh->pool_class = pool_class;
+    }
+
+    return dpusmh;
 }
 
 static void *
 dpusm_alloc_ref(void *src, size_t offset, size_t size) {
     CHECK_HANDLE(src, dpusmh, NULL);
+
+    /* single allocation - provider fills in its handle in place */
+    if (FUNCS(dpusmh->provider)->private_size) {
+        dpusm_handle_t *ref = dpusm_handle_construct_embedded(dpusmh->provider
+#ifdef DEBUG
+            , DPUSM_HANDLE_REF, size
+#endif
+            );
+        if (ref &&
+            (FUNCS(dpusmh->provider)->alloc_ref_private(ref->handle,
+                dpusmh->handle, offset, size) != DPUSM_OK)) {
+            dpusm_handle_free(ref);
+            ref = NULL;
+        }
+        return ref;
+    }
+
     return dpusm_handle_construct(dpusmh->provider,
         FUNCS(dpusmh->provider)->alloc_ref(dpusmh->handle,
         offset, size)
@@ -201,30 +540,258 @@ dpusm_free(void *handle) {
     }
 
     dpusm_handle_t *dpusmh = (dpusm_handle_t *) handle;
+    dpusm_stage_drop(dpusmh);
+
     int rc = DPUSM_OK;
     if (dpusm_provider_sane(dpusmh->provider) == DPUSM_OK) {
-        rc = FUNCS(dpusmh->provider)->free(dpusmh->handle);
+        /* keep the handle around for the next allocation of the same size */
+        if ((dpusmh->pool_class >= 0) &&
+            dpusm_pool_put((*dpusmh->provider)->pool, dpusmh->pool_class, dpusmh)) {
+            return DPUSM_OK;
+        }
+
+        if (EMBEDDED(dpusmh)) {
+            rc = FUNCS(dpusmh->provider)->free_private(dpusmh->handle);
+        }
+        else {
+            rc = FUNCS(dpusmh->provider)->free(dpusmh->handle);
+        }
     }
     dpusm_handle_free(dpusmh);
     return rc;
 }
 
+/* allocate or reference a single provider handle for the *_many fallbacks */
+static int
+dpusm_provider_alloc_one(const dpusm_pf_t *funcs, void *src,
+    size_t offset, size_t size, void **handle) {
+    if (funcs->private_size) {
+        return src?
+            funcs->alloc_ref_private(*handle, src, offset, size):
+            funcs->alloc_private(*handle, size);
+    }
+
+    *handle = src?funcs->alloc_ref(src, offset, size):funcs->alloc(size);
+    return *handle?DPUSM_OK:DPUSM_ERROR;
+}
+
+static int
+dpusm_provider_free_one(const dpusm_pf_t *funcs, void *handle) {
+    return funcs->private_size?funcs->free_private(handle):funcs->free(handle);
+}
+
+/*
+ * shared by alloc_many and alloc_ref_many
+ *
+ * src is NULL when allocating and a provider handle when referencing
+ *
+ * All of the wrappers are allocated with a single bulk slab
+ * allocation. If the provider has a batch function, all of the
+ * provider handles are created with one call. Otherwise, they are
+ * created one at a time.
+ *
+ * Either all count handles are created or none are.
+ */
+static int
+dpusm_alloc_many_common(dpusm_ph_t **provider, void *src, size_t count,
+    size_t *offsets, size_t *sizes, void **handles) {
+    const dpusm_pf_t *funcs = FUNCS(provider);
+    const int handle_class = funcs->private_size?(*provider)->handle_class:-1;
+    struct kmem_cache *cache = dpusm_handle_cache_of(handle_class);
+
+    void **phandles = dpusm_mem_alloc(count * sizeof(void *));
+    if (!phandles) {
+        return DPUSM_ERROR;
+    }
+
+    if (dpusm_mem_cache_alloc_bulk(cache, count, handles) != count) {
+        dpusm_mem_free(phandles, count * sizeof(void *));
+        return DPUSM_ERROR;
+    }
+
+    dpusm_handle_t **dpusmhs = (dpusm_handle_t **) handles;
+
+    /* embedded provider handles are filled in place */
+    for(size_t i = 0; i < count; i++) {
+        phandles[i] = funcs->private_size?dpusmhs[i]->private:NULL;
+    }
+
+    int rc = DPUSM_OK;
+    if (src && funcs->alloc_ref_many) {
+        rc = funcs->alloc_ref_many(src, count, offsets, sizes, phandles);
+    }
+    else if (!src && funcs->alloc_many) {
+        rc = funcs->alloc_many(count, sizes, phandles);
+    }
+    else {
+        for(size_t i = 0; i < count; i++) {
+            rc = dpusm_provider_alloc_one(funcs, src,
+                src?offsets[i]:0, sizes[i], &phandles[i]);
+            if (rc != DPUSM_OK) {
+                /* undo partial allocation */
+                while (i--) {
+                    dpusm_provider_free_one(funcs, phandles[i]);
+                }
+                break;
+            }
+        }
+    }
+
+    if (rc != DPUSM_OK) {
+        dpusm_mem_cache_free_bulk(cache, count, handles);
+        memset(handles, 0, count * sizeof(void *));
+    }
+    else {
+        for(size_t i = 0; i < count; i++) {
+            dpusmhs[i]->provider = provider;
+            dpusmhs[i]->handle = phandles[i];
+            dpusmhs[i]->pool_class = -1;
+            dpusmhs[i]->handle_class = handle_class;
+            dpusmhs[i]->host = false;
+            dpusmhs[i]->stage = NULL;
+#ifdef DEBUG
+            dpusmhs[i]->type = src?DPUSM_HANDLE_REF:DPUSM_HANDLE_REAL;
+            dpusmhs[i]->size = sizes[i];
+#endif
+            trace_dpusm_handle_construct(provider, dpusmhs[i], phandles[i]);
+        }
+    }
+
+    dpusm_mem_free(phandles, count * sizeof(void *));
+    return rc;
+}
+
+static int
+dpusm_alloc_many(void *provider, size_t count, size_t *sizes, void **handles) {
+    CHECK_PROVIDER(provider, DPUSM_ERROR);
+    if (!sizes || !handles) {
+        return DPUSM_ERROR;
+    }
+
+    if (!count) {
+        return DPUSM_OK;
+    }
+
+    return dpusm_alloc_many_common(provider, NULL, count, NULL, sizes, handles);
+}
+
+static int
+dpusm_alloc_ref_many(void *src, size_t count, size_t *offsets, size_t *sizes,
+    void **handles) {
+    CHECK_HANDLE(src, dpusmh, DPUSM_ERROR);
+    if (!offsets || !sizes || !handles) {
+        return DPUSM_ERROR;
+    }
+
+    if (!count) {
+        return DPUSM_OK;
+    }
+
+    return dpusm_alloc_many_common(dpusmh->provider, dpusmh->handle,
+        count, offsets, sizes, handles);
+}
+
+/*
+ * free handles in runs of handles from the same provider
+ *
+ * Each run is passed to the provider's batch free function if it
+ * has one, and its wrappers are returned with one bulk slab free.
+ *
+ * Handles are never cached in the pool by this function.
+ */
+int
+dpusm_handle_free_many(size_t count, void **handles) {
+    if (!handles) {
+        return DPUSM_ERROR;
+    }
+
+    if (!count) {
+        return DPUSM_OK;
+    }
+
+    void **phandles = dpusm_mem_alloc(count * sizeof(void *));
+    if (!phandles) {
+        return DPUSM_ERROR;
+    }
+
+    int rc = DPUSM_OK;
+    size_t start = 0;
+    while (start < count) {
+        dpusm_handle_t *first = (dpusm_handle_t *) handles[start];
+        if (!first) {
+            rc = DPUSM_ERROR;
+            start++;
+            continue;
+        }
+
+        size_t end = start + 1;
+        while ((end < count) && handles[end] &&
+               (((dpusm_handle_t *) handles[end])->provider == first->provider)) {
+            end++;
+        }
+
+        const size_t run = end - start;
+        for(size_t i = start; i < end; i++) {
+            dpusm_handle_t *dpusmh = (dpusm_handle_t *) handles[i];
+            phandles[i - start] = dpusmh->handle;
+            dpusm_stage_drop(dpusmh);
+            trace_dpusm_handle_free(dpusmh->provider, dpusmh, dpusmh->handle);
+        }
+
+        /* the provider might be gone, but the wrappers still need to be freed */
+        struct kmem_cache *cache = dpusm_handle_cache_of(first->handle_class);
+        if (dpusm_provider_sane(first->provider) == DPUSM_OK) {
+            const dpusm_pf_t *funcs = FUNCS(first->provider);
+            if (funcs->free_many) {
+                const int run_rc = funcs->free_many(run, phandles);
+                rc = (run_rc != DPUSM_OK)?run_rc:rc;
+            }
+            else {
+                for(size_t i = 0; i < run; i++) {
+                    const int one_rc = dpusm_provider_free_one(funcs, phandles[i]);
+                    rc = (one_rc != DPUSM_OK)?one_rc:rc;
+                }
+            }
+        }
+
+        dpusm_mem_cache_free_bulk(cache, run, &handles[start]);
+        start = end;
+    }
+
+    dpusm_mem_free(phandles, count * sizeof(void *));
+    return rc;
+}
+
 static int
 dpusm_associate_handle(void *handle, void *ptr) {
     CHECK_HANDLE(handle, dpusmh, DPUSM_ERROR);
     if (!FUNCS(dpusmh->provider)->associate_handle) {
         return (DPUSM_NOT_IMPLEMENTED);
     }
+
+    /* the provider might keep state for the association, so don't recycle this handle */
+    dpusmh->pool_class = -1;
+
     return (FUNCS(dpusmh->provider)->associate_handle(dpusmh->handle, ptr));
 }
 
 static int
 dpusm_copy_from_generic(dpusm_mv_t *mv, const void *buf, size_t size) {
-    if (!mv || !buf) {
+    if (!mv || !buf || !mv->handle) {
         return DPUSM_ERROR;
     }
 
-    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+    dpusm_handle_t *dpusmh = (dpusm_handle_t *) mv->handle;
+    CHECK_PROVIDER(dpusmh->provider, DPUSM_ERROR);
+
+    if (dpusmh->stage) {
+        const int rc = dpusm_stage_copy(dpusmh, mv->offset, buf, size);
+        if (rc != DPUSM_NOT_SUPPORTED) {
+            return rc;
+        }
+    }
+
+    CHECK_STAGED(dpusmh, DPUSM_ERROR);
 
     dpusm_mv_t actual_mv = {
         .handle = dpusmh->handle,
@@ -243,195 +810,1221 @@ dpusm_copy_to_generic(dpusm_mv_t *mv, void *buf, size_t size) {
 
     CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
 
-    dpusm_mv_t actual_mv = {
-        .handle = dpusmh->handle,
-        .offset = mv->offset,
-    };
+    dpusm_mv_t actual_mv = {
+        .handle = dpusmh->handle,
+        .offset = mv->offset,
+    };
+
+    return FUNCS(dpusmh->provider)->copy.to.generic(&actual_mv,
+        buf, size);
+}
+
+static int
+dpusm_copy_from_ptr(dpusm_mv_t *mv, const void *buf, size_t size) {
+    if (!mv || !buf) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = dpusmh->provider;
+    if (!FUNCS(provider)->copy.from.ptr) {  /* copy from ptr is optional */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    dpusm_mv_t actual_mv = {
+        .handle = dpusmh->handle,
+        .offset = mv->offset,
+    };
+
+    return FUNCS(provider)->copy.from.ptr(&actual_mv,
+        buf, size);
+}
+
+static int
+dpusm_copy_to_ptr(dpusm_mv_t *mv, void *buf, size_t size) {
+    if (!mv || !buf) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = dpusmh->provider;
+    if (!FUNCS(provider)->copy.to.ptr) {  /* copy to ptr is optional */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    dpusm_mv_t actual_mv = {
+        .handle = dpusmh->handle,
+        .offset = mv->offset,
+    };
+
+    return FUNCS(provider)->copy.to.ptr(&actual_mv,
+        buf, size);
+}
+
+static int
+dpusm_copy_from_scatterlist(dpusm_mv_t *mv,
+    struct scatterlist *sgl, unsigned int nents,
+    size_t size) {
+    if (!mv || !sgl) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = dpusmh->provider;
+    if (!FUNCS(provider)->copy.from.scatterlist) {  /* copy from scatterlist is optional */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    dpusm_mv_t actual_mv = {
+        .handle = dpusmh->handle,
+        .offset = mv->offset,
+    };
+
+    /* /\* make sure sizes are set *\/ */
+    /* size_t actual = 0; */
+    /* for(int i = 0; i < nents; i++) { */
+    /*     if ((sgl[i].length == 0) || (sgl[i].length > size)) { */
+    /*         return DPUSM_ERROR; */
+    /*     } */
+
+    /*     actual += sgl[i].length; */
+    /* } */
+
+    /* if (actual > size) { */
+    /*     return DPUSM_ERROR; */
+    /* } */
+
+    return FUNCS(provider)->copy.from.scatterlist(&actual_mv,
+        sgl, nents, size);
+}
+
+static int
+dpusm_copy_to_scatterlist(dpusm_mv_t *mv,
+    struct scatterlist *sgl, unsigned int nents,
+    size_t size) {
+    if (!mv || !sgl) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = dpusmh->provider;
+    if (!FUNCS(provider)->copy.to.scatterlist) {  /* copy to scatterlist is optional */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    dpusm_mv_t actual_mv = {
+        .handle = dpusmh->handle,
+        .offset = mv->offset,
+    };
+
+    return FUNCS(provider)->copy.to.scatterlist(&actual_mv,
+        sgl, nents, size);
+}
+
+/* copy a vmalloc buffer by building a scatterlist of its pages */
+static int
+dpusm_copy_vmalloc(dpusm_mv_t *mv, void *buf, size_t size, bool to) {
+    const size_t first = offset_in_page(buf);
+    const unsigned int nents = DIV_ROUND_UP(first + size, PAGE_SIZE);
+
+    struct sg_table table;
+    if (sg_alloc_table(&table, nents, GFP_KERNEL)) {
+        return DPUSM_NOT_SUPPORTED; /* fall back to generic */
+    }
+
+    char *ptr = buf;
+    size_t remaining = size;
+    struct scatterlist *sg = NULL;
+    unsigned int i = 0;
+    for_each_sg(table.sgl, sg, nents, i) {
+        const size_t offset = offset_in_page(ptr);
+        const size_t len = min_t(size_t, remaining, PAGE_SIZE - offset);
+        sg_set_page(sg, vmalloc_to_page(ptr), len, offset);
+        ptr += len;
+        remaining -= len;
+    }
+
+    const int rc = to?
+        dpusm_copy_to_scatterlist(mv, table.sgl, nents, size):
+        dpusm_copy_from_scatterlist(mv, table.sgl, nents, size);
+
+    sg_free_table(&table);
+    return rc;
+}
+
+/*
+ * pick a copy function based on where buf is
+ *
+ *     vmalloc:       scatterlist of its pages, or generic
+ *     linear map:    ptr, single entry scatterlist, or generic
+ *     anything else: generic
+ *
+ * ptr and scatterlist are only used when the provider supports
+ * them and the copy is at least as large as the provider's
+ * thresholds. If they fail as unsupported, generic is used.
+ */
+static int
+dpusm_copy_automatic(dpusm_mv_t *mv, void *buf, size_t size, bool to) {
+    if (!mv || !buf) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+
+    const dpusm_ph_t *ph = *dpusmh->provider;
+    const u64 optional = ph->capabilities.optional;
+    const bool ptr = size >= READ_ONCE(ph->copy_ptr_min) &&
+        (optional & (to?DPUSM_OPTIONAL_COPY_TO_PTR:DPUSM_OPTIONAL_COPY_FROM_PTR));
+    const bool sg = size >= READ_ONCE(ph->copy_scatterlist_min) &&
+        (optional & (to?DPUSM_OPTIONAL_COPY_TO_SCATTERLIST:DPUSM_OPTIONAL_COPY_FROM_SCATTERLIST));
+
+    int rc = DPUSM_NOT_SUPPORTED;
+    if (is_vmalloc_addr(buf)) {
+        if (sg) {
+            rc = dpusm_copy_vmalloc(mv, buf, size, to);
+        }
+    }
+    else if (size && virt_addr_valid(buf) && virt_addr_valid((char *) buf + size - 1)) {
+        if (ptr) {
+            rc = to?
+                dpusm_copy_to_ptr(mv, buf, size):
+                dpusm_copy_from_ptr(mv, buf, size);
+        }
+        else if (sg) {
+            struct scatterlist one;
+            sg_init_one(&one, buf, size);
+            rc = to?
+                dpusm_copy_to_scatterlist(mv, &one, 1, size):
+                dpusm_copy_from_scatterlist(mv, &one, 1, size);
+        }
+    }
+
+    if ((rc == DPUSM_NOT_SUPPORTED) || (rc == DPUSM_NOT_IMPLEMENTED)) {
+        rc = to?
+            dpusm_copy_to_generic(mv, buf, size):
+            dpusm_copy_from_generic(mv, buf, size);
+    }
+
+    return rc;
+}
+
+static int
+dpusm_copy_from_automatic(dpusm_mv_t *mv, const void *buf, size_t size) {
+    return dpusm_copy_automatic(mv, (void *) buf, size, false);
+}
+
+static int
+dpusm_copy_to_automatic(dpusm_mv_t *mv, void *buf, size_t size) {
+    return dpusm_copy_automatic(mv, buf, size, true);
+}
+
+static int
+dpusm_copy_from_async(dpusm_mv_t *mv, const void *buf, size_t size,
+    dpusm_cc_t copy_completion, void *cc_args) {
+    if (!mv || !buf || !copy_completion) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = dpusmh->provider;
+    if (!FUNCS(provider)->copy.from.async) {  /* emulated if the provider does not have it */
+        return dpusm_async_copy_emulate(mv, (void *) buf, size, false,
+            copy_completion, cc_args);
+    }
+
+    dpusm_mv_t actual_mv = {
+        .handle = dpusmh->handle,
+        .offset = mv->offset,
+    };
+
+    return FUNCS(provider)->copy.from.async(&actual_mv,
+        buf, size, copy_completion, cc_args);
+}
+
+static int
+dpusm_copy_to_async(dpusm_mv_t *mv, void *buf, size_t size,
+    dpusm_cc_t copy_completion, void *cc_args) {
+    if (!mv || !buf || !copy_completion) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = dpusmh->provider;
+    if (!FUNCS(provider)->copy.to.async) {  /* emulated if the provider does not have it */
+        return dpusm_async_copy_emulate(mv, buf, size, true,
+            copy_completion, cc_args);
+    }
+
+    dpusm_mv_t actual_mv = {
+        .handle = dpusmh->handle,
+        .offset = mv->offset,
+    };
+
+    return FUNCS(provider)->copy.to.async(&actual_mv,
+        buf, size, copy_completion, cc_args);
+}
+
+static int
+dpusm_copy_peer(dpusm_mv_t *dst, dpusm_mv_t *src, size_t size) {
+    if (!dst || !src) {
+        return DPUSM_ERROR;
+    }
+
+    /* the handles do not need to come from the same provider */
+    CHECK_HANDLE(dst->handle, dst_dpusmh, DPUSM_ERROR);
+    CHECK_HANDLE(src->handle, src_dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **dst_provider = dst_dpusmh->provider;
+    dpusm_ph_t **src_provider = src_dpusmh->provider;
+
+    dpusm_mv_t actual_dst = {
+        .handle = dst_dpusmh->handle,
+        .offset = dst->offset,
+    };
+
+    dpusm_mv_t actual_src = {
+        .handle = src_dpusmh->handle,
+        .offset = src->offset,
+    };
+
+    /* try pushing from the source, then pulling from the destination */
+    int rc = DPUSM_NOT_SUPPORTED;
+    if (FUNCS(src_provider)->copy.peer) {
+        rc = FUNCS(src_provider)->copy.peer(&actual_src,
+            module_name((*dst_provider)->module), &actual_dst, size, 1);
+    }
+
+    if (((rc == DPUSM_NOT_SUPPORTED) || (rc == DPUSM_NOT_IMPLEMENTED)) &&
+        FUNCS(dst_provider)->copy.peer) {
+        rc = FUNCS(dst_provider)->copy.peer(&actual_dst,
+            module_name((*src_provider)->module), &actual_src, size, 0);
+    }
+
+    if ((rc != DPUSM_NOT_SUPPORTED) && (rc != DPUSM_NOT_IMPLEMENTED)) {
+        return rc;
+    }
+
+    /* go through host memory */
+    void *bounce = mempool_alloc(dpusm_peer_bounce, GFP_KERNEL);
+    if (!bounce) {
+        return DPUSM_ERROR;
+    }
+
+    rc = DPUSM_OK;
+    for(size_t done = 0; (rc == DPUSM_OK) && (done < size);) {
+        const size_t len = min_t(size_t, size - done, DPUSM_PEER_BOUNCE_SIZE);
+
+        actual_src.offset = src->offset + done;
+        rc = FUNCS(src_provider)->copy.to.generic(&actual_src, bounce, len);
+        if (rc == DPUSM_OK) {
+            actual_dst.offset = dst->offset + done;
+            rc = FUNCS(dst_provider)->copy.from.generic(&actual_dst, bounce, len);
+        }
+
+        done += len;
+    }
+
+    mempool_free(bounce, dpusm_peer_bounce);
+    return rc;
+}
+
+static int
+dpusm_stage_begin(void *handle, size_t offset, size_t size) {
+    if (!size) {
+        return DPUSM_ERROR;
+    }
+
+    /* writes out the current staged range, if there is one */
+    CHECK_HANDLE(handle, dpusmh, DPUSM_ERROR);
+    dpusm_stage_drop(dpusmh);
+
+    dpusm_stage_t *stage = dpusm_mem_alloc(sizeof(dpusm_stage_t));
+    if (!stage) {
+        return DPUSM_ERROR;
+    }
+
+    stage->buf = dpusm_mem_alloc(size);
+    stage->dirty = dpusm_mem_alloc(DPUSM_STAGE_DIRTY_SIZE(size));
+    if (!stage->buf || !stage->dirty) {
+        if (stage->dirty) {
+            dpusm_mem_free(stage->dirty, DPUSM_STAGE_DIRTY_SIZE(size));
+        }
+        if (stage->buf) {
+            dpusm_mem_free(stage->buf, size);
+        }
+        dpusm_mem_free(stage, sizeof(*stage));
+        return DPUSM_ERROR;
+    }
+
+    stage->offset = offset;
+    stage->size = size;
+    bitmap_zero(stage->dirty, size);
+
+    dpusmh->stage = stage;
+    return DPUSM_OK;
+}
+
+static int
+dpusm_stage_flush(void *handle) {
+    if (!handle) {
+        return DPUSM_ERROR;
+    }
+
+    dpusm_handle_t *dpusmh = (dpusm_handle_t *) handle;
+    CHECK_PROVIDER(dpusmh->provider, DPUSM_ERROR);
+
+    if (!dpusmh->stage) {
+        return DPUSM_OK;
+    }
+
+    return dpusm_stage_flush_dirty(dpusmh);
+}
+
+static int
+dpusm_stage_end(void *handle) {
+    const int rc = dpusm_stage_flush(handle);
+    if (rc == DPUSM_OK) {
+        dpusm_stage_drop((dpusm_handle_t *) handle);
+    }
+    return rc;
+}
+
+static int
+dpusm_provider_mem_stats(void *provider,
+    size_t *t_count, size_t *t_size, size_t *t_actual,
+    size_t *a_count, size_t *a_size, size_t *a_actual) {
+    CHECK_PROVIDER(provider, DPUSM_ERROR);
+    if (!FUNCS(provider)->mem_stats) {
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+    return FUNCS(provider)->mem_stats(t_count, t_size, t_actual,
+        a_count, a_size, a_actual);
+}
+
+static int
+dpusm_zero_fill(void *handle, size_t offset, size_t size) {
+    CHECK_HANDLE(handle, dpusmh, DPUSM_ERROR);
+    if (!FUNCS(dpusmh->provider)->zero_fill) {
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+    return FUNCS(dpusmh->provider)->zero_fill(dpusmh->handle, offset, size);
+}
+
+static int
+dpusm_all_zeros(void *handle, size_t offset, size_t size) {
+    CHECK_HANDLE(handle, dpusmh, DPUSM_ERROR);
+    if (!FUNCS(dpusmh->provider)->all_zeros) {
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+    return FUNCS(dpusmh->provider)->all_zeros(dpusmh->handle, offset, size);
+}
+
+static int
+dpusm_compress(dpusm_compress_t alg, int level,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+    SAME_PROVIDERS(dst, dst_dpusmh, src, src_dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = src_dpusmh->provider;
+    if (!FUNCS(provider)->compress ||                  /* compression is optional */
+        !((*provider)->capabilities.compress & alg)) { /* make sure algorithm is implemented */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    return FUNCS(provider)->compress(alg, level,
+        src_dpusmh->handle, s_len, dst_dpusmh->handle, d_len);
+}
+
+static int
+dpusm_compress_bounded(dpusm_compress_t alg, int level,
+    void *src, size_t s_len, void *dst, size_t *d_len,
+    unsigned int max_percent) {
+    if (!d_len || !max_percent) {
+        return DPUSM_ERROR;
+    }
+
+    SAME_PROVIDERS(dst, dst_dpusmh, src, src_dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = src_dpusmh->provider;
+    if (!FUNCS(provider)->compress ||                  /* compression is optional */
+        !((*provider)->capabilities.compress & alg)) { /* make sure algorithm is implemented */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    /* largest output that is still worth keeping */
+    const size_t limit = min_t(u64, *d_len, div_u64((u64) s_len * max_percent, 100));
+
+    if (FUNCS(provider)->compress_bounded) {
+        size_t len = limit;
+        const int rc = FUNCS(provider)->compress_bounded(alg, level,
+            src_dpusmh->handle, s_len, dst_dpusmh->handle, &len);
+        if (rc == DPUSM_OK) {
+            *d_len = len;
+        }
+        return rc;
+    }
+
+    /* compress everything and check afterwards */
+    size_t len = *d_len;
+    const int rc = FUNCS(provider)->compress(alg, level,
+        src_dpusmh->handle, s_len, dst_dpusmh->handle, &len);
+    if (rc != DPUSM_OK) {
+        return rc;
+    }
+
+    if (len > limit) {
+        return DPUSM_NOT_COMPRESSIBLE;
+    }
+
+    *d_len = len;
+    return DPUSM_OK;
+}
+
+static void *
+dpusm_dict_load(void *provider, dpusm_compress_t algs,
+    const void *buf, size_t size) {
+    CHECK_PROVIDER(provider, NULL);
+
+    dpusm_ph_t **dpusmph = (dpusm_ph_t **) provider;
+    const u64 supported = (*dpusmph)->capabilities.compress |
+                          (*dpusmph)->capabilities.decompress;
+    if (!FUNCS(provider)->dict.load ||  /* dictionaries are optional */
+        !buf || !size || !algs ||
+        (algs & ~supported)) {          /* make sure the algorithms are implemented */
+        return NULL;
+    }
+
+    void *dict = FUNCS(provider)->dict.load(algs, buf, size);
+    if (!dict) {
+        return NULL;
+    }
+
+    dpusm_handle_t *dpusmh = dpusm_handle_construct(provider, dict
+#ifdef DEBUG
+        , DPUSM_HANDLE_DICT, size
+#endif
+        );
+    if (!dpusmh) {
+        FUNCS(provider)->dict.free(dict);
+    }
+    return dpusmh;
+}
+
+static int
+dpusm_dict_compress(void *dict, dpusm_compress_t alg, int level,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+    CHECK_HANDLE(dict, dict_dpusmh, DPUSM_ERROR);
+    SAME_PROVIDERS(dst, dst_dpusmh, src, src_dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = src_dpusmh->provider;
+    if (dict_dpusmh->provider != provider) {
+        return DPUSM_PROVIDER_MISMATCH;
+    }
+
+    if (!FUNCS(provider)->dict.compress ||             /* dictionaries are optional */
+        !((*provider)->capabilities.compress & alg)) { /* make sure algorithm is implemented */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    return FUNCS(provider)->dict.compress(dict_dpusmh->handle, alg, level,
+        src_dpusmh->handle, s_len, dst_dpusmh->handle, d_len);
+}
+
+static int
+dpusm_dict_decompress(void *dict, dpusm_decompress_t alg, int *level,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+    CHECK_HANDLE(dict, dict_dpusmh, DPUSM_ERROR);
+    SAME_PROVIDERS(dst, dst_dpusmh, src, src_dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = src_dpusmh->provider;
+    if (dict_dpusmh->provider != provider) {
+        return DPUSM_PROVIDER_MISMATCH;
+    }
+
+    if (!FUNCS(provider)->dict.decompress ||             /* dictionaries are optional */
+        !((*provider)->capabilities.decompress & alg)) { /* make sure algorithm is implemented */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    return FUNCS(provider)->dict.decompress(dict_dpusmh->handle, alg, level,
+        src_dpusmh->handle, s_len, dst_dpusmh->handle, d_len);
+}
+
+static int
+dpusm_dict_free(void *dict) {
+    if (!dict) {
+        return DPUSM_ERROR;
+    }
+
+    /* the wrapper is freed even if the provider has gone down */
+    dpusm_handle_t *dict_dpusmh = (dpusm_handle_t *) dict;
+    if (dpusm_provider_sane(dict_dpusmh->provider) == DPUSM_OK) {
+        /* only handles from dict.load get here, so the provider has dictionaries */
+        FUNCS(dict_dpusmh->provider)->dict.free(dict_dpusmh->handle);
+    }
+    dpusm_handle_free(dict_dpusmh);
+    return DPUSM_OK;
+}
+
+/* estimate from samples of the data copied to the host */
+static int
+dpusm_compressibility_handle(void *handle, size_t offset, size_t size,
+    unsigned int *percent) {
+    if (!size || !percent) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(handle, dpusmh, DPUSM_ERROR);
+
+    if (FUNCS(dpusmh->provider)->compressibility) {
+        const int rc = FUNCS(dpusmh->provider)->compressibility(dpusmh->handle,
+            offset, size, percent);
+        if (rc != DPUSM_NOT_SUPPORTED) {
+            return rc;
+        }
+    }
+
+    const size_t samples_size = min_t(size_t, size,
+        DPUSM_PROBE_SAMPLE_SIZE * DPUSM_PROBE_SAMPLES);
+    u8 *samples = dpusm_mem_alloc(samples_size);
+    if (!samples) {
+        return DPUSM_ERROR;
+    }
+
+    dpusm_mv_t mv = {
+        .handle = handle,
+        .offset = offset,
+    };
+
+    int rc = DPUSM_OK;
+    if (size == samples_size) {
+        rc = dpusm_copy_automatic(&mv, samples, size, true);
+    }
+    else {
+        for(size_t i = 0; (i < DPUSM_PROBE_SAMPLES) && (rc == DPUSM_OK); i++) {
+            mv.offset = offset + dpusm_probe_sample_offset(size, i);
+            rc = dpusm_copy_automatic(&mv, samples + i * DPUSM_PROBE_SAMPLE_SIZE,
+                DPUSM_PROBE_SAMPLE_SIZE, true);
+        }
+    }
+
+    if (rc == DPUSM_OK) {
+        rc = dpusm_probe_samples(samples, samples_size, percent);
+    }
+
+    dpusm_mem_free(samples, samples_size);
+    return rc;
+}
+
+static int
+dpusm_decompress(dpusm_decompress_t alg, int *level,
+    void *src, size_t s_len, void *dst, size_t *d_len) {
+    SAME_PROVIDERS(dst, dst_dpusmh, src, src_dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = src_dpusmh->provider;
+    if (!FUNCS(provider)->decompress ||                  /* decompression is optional */
+        !((*provider)->capabilities.decompress & alg)) { /* make sure algorithm is implemented */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    return FUNCS(provider)->decompress(alg, level,
+        src_dpusmh->handle, s_len, dst_dpusmh->handle, d_len);
+}
+
+/* compress_many and decompress_many - level is only used by compress */
+static int
+dpusm_compression_many(bool compress, u64 alg, int level, int *levels,
+    size_t count, void **srcs, size_t *s_lens, void **dsts, size_t *d_lens,
+    int *rcs) {
+    if (!count || !srcs || !s_lens || !dsts || !d_lens) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(srcs[0], dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = dpusmh->provider;
+    const dpusm_pc_t *caps = &(*provider)->capabilities;
+    if (compress?
+        (!FUNCS(provider)->compress || !(caps->compress & alg)):        /* compression is optional */
+        (!FUNCS(provider)->decompress || !(caps->decompress & alg))) {  /* make sure algorithm is implemented */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    /* one entry at a time */
+    if (compress?!FUNCS(provider)->compress_many:!FUNCS(provider)->decompress_many) {
+        int ret = DPUSM_OK;
+        for(size_t i = 0; i < count; i++) {
+            const int rc = compress?
+                dpusm_compress(alg, level, srcs[i], s_lens[i], dsts[i], &d_lens[i]):
+                dpusm_decompress(alg, levels?&levels[i]:&level,
+                    srcs[i], s_lens[i], dsts[i], &d_lens[i]);
+            if (rcs) {
+                rcs[i] = rc;
+            }
+            if ((rc != DPUSM_OK) && (ret == DPUSM_OK)) {
+                ret = rc;
+            }
+        }
+        return ret;
+    }
+
+    /* provider sources, provider destinations, and return values if the caller did not want them */
+    const size_t tmp_size = count * (2 * sizeof(void *) + (rcs?0:sizeof(int)));
+    void **psrcs = dpusm_mem_alloc(tmp_size);
+    if (!psrcs) {
+        return DPUSM_ERROR;
+    }
+
+    void **pdsts = psrcs + count;
+    int *prcs = rcs?rcs:(int *) (pdsts + count);
+
+    int rc = DPUSM_OK;
+    for(size_t i = 0; i < count; i++) {
+        psrcs[i] = dpusm_handle_unwrap(srcs[i], provider);
+        pdsts[i] = dpusm_handle_unwrap(dsts[i], provider);
+        if (!psrcs[i] || !pdsts[i]) {
+            rc = DPUSM_PROVIDER_MISMATCH;
+            goto free;
+        }
+    }
+
+    rc = compress?
+        FUNCS(provider)->compress_many(alg, level, count,
+            psrcs, s_lens, pdsts, d_lens, prcs):
+        FUNCS(provider)->decompress_many(alg, levels, count,
+            psrcs, s_lens, pdsts, d_lens, prcs);
+
+    if (rc == DPUSM_OK) {
+        for(size_t i = 0; i < count; i++) {
+            if (prcs[i] != DPUSM_OK) {
+                rc = prcs[i];
+                break;
+            }
+        }
+    }
+
+  free:
+    dpusm_mem_free(psrcs, tmp_size);
+    return rc;
+}
+
+static int
+dpusm_compress_many(dpusm_compress_t alg, int level, size_t count,
+    void **srcs, size_t *s_lens, void **dsts, size_t *d_lens, int *rcs) {
+    return dpusm_compression_many(true, alg, level, NULL,
+        count, srcs, s_lens, dsts, d_lens, rcs);
+}
+
+static int
+dpusm_decompress_many(dpusm_decompress_t alg, int *levels, size_t count,
+    void **srcs, size_t *s_lens, void **dsts, size_t *d_lens, int *rcs) {
+    return dpusm_compression_many(false, alg, 0, levels,
+        count, srcs, s_lens, dsts, d_lens, rcs);
+}
+
+static int
+dpusm_checksum(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *data, size_t size, void *cksum, size_t cksum_size) {
+    CHECK_HANDLE(data, data_dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = data_dpusmh->provider;
+    if (!FUNCS(provider)->checksum ||                              /* checksum is optional */
+        !((*provider)->capabilities.checksum & alg) ||             /* make sure the algorithm is implemented */
+        !((*provider)->capabilities.checksum_byteorder & order)) { /* make sure the byte order is supported */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    return FUNCS(provider)->checksum(alg, order,
+        data_dpusmh->handle, size, cksum, cksum_size);
+}
+
+/* checksum one range of a handle */
+static int
+dpusm_checksum_range(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *handle, size_t offset, size_t size, void *cksum, size_t cksum_size) {
+    if (!offset) {
+        return dpusm_checksum(alg, order, handle, size, cksum, cksum_size);
+    }
+
+    void *ref = dpusm_alloc_ref(handle, offset, size);
+    if (!ref) {
+        return DPUSM_ERROR;
+    }
+
+    const int rc = dpusm_checksum(alg, order, ref, size, cksum, cksum_size);
+    dpusm_free(ref);
+    return rc;
+}
+
+/* chunks are checksummed on the host right after they are copied, while they are still in cache */
+#define DPUSM_COPY_CKSUM_CHUNK (64 * 1024)
+
+static int
+dpusm_copy_checksum(dpusm_mv_t *mv, void *buf, size_t size, bool to,
+    dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *cksum, size_t cksum_size) {
+    if (!mv || !buf || !cksum) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = dpusmh->provider;
+    dpusm_mv_t actual_mv = {
+        .handle = dpusmh->handle,
+        .offset = mv->offset,
+    };
+
+    int rc = DPUSM_NOT_SUPPORTED;
+    if (to && FUNCS(provider)->copy.to.checksum) {
+        rc = FUNCS(provider)->copy.to.checksum(&actual_mv, buf, size,
+            alg, order, cksum, cksum_size);
+    }
+    else if (!to && FUNCS(provider)->copy.from.checksum) {
+        rc = FUNCS(provider)->copy.from.checksum(&actual_mv, buf, size,
+            alg, order, cksum, cksum_size);
+    }
+
+    if ((rc != DPUSM_NOT_SUPPORTED) && (rc != DPUSM_NOT_IMPLEMENTED)) {
+        return rc;
+    }
+
+    dpusm_host_cksum_t hc;
+    rc = dpusm_host_cksum_init(&hc, alg, order);
+    if (rc == DPUSM_NOT_SUPPORTED) {
+        /* neither side can checksum while copying */
+        rc = dpusm_copy_automatic(mv, buf, size, to);
+        return (rc == DPUSM_OK)?
+            dpusm_checksum_range(alg, order, mv->handle, mv->offset,
+                size, cksum, cksum_size):
+            rc;
+    }
+
+    if (rc != DPUSM_OK) {
+        return rc;
+    }
+
+    for(size_t done = 0; done < size; done += DPUSM_COPY_CKSUM_CHUNK) {
+        const size_t len = min_t(size_t, size - done, DPUSM_COPY_CKSUM_CHUNK);
+        dpusm_mv_t chunk = {
+            .handle = mv->handle,
+            .offset = mv->offset + done,
+        };
+
+        rc = dpusm_copy_automatic(&chunk, ((char *) buf) + done, len, to);
+        if (rc != DPUSM_OK) {
+            break;
+        }
+
+        rc = dpusm_host_cksum_update(&hc, ((char *) buf) + done, len);
+        if (rc != DPUSM_OK) {
+            break;
+        }
+    }
+
+    if (rc == DPUSM_OK) {
+        rc = dpusm_host_cksum_final(&hc, cksum, cksum_size);
+    }
+
+    dpusm_host_cksum_fini(&hc);
+    return rc;
+}
+
+static int
+dpusm_copy_from_checksum(dpusm_mv_t *mv, const void *buf, size_t size,
+    dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *cksum, size_t cksum_size) {
+    return dpusm_copy_checksum(mv, (void *) buf, size, false,
+        alg, order, cksum, cksum_size);
+}
+
+static int
+dpusm_copy_to_checksum(dpusm_mv_t *mv, void *buf, size_t size,
+    dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *cksum, size_t cksum_size) {
+    return dpusm_copy_checksum(mv, buf, size, true,
+        alg, order, cksum, cksum_size);
+}
+
+static int
+dpusm_checksum_many(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    size_t count, void **handles, size_t *offsets, size_t *sizes,
+    void *cksums, size_t cksum_size, int *rcs) {
+    if (!count || !handles || !offsets || !sizes || !cksums) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(handles[0], dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = dpusmh->provider;
+    if (!FUNCS(provider)->checksum ||                              /* checksum is optional */
+        !((*provider)->capabilities.checksum & alg) ||             /* make sure the algorithm is implemented */
+        !((*provider)->capabilities.checksum_byteorder & order)) { /* make sure the byte order is supported */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    /* one checksum at a time */
+    if (!FUNCS(provider)->checksum_many) {
+        int ret = DPUSM_OK;
+        for(size_t i = 0; i < count; i++) {
+            const int rc = dpusm_checksum_range(alg, order,
+                handles[i], offsets[i], sizes[i],
+                (char *) cksums + i * cksum_size, cksum_size);
+            if (rcs) {
+                rcs[i] = rc;
+            }
+            if ((rc != DPUSM_OK) && (ret == DPUSM_OK)) {
+                ret = rc;
+            }
+        }
+        return ret;
+    }
+
+    /* provider handles, followed by return values if the caller did not want them */
+    const size_t tmp_size = count * (sizeof(void *) + (rcs?0:sizeof(int)));
+    void **phandles = dpusm_mem_alloc(tmp_size);
+    if (!phandles) {
+        return DPUSM_ERROR;
+    }
+
+    int *prcs = rcs?rcs:(int *) (phandles + count);
+
+    int rc = DPUSM_OK;
+    for(size_t i = 0; i < count; i++) {
+        phandles[i] = dpusm_handle_unwrap(handles[i], provider);
+        if (!phandles[i]) {
+            rc = DPUSM_PROVIDER_MISMATCH;
+            goto free;
+        }
+    }
+
+    rc = FUNCS(provider)->checksum_many(alg, order, count,
+        phandles, offsets, sizes, cksums, cksum_size, prcs);
+
+    if (rc == DPUSM_OK) {
+        for(size_t i = 0; i < count; i++) {
+            if (prcs[i] != DPUSM_OK) {
+                rc = prcs[i];
+                break;
+            }
+        }
+    }
+
+  free:
+    dpusm_mem_free(phandles, tmp_size);
+    return rc;
+}
+
+/* checksums up to this size are compared on the stack */
+#define DPUSM_CKSUM_VERIFY_STACK 64
+
+static int
+dpusm_checksum_verify(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *data, size_t size, const void *expected, size_t cksum_size) {
+    if (!expected || !cksum_size) {
+        return DPUSM_ERROR;
+    }
+
+    CHECK_HANDLE(data, data_dpusmh, DPUSM_ERROR);
+
+    dpusm_ph_t **provider = data_dpusmh->provider;
+    if (!FUNCS(provider)->checksum ||                              /* checksum is optional */
+        !((*provider)->capabilities.checksum & alg) ||             /* make sure the algorithm is implemented */
+        !((*provider)->capabilities.checksum_byteorder & order)) { /* make sure the byte order is supported */
+        return DPUSM_NOT_IMPLEMENTED;
+    }
+
+    if (FUNCS(provider)->checksum_verify) {
+        return FUNCS(provider)->checksum_verify(alg, order,
+            data_dpusmh->handle, size, expected, cksum_size);
+    }
+
+    /* bring the checksum back and compare it here */
+    u8 stack[DPUSM_CKSUM_VERIFY_STACK];
+    void *actual = (cksum_size <= sizeof(stack))?stack:dpusm_mem_alloc(cksum_size);
+    if (!actual) {
+        return DPUSM_ERROR;
+    }
+
+    int rc = FUNCS(provider)->checksum(alg, order,
+        data_dpusmh->handle, size, actual, cksum_size);
+    if ((rc == DPUSM_OK) && memcmp(actual, expected, cksum_size)) {
+        rc = DPUSM_CHECKSUM_MISMATCH;
+    }
+
+    if (actual != stack) {
+        dpusm_mem_free(actual, cksum_size);
+    }
 
-    return FUNCS(dpusmh->provider)->copy.to.generic(&actual_mv,
-        buf, size);
+    return rc;
 }
 
+/* verify one range of a handle */
 static int
-dpusm_copy_from_ptr(dpusm_mv_t *mv, const void *buf, size_t size) {
-    if (!mv || !buf) {
-        return DPUSM_ERROR;
+dpusm_checksum_verify_range(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    void *handle, size_t offset, size_t size, const void *expected, size_t cksum_size) {
+    if (!offset) {
+        return dpusm_checksum_verify(alg, order, handle, size, expected, cksum_size);
     }
 
-    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
-
-    dpusm_ph_t **provider = dpusmh->provider;
-    if (!FUNCS(provider)->copy.from.ptr) {  /* copy from ptr is optional */
-        return DPUSM_NOT_IMPLEMENTED;
+    void *ref = dpusm_alloc_ref(handle, offset, size);
+    if (!ref) {
+        return DPUSM_ERROR;
     }
 
-    dpusm_mv_t actual_mv = {
-        .handle = dpusmh->handle,
-        .offset = mv->offset,
-    };
-
-    return FUNCS(provider)->copy.from.ptr(&actual_mv,
-        buf, size);
+    const int rc = dpusm_checksum_verify(alg, order, ref, size, expected, cksum_size);
+    dpusm_free(ref);
+    return rc;
 }
 
 static int
-dpusm_copy_to_ptr(dpusm_mv_t *mv, void *buf, size_t size) {
-    if (!mv || !buf) {
+dpusm_checksum_verify_many(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
+    size_t count, void **handles, size_t *offsets, size_t *sizes,
+    const void *expected, size_t cksum_size, int *rcs) {
+    if (!count || !handles || !offsets || !sizes || !expected || !cksum_size) {
         return DPUSM_ERROR;
     }
 
-    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+    CHECK_HANDLE(handles[0], dpusmh, DPUSM_ERROR);
 
     dpusm_ph_t **provider = dpusmh->provider;
-    if (!FUNCS(provider)->copy.to.ptr) {  /* copy to ptr is optional */
+    if (!FUNCS(provider)->checksum ||                              /* checksum is optional */
+        !((*provider)->capabilities.checksum & alg) ||             /* make sure the algorithm is implemented */
+        !((*provider)->capabilities.checksum_byteorder & order)) { /* make sure the byte order is supported */
         return DPUSM_NOT_IMPLEMENTED;
     }
 
-    dpusm_mv_t actual_mv = {
-        .handle = dpusmh->handle,
-        .offset = mv->offset,
-    };
-
-    return FUNCS(provider)->copy.to.ptr(&actual_mv,
-        buf, size);
-}
+    const int verify_many = !!FUNCS(provider)->checksum_verify_many;
+
+    /* one range at a time */
+    if (!verify_many && !FUNCS(provider)->checksum_many) {
+        int ret = DPUSM_OK;
+        for(size_t i = 0; i < count; i++) {
+            const int rc = dpusm_checksum_verify_range(alg, order,
+                handles[i], offsets[i], sizes[i],
+                (const char *) expected + i * cksum_size, cksum_size);
+            if (rcs) {
+                rcs[i] = rc;
+            }
+            if ((rc != DPUSM_OK) && (ret == DPUSM_OK)) {
+                ret = rc;
+            }
+        }
+        return ret;
+    }
 
-static int
-dpusm_copy_from_scatterlist(dpusm_mv_t *mv,
-    struct scatterlist *sgl, unsigned int nents,
-    size_t size) {
-    if (!mv || !sgl) {
+    /*
+     * provider handles, followed by return values if the caller did not
+     * want them, followed by the checksums if the provider cannot verify
+     */
+    const size_t rcs_size = rcs?0:(count * sizeof(int));
+    const size_t cksums_size = verify_many?0:(count * cksum_size);
+    const size_t tmp_size = count * sizeof(void *) + rcs_size + cksums_size;
+    void **phandles = dpusm_mem_alloc(tmp_size);
+    if (!phandles) {
         return DPUSM_ERROR;
     }
 
-    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+    int *prcs = rcs?rcs:(int *) (phandles + count);
+    char *cksums = (char *) (phandles + count) + rcs_size;
 
-    dpusm_ph_t **provider = dpusmh->provider;
-    if (!FUNCS(provider)->copy.from.scatterlist) {  /* copy from scatterlist is optional */
-        return DPUSM_NOT_IMPLEMENTED;
+    int rc = DPUSM_OK;
+    for(size_t i = 0; i < count; i++) {
+        phandles[i] = dpusm_handle_unwrap(handles[i], provider);
+        if (!phandles[i]) {
+            rc = DPUSM_PROVIDER_MISMATCH;
+            goto free;
+        }
     }
 
-    dpusm_mv_t actual_mv = {
-        .handle = dpusmh->handle,
-        .offset = mv->offset,
-    };
-
-    /* /\* make sure sizes are set *\/ */
-    /* size_t actual = 0; */
-    /* for(int i = 0; i < nents; i++) { */
-    /*     if ((sgl[i].length == 0) || (sgl[i].length > size)) { */
-    /*         return DPUSM_ERROR; */
-    /*     } */
+    if (verify_many) {
+        rc = FUNCS(provider)->checksum_verify_many(alg, order, count,
+            phandles, offsets, sizes, expected, cksum_size, prcs);
+    }
+    else {
+        rc = FUNCS(provider)->checksum_many(alg, order, count,
+            phandles, offsets, sizes, cksums, cksum_size, prcs);
+
+        /* the checksums and return values might not have been written on failure */
+        if (rc == DPUSM_OK) {
+            for(size_t i = 0; i < count; i++) {
+                if ((prcs[i] == DPUSM_OK) &&
+                    memcmp(cksums + i * cksum_size, (const char *) expected + i * cksum_size, cksum_size)) {
+                    prcs[i] = DPUSM_CHECKSUM_MISMATCH;
+                }
+            }
+        }
+    }
 
-    /*     actual += sgl[i].length; */
-    /* } */
+    /* mismatches are not failures of the batch itself */
+    if ((rc == DPUSM_OK) || (rc == DPUSM_CHECKSUM_MISMATCH)) {
+        rc = DPUSM_OK;
+        for(size_t i = 0; i < count; i++) {
+            if (prcs[i] != DPUSM_OK) {
+                rc = prcs[i];
+                break;
+            }
+        }
+    }
 
-    /* if (actual > size) { */
-    /*     return DPUSM_ERROR; */
-    /* } */
+  free:
+    dpusm_mem_free(phandles, tmp_size);
+    return rc;
+}
 
-    return FUNCS(provider)->copy.from.scatterlist(&actual_mv,
-        sgl, nents, size);
+/*
+ * checksum context of providers without checksum_ctx
+ *
+ * Each segment is copied to the host a bounce buffer at a time and
+ * added to a host checksum as soon as it is added, so nothing has to
+ * be remembered or allocated on the provider.
+ */
+static void
+dpusm_cksum_ctx_destroy(dpusm_host_cksum_t *hc) {
+    dpusm_host_cksum_fini(hc);
+    dpusm_mem_free(hc, sizeof(*hc));
 }
 
 static int
-dpusm_copy_to_scatterlist(dpusm_mv_t *mv,
-    struct scatterlist *sgl, unsigned int nents,
-    size_t size) {
-    if (!mv || !sgl) {
+dpusm_cksum_ctx_update(dpusm_host_cksum_t *hc, void *handle, size_t offset, size_t size) {
+    void *bounce = mempool_alloc(dpusm_peer_bounce, GFP_KERNEL);
+    if (!bounce) {
         return DPUSM_ERROR;
     }
 
-    CHECK_HANDLE(mv->handle, dpusmh, DPUSM_ERROR);
+    int rc = DPUSM_OK;
+    for(size_t done = 0; (rc == DPUSM_OK) && (done < size);) {
+        const size_t len = min_t(size_t, size - done, DPUSM_PEER_BOUNCE_SIZE);
+        dpusm_mv_t chunk = {
+            .handle = handle,
+            .offset = offset + done,
+        };
+
+        rc = dpusm_copy_automatic(&chunk, bounce, len, true);
+        if (rc == DPUSM_OK) {
+            rc = dpusm_host_cksum_update(hc, bounce, len);
+        }
 
-    dpusm_ph_t **provider = dpusmh->provider;
-    if (!FUNCS(provider)->copy.to.scatterlist) {  /* copy to scatterlist is optional */
-        return DPUSM_NOT_IMPLEMENTED;
+        done += len;
     }
 
-    dpusm_mv_t actual_mv = {
-        .handle = dpusmh->handle,
-        .offset = mv->offset,
-    };
-
-    return FUNCS(provider)->copy.to.scatterlist(&actual_mv,
-        sgl, nents, size);
+    mempool_free(bounce, dpusm_peer_bounce);
+    return rc;
 }
 
-static int
-dpusm_provider_mem_stats(void *provider,
-    size_t *t_count, size_t *t_size, size_t *t_actual,
-    size_t *a_count, size_t *a_size, size_t *a_actual) {
-    CHECK_PROVIDER(provider, DPUSM_ERROR);
-    if (!FUNCS(provider)->mem_stats) {
-        return DPUSM_NOT_IMPLEMENTED;
+static void
+dpusm_checksum_ctx_release(dpusm_ph_t **provider, void *ctx) {
+    if (FUNCS(provider)->checksum_ctx.free) {
+        FUNCS(provider)->checksum_ctx.free(ctx);
+    }
+    else {
+        dpusm_cksum_ctx_destroy(ctx);
     }
-    return FUNCS(provider)->mem_stats(t_count, t_size, t_actual,
-        a_count, a_size, a_actual);
 }
 
-static int
-dpusm_zero_fill(void *handle, size_t offset, size_t size) {
-    CHECK_HANDLE(handle, dpusmh, DPUSM_ERROR);
-    if (!FUNCS(dpusmh->provider)->zero_fill) {
-        return DPUSM_NOT_IMPLEMENTED;
+/* host side state is always freed, even if the provider has gone down */
+static void
+dpusm_checksum_ctx_handle_free(dpusm_handle_t *ctx_dpusmh) {
+    if (ctx_dpusmh->host) {
+        dpusm_cksum_ctx_destroy(ctx_dpusmh->handle);
     }
-    return FUNCS(dpusmh->provider)->zero_fill(dpusmh->handle, offset, size);
+    else if (dpusm_provider_sane(ctx_dpusmh->provider) == DPUSM_OK) {
+        FUNCS(ctx_dpusmh->provider)->checksum_ctx.free(ctx_dpusmh->handle);
+    }
+    dpusm_handle_free(ctx_dpusmh);
 }
 
-static int
-dpusm_all_zeros(void *handle, size_t offset, size_t size) {
-    CHECK_HANDLE(handle, dpusmh, DPUSM_ERROR);
-    if (!FUNCS(dpusmh->provider)->all_zeros) {
-        return DPUSM_NOT_IMPLEMENTED;
+static void *
+dpusm_checksum_ctx_init(void *provider, dpusm_checksum_t alg,
+    dpusm_checksum_byteorder_t order) {
+    CHECK_PROVIDER(provider, NULL);
+
+    dpusm_ph_t **dpusmph = (dpusm_ph_t **) provider;
+    if (!FUNCS(provider)->checksum ||                              /* checksum is optional */
+        !((*dpusmph)->capabilities.checksum & alg) ||              /* make sure the algorithm is implemented */
+        !((*dpusmph)->capabilities.checksum_byteorder & order)) {  /* make sure the byte order is supported */
+        return NULL;
     }
-    return FUNCS(dpusmh->provider)->all_zeros(dpusmh->handle, offset, size);
+
+    void *ctx = NULL;
+    if (FUNCS(provider)->checksum_ctx.init) {
+        ctx = FUNCS(provider)->checksum_ctx.init(alg, order);
+    }
+    else {
+        /* NULL if the host cannot compute alg either */
+        dpusm_host_cksum_t *hc = dpusm_mem_alloc(sizeof(*hc));
+        if (hc && (dpusm_host_cksum_init(hc, alg, order) != DPUSM_OK)) {
+            dpusm_mem_free(hc, sizeof(*hc));
+            hc = NULL;
+        }
+        ctx = hc;
+    }
+
+    if (!ctx) {
+        return NULL;
+    }
+
+    dpusm_handle_t *dpusmh = dpusm_handle_construct(provider, ctx
+#ifdef DEBUG
+        , DPUSM_HANDLE_CHECKSUM, 0
+#endif
+        );
+    if (!dpusmh) {
+        dpusm_checksum_ctx_release(provider, ctx);
+        return NULL;
+    }
+
+    dpusmh->host = !FUNCS(provider)->checksum_ctx.init;
+    return dpusmh;
 }
 
 static int
-dpusm_compress(dpusm_compress_t alg, int level,
-    void *src, size_t s_len, void *dst, size_t *d_len) {
-    SAME_PROVIDERS(dst, dst_dpusmh, src, src_dpusmh, DPUSM_ERROR);
+dpusm_checksum_ctx_update(void *ctx, void *handle, size_t offset, size_t size) {
+    SAME_PROVIDERS(ctx, ctx_dpusmh, handle, dpusmh, DPUSM_ERROR);
 
-    dpusm_ph_t **provider = src_dpusmh->provider;
-    if (!FUNCS(provider)->compress ||                  /* compression is optional */
-        !((*provider)->capabilities.compress & alg)) { /* make sure algorithm is implemented */
-        return DPUSM_NOT_IMPLEMENTED;
+    if (ctx_dpusmh->host) {
+        return dpusm_cksum_ctx_update(ctx_dpusmh->handle, handle, offset, size);
     }
 
-    return FUNCS(provider)->compress(alg, level,
-        src_dpusmh->handle, s_len, dst_dpusmh->handle, d_len);
+    return FUNCS(ctx_dpusmh->provider)->checksum_ctx.update(ctx_dpusmh->handle,
+        dpusmh->handle, offset, size);
 }
 
 static int
-dpusm_decompress(dpusm_decompress_t alg, int *level,
-    void *src, size_t s_len, void *dst, size_t *d_len) {
-    SAME_PROVIDERS(dst, dst_dpusmh, src, src_dpusmh, DPUSM_ERROR);
-
-    dpusm_ph_t **provider = src_dpusmh->provider;
-    if (!FUNCS(provider)->decompress ||                  /* decompression is optional */
-        !((*provider)->capabilities.decompress & alg)) { /* make sure algorithm is implemented */
-        return DPUSM_NOT_IMPLEMENTED;
+dpusm_checksum_ctx_free(void *ctx) {
+    if (!ctx) {
+        return DPUSM_ERROR;
     }
 
-    return FUNCS(provider)->decompress(alg, level,
-        src_dpusmh->handle, s_len, dst_dpusmh->handle, d_len);
+    dpusm_checksum_ctx_handle_free((dpusm_handle_t *) ctx);
+    return DPUSM_OK;
 }
 
 static int
-dpusm_checksum(dpusm_checksum_t alg, dpusm_checksum_byteorder_t order,
-    void *data, size_t size, void *cksum, size_t cksum_size) {
-    CHECK_HANDLE(data, data_dpusmh, DPUSM_ERROR);
+dpusm_checksum_ctx_final(void *ctx, void *cksum, size_t cksum_size) {
+    if (!ctx) {
+        return DPUSM_ERROR;
+    }
 
-    dpusm_ph_t **provider = data_dpusmh->provider;
-    if (!FUNCS(provider)->checksum ||                              /* checksum is optional */
-        !((*provider)->capabilities.checksum & alg) ||             /* make sure the algorithm is implemented */
-        !((*provider)->capabilities.checksum_byteorder & order)) { /* make sure the byte order is supported */
-        return DPUSM_NOT_IMPLEMENTED;
+    /* the context is freed whether or not the checksum can be computed */
+    dpusm_handle_t *ctx_dpusmh = (dpusm_handle_t *) ctx;
+    dpusm_ph_t **provider = ctx_dpusmh->provider;
+
+    int rc = DPUSM_ERROR;
+    if (ctx_dpusmh->host) {
+        rc = dpusm_host_cksum_final(ctx_dpusmh->handle, cksum, cksum_size);
+    }
+    else if (dpusm_provider_sane(provider) == DPUSM_OK) {
+        rc = FUNCS(provider)->checksum_ctx.final(ctx_dpusmh->handle, cksum, cksum_size);
     }
 
-    return FUNCS(provider)->checksum(alg, order,
-        data_dpusmh->handle, size, cksum, cksum_size);
+    dpusm_checksum_ctx_handle_free(ctx_dpusmh);
+    return rc;
 }
 
 static int dpusm_raid_can_compute(void *provider, size_t nparity, size_t ndata,
@@ -686,35 +2279,308 @@ dpusm_disk_close(void *disk) {
     return DPUSM_OK;
 }
 
+int
+dpusm_op_run(dpusm_op_t *op) {
+    switch (op->type) {
+        case DPUSM_OP_COMPRESS:
+            return dpusm_compress(op->compress.alg, op->compress.level,
+                op->compress.src, op->compress.s_len,
+                op->compress.dst, op->compress.d_len);
+        case DPUSM_OP_DECOMPRESS:
+            return dpusm_decompress(op->decompress.alg, op->decompress.level,
+                op->decompress.src, op->decompress.s_len,
+                op->decompress.dst, op->decompress.d_len);
+        case DPUSM_OP_CHECKSUM:
+            return dpusm_checksum(op->checksum.alg, op->checksum.order,
+                op->checksum.data, op->checksum.size,
+                op->checksum.cksum, op->checksum.cksum_size);
+        case DPUSM_OP_RAID_GEN:
+            return dpusm_raid_gen(op->raid_gen.raid);
+        case DPUSM_OP_RAID_REC:
+            return dpusm_raid_rec(op->raid_rec.raid,
+                op->raid_rec.tgts, op->raid_rec.ntgts);
+        case DPUSM_OP_COPY_FROM:
+            return dpusm_copy_from_generic(&op->copy_from.mv,
+                op->copy_from.buf, op->copy_from.size);
+        case DPUSM_OP_COPY_TO:
+            return dpusm_copy_to_generic(&op->copy_to.mv,
+                op->copy_to.buf, op->copy_to.size);
+        case DPUSM_OP_FILE_WRITE:
+            return dpusm_file_write(op->file_write.fp_handle,
+                op->file_write.data, op->file_write.size,
+                op->file_write.trailing_zeros, op->file_write.offset,
+                op->file_write.ashift, op->file_write.resid,
+                op->file_write.err);
+        case DPUSM_OP_RAID_SET_COLUMN:
+            return dpusm_raid_set_column(op->raid_set_column.raid,
+                op->raid_set_column.c, op->raid_set_column.col,
+                op->raid_set_column.size);
+        case DPUSM_OP_DISK_WRITE:
+            return dpusm_disk_write(op->disk_write.disk,
+                op->disk_write.data, op->disk_write.data_size,
+                op->disk_write.trailing_zeros, op->disk_write.io_offset,
+                op->disk_write.flags, op->disk_write.write_completion,
+                op->disk_write.wc_args);
+        default:
+            break;
+    }
+
+    return DPUSM_NOT_SUPPORTED;
+}
+
+#define UNWRAP(provider, handle)                                \
+    do {                                                        \
+        (handle) = dpusm_handle_unwrap((handle), (provider));   \
+        if (!(handle)) {                                        \
+            return DPUSM_PROVIDER_MISMATCH;                     \
+        }                                                       \
+    } while (0)
+
+int
+dpusm_op_unwrap(void *provider, dpusm_op_t *uop, dpusm_op_t *pop) {
+    *pop = *uop;
+
+    switch (pop->type) {
+        case DPUSM_OP_COMPRESS:
+            UNWRAP(provider, pop->compress.src);
+            UNWRAP(provider, pop->compress.dst);
+            break;
+        case DPUSM_OP_DECOMPRESS:
+            UNWRAP(provider, pop->decompress.src);
+            UNWRAP(provider, pop->decompress.dst);
+            break;
+        case DPUSM_OP_CHECKSUM:
+            UNWRAP(provider, pop->checksum.data);
+            break;
+        case DPUSM_OP_RAID_GEN:
+            UNWRAP(provider, pop->raid_gen.raid);
+            break;
+        case DPUSM_OP_RAID_REC:
+            UNWRAP(provider, pop->raid_rec.raid);
+            break;
+        case DPUSM_OP_COPY_FROM:
+            UNWRAP(provider, pop->copy_from.mv.handle);
+            break;
+        case DPUSM_OP_COPY_TO:
+            UNWRAP(provider, pop->copy_to.mv.handle);
+            break;
+        case DPUSM_OP_FILE_WRITE:
+            UNWRAP(provider, pop->file_write.fp_handle);
+            UNWRAP(provider, pop->file_write.data);
+            break;
+        case DPUSM_OP_RAID_SET_COLUMN:
+            UNWRAP(provider, pop->raid_set_column.raid);
+            UNWRAP(provider, pop->raid_set_column.col);
+            break;
+        case DPUSM_OP_DISK_WRITE:
+            UNWRAP(provider, pop->disk_write.disk);
+            UNWRAP(provider, pop->disk_write.data);
+            break;
+        default:
+            return DPUSM_NOT_SUPPORTED;
+    }
+
+    return DPUSM_OK;
+}
+
+/* the handle that determines which provider runs an operation */
+static void *
+dpusm_op_handle(dpusm_op_t *op) {
+    switch (op->type) {
+        case DPUSM_OP_COMPRESS:         return op->compress.src;
+        case DPUSM_OP_DECOMPRESS:       return op->decompress.src;
+        case DPUSM_OP_CHECKSUM:         return op->checksum.data;
+        case DPUSM_OP_RAID_GEN:         return op->raid_gen.raid;
+        case DPUSM_OP_RAID_REC:         return op->raid_rec.raid;
+        case DPUSM_OP_COPY_FROM:        return op->copy_from.mv.handle;
+        case DPUSM_OP_COPY_TO:          return op->copy_to.mv.handle;
+        case DPUSM_OP_FILE_WRITE:       return op->file_write.fp_handle;
+        case DPUSM_OP_RAID_SET_COLUMN:  return op->raid_set_column.raid;
+        case DPUSM_OP_DISK_WRITE:       return op->disk_write.disk;
+        default:                        break;
+    }
+    return NULL;
+}
+
+/* returns 0 if the operation has no output length */
+static int
+dpusm_op_output_len(dpusm_op_t *op, size_t *len) {
+    size_t *d_len = NULL;
+    switch (op->type) {
+        case DPUSM_OP_COMPRESS:   d_len = op->compress.d_len;   break;
+        case DPUSM_OP_DECOMPRESS: d_len = op->decompress.d_len; break;
+        default:                  break;
+    }
+
+    if (!d_len) {
+        return 0;
+    }
+
+    *len = *d_len;
+    return 1;
+}
+
+static void
+dpusm_op_set_input_len(dpusm_op_t *op, size_t len) {
+    switch (op->type) {
+        case DPUSM_OP_COMPRESS:         op->compress.s_len = len;        break;
+        case DPUSM_OP_DECOMPRESS:       op->decompress.s_len = len;      break;
+        case DPUSM_OP_CHECKSUM:         op->checksum.size = len;         break;
+        case DPUSM_OP_COPY_FROM:        op->copy_from.size = len;        break;
+        case DPUSM_OP_COPY_TO:          op->copy_to.size = len;          break;
+        case DPUSM_OP_FILE_WRITE:       op->file_write.size = len;       break;
+        case DPUSM_OP_RAID_SET_COLUMN:  op->raid_set_column.size = len;  break;
+        case DPUSM_OP_DISK_WRITE:       op->disk_write.data_size = len;  break;
+        default:                        break;
+    }
+}
+
+/* run the stages one at a time through the user functions */
+static int
+dpusm_chain_emulate(dpusm_op_t *stages, size_t count, size_t *completed) {
+    size_t prev_len = 0;
+    int have_prev_len = 0;
+
+    for(size_t i = 0; i < count; i++) {
+        dpusm_op_t stage = stages[i];
+        if (stage.flags & DPUSM_OP_SIZE_FROM_PREV) {
+            if (!have_prev_len) {
+                stages[i].rc = DPUSM_ERROR;
+                return DPUSM_ERROR;
+            }
+            dpusm_op_set_input_len(&stage, prev_len);
+        }
+
+        stages[i].rc = dpusm_op_run(&stage);
+        if (stages[i].rc != DPUSM_OK) {
+            return stages[i].rc;
+        }
+
+        have_prev_len = dpusm_op_output_len(&stage, &prev_len);
+        (*completed)++;
+    }
+
+    return DPUSM_OK;
+}
+
+static int
+dpusm_chain(dpusm_op_t *stages, size_t count, size_t *completed) {
+    size_t done = 0;
+    if (!completed) {
+        completed = &done;
+    }
+    *completed = 0;
+
+    if (!stages || !count) {
+        return DPUSM_ERROR;
+    }
+
+    dpusm_handle_t *dpusmh = (dpusm_handle_t *) dpusm_op_handle(&stages[0]);
+    if (!dpusmh) {
+        return DPUSM_ERROR;
+    }
+
+    dpusm_ph_t **provider = dpusmh->provider;
+    CHECK_PROVIDER(provider, DPUSM_ERROR);
+
+    if (!FUNCS(provider)->chain) {
+        return dpusm_chain_emulate(stages, count, completed);
+    }
+
+    dpusm_op_t *pstages = dpusm_mem_alloc(count * sizeof(dpusm_op_t));
+    if (!pstages) {
+        return DPUSM_ERROR;
+    }
+
+    int rc = DPUSM_OK;
+    for(size_t i = 0; i < count; i++) {
+        rc = dpusm_op_unwrap(provider, &stages[i], &pstages[i]);
+        if (rc != DPUSM_OK) {
+            stages[i].rc = rc;
+            goto free;
+        }
+        pstages[i].rc = DPUSM_OK;
+    }
+
+    rc = FUNCS(provider)->chain(pstages, count, completed);
+
+    /* report the stages that ran, including the one that failed */
+    for(size_t i = 0; (i < count) && (i <= *completed); i++) {
+        stages[i].rc = pstages[i].rc;
+    }
+
+  free:
+    dpusm_mem_free(pstages, count * sizeof(dpusm_op_t));
+    return rc;
+}
+
 static const dpusm_uf_t user_functions = {
     .get              = dpusm_get_provider,
     .get_name         = dpusm_get_provider_name,
     .put              = dpusm_put_provider,
     .extract          = dpusm_extract_provider,
     .capabilities     = dpusm_get_capabilities,
+    .algorithm_properties = dpusm_get_algorithm_properties,
     .alloc            = dpusm_alloc,
     .alloc_ref        = dpusm_alloc_ref,
     .get_size         = dpusm_get_size,
     .free             = dpusm_free,
+    .alloc_many       = dpusm_alloc_many,
+    .alloc_ref_many   = dpusm_alloc_ref_many,
+    .free_many        = dpusm_handle_free_many,
     .associate_handle = dpusm_associate_handle,
     .copy             = {
                             .from = {
                                      .generic     = dpusm_copy_from_generic,
                                      .ptr         = dpusm_copy_from_ptr,
                                      .scatterlist = dpusm_copy_from_scatterlist,
+                                     .automatic   = dpusm_copy_from_automatic,
+                                     .async       = dpusm_copy_from_async,
+                                     .checksum    = dpusm_copy_from_checksum,
                                     },
                             .to   = {
                                      .generic     = dpusm_copy_to_generic,
                                      .ptr         = dpusm_copy_to_ptr,
                                      .scatterlist = dpusm_copy_to_scatterlist,
+                                     .automatic   = dpusm_copy_to_automatic,
+                                     .async       = dpusm_copy_to_async,
+                                     .checksum    = dpusm_copy_to_checksum,
                                     },
+                            .peer = dpusm_copy_peer,
                      },
+    .stage            = {
+                            .begin       = dpusm_stage_begin,
+                            .flush       = dpusm_stage_flush,
+                            .end         = dpusm_stage_end,
+                        },
     .mem_stats        = dpusm_provider_mem_stats,
     .zero_fill        = dpusm_zero_fill,
     .all_zeros        = dpusm_all_zeros,
     .compress         = dpusm_compress,
     .decompress       = dpusm_decompress,
+    .compress_many    = dpusm_compress_many,
+    .decompress_many  = dpusm_decompress_many,
+    .compress_bounded = dpusm_compress_bounded,
+    .compressibility  = {
+                            .handle      = dpusm_compressibility_handle,
+                            .buf         = dpusm_probe,
+                        },
+    .dict             = {
+                            .load        = dpusm_dict_load,
+                            .compress    = dpusm_dict_compress,
+                            .decompress  = dpusm_dict_decompress,
+                            .free        = dpusm_dict_free,
+                        },
     .checksum         = dpusm_checksum,
+    .checksum_many    = dpusm_checksum_many,
+    .checksum_verify  = dpusm_checksum_verify,
+    .checksum_verify_many = dpusm_checksum_verify_many,
+    .checksum_ctx     = {
+                            .init        = dpusm_checksum_ctx_init,
+                            .update      = dpusm_checksum_ctx_update,
+                            .final       = dpusm_checksum_ctx_final,
+                            .free        = dpusm_checksum_ctx_free,
+                        },
     .raid             = {
                             .can_compute = dpusm_raid_can_compute,
                             .alloc       = dpusm_raid_alloc,
@@ -736,6 +2602,14 @@ static const dpusm_uf_t user_functions = {
                             .flush       = dpusm_disk_flush,
                             .close       = dpusm_disk_close,
                         },
+    .chain            = dpusm_chain,
+    .async            = {
+                            .queue_create  = dpusm_async_queue_create,
+                            .submit        = dpusm_async_submit,
+                            .poll          = dpusm_async_poll,
+                            .drain         = dpusm_async_drain,
+                            .queue_destroy = dpusm_async_queue_destroy,
+                        },
 };
 
 const dpusm_uf_t *